@@ -1,7 +1,47 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 
+#include "DICOMAppHelper.h"
+#include "DICOMParser.h"
+#include "Profiler/FrameProfiler.hpp"
+#include "Profiler/Json.hpp"
+#include "Profiler/PeakMemory.hpp"
+#include "Scheduler/SliceLoader.hpp"
+#include "Scheduler/TileScheduler.hpp"
+#include "Volume/BrickCache.hpp"
+#include "Volume/BrickPyramid.hpp"
+#include "Volume/FrameCache.hpp"
+#include "Volume/GradientVolume.hpp"
+#include "Volume/GridTraversal.hpp"
+#include "Volume/MacrocellGrid.hpp"
+#include "Volume/PacketTracer.hpp"
+#include "Volume/Phantoms.hpp"
+#include "Volume/Progressive.hpp"
+#include "Volume/RayCamera.hpp"
+#include "Volume/Series.hpp"
+#include "Volume/TransferFunction.hpp"
+#include "Volume/Volume.hpp"
+#include "Volume/VolumeCache.hpp"
+#include "Volume/Window.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 uint32_t factorial(uint32_t number)
 {
@@ -15,3 +55,1071 @@ TEST_CASE("Factorials are computed", "[factorial]")
     REQUIRE(factorial(3) == 6);
     REQUIRE(factorial(10) == 3'628'800);
 }
+
+TEST_CASE("Volume layouts address every voxel exactly once", "[volume]")
+{
+    for (auto layout : {VolumeUtils::Layout::Linear, VolumeUtils::Layout::Bricked})
+    {
+        VolumeUtils::Volume<uint16_t> volume(13, 9, 17, layout);
+        std::set<std::size_t> offsets;
+        for (int z = 0; z < volume.Depth(); ++z)
+            for (int y = 0; y < volume.Height(); ++y)
+                for (int x = 0; x < volume.Width(); ++x)
+                {
+                    const std::size_t offset = volume.Index(x, y, z);
+                    REQUIRE(offset * sizeof(uint16_t) < volume.SizeInBytes());
+                    offsets.insert(offset);
+                    volume(x, y, z) = static_cast<uint16_t>(x + 16 * y + 256 * z);
+                }
+        REQUIRE(offsets.size() == volume.VoxelCount());
+        REQUIRE(volume(12, 8, 16) == 12 + 16 * 8 + 256 * 16);
+        REQUIRE(volume(0, 0, 0) == 0);
+    }
+}
+
+TEST_CASE("Linear volumes match the flat slice-major layout", "[volume]")
+{
+    VolumeUtils::Volume<uint8_t> volume(4, 3, 2);
+    REQUIRE(volume.Index(1, 2, 1) == 1 + 4 * (2 + 3 * 1));
+    REQUIRE(volume.SizeInBytes() == 4 * 3 * 2);
+    REQUIRE_FALSE(volume.Contains(4, 0, 0));
+    REQUIRE(volume.Contains(3, 2, 1));
+}
+
+TEST_CASE("Bricked volumes keep a brick contiguous", "[volume]")
+{
+    VolumeUtils::Volume<uint8_t> volume(16, 16, 16, VolumeUtils::Layout::Bricked);
+    constexpr int kBrick = VolumeUtils::Volume<uint8_t>::kBrickSize;
+    for (int z = 0; z < kBrick; ++z)
+        for (int y = 0; y < kBrick; ++y)
+            for (int x = 0; x < kBrick; ++x)
+                REQUIRE(volume.Index(x, y, z) < VolumeUtils::Volume<uint8_t>::kBrickVoxels);
+    REQUIRE(volume.Index(kBrick, 0, 0) == VolumeUtils::Volume<uint8_t>::kBrickVoxels);
+}
+
+TEST_CASE("Grid traversal visits crossed cells once with contiguous spans", "[traversal]")
+{
+    const VolumeUtils::Vec3 origin{-1.0F, 0.3F, 0.7F};
+    const VolumeUtils::Vec3 direction{0.8F, 0.36F, 0.48F};
+    std::set<std::array<int, 3>> cells;
+    float previousExit = 1.25F;
+    VolumeUtils::TraverseGrid(origin, direction, 1.25F, 9.0F, {0.0F, 0.0F, 0.0F}, {1.0F, 1.0F, 1.0F}, {0, 0, 0},
+                              {4, 4, 4}, [&](const VolumeUtils::Int3 &cell, float t0, float t1) {
+                                  REQUIRE(cells.insert(cell).second);
+                                  REQUIRE_THAT(t0, Catch::Matchers::WithinAbs(previousExit, 1e-5));
+                                  REQUIRE(t1 > t0);
+                                  previousExit = t1;
+                                  return true;
+                              });
+    REQUIRE(cells.count({0, 0, 1}) == 1);
+    REQUIRE(cells.size() >= 4);
+}
+
+TEST_CASE("Macrocells only mark non-empty cells occupied", "[macrocell]")
+{
+    VolumeUtils::Volume<uint8_t> volume(20, 16, 16);
+    volume(18, 3, 12) = 200;
+
+    VolumeUtils::MacrocellGrid<uint8_t> grid;
+    grid.Build(volume);
+    REQUIRE(grid.Dimensions() == VolumeUtils::Int3{3, 2, 2});
+    REQUIRE(grid.At(2, 0, 1).maxValue == 200);
+
+    REQUIRE(grid.UpdateOccupancy([](const auto &cell) { return cell.maxValue > 0; }));
+    REQUIRE(grid.OccupiedCount() == 1);
+    REQUIRE(grid.IsOccupied({2, 0, 1}));
+    REQUIRE_FALSE(grid.IsOccupied({1, 0, 1}));
+    REQUIRE_FALSE(grid.UpdateOccupancy([](const auto &cell) { return cell.maxValue > 0; }));
+}
+
+TEST_CASE("Packet tracer renders the same bytes at every SIMD level", "[packet]")
+{
+    VolumeUtils::Volume<uint8_t> volume(24, 20, 16, VolumeUtils::Layout::Bricked);
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> dist(0, 255);
+    for (int z = 4; z < 12; ++z)
+        for (int y = 0; y < 20; ++y)
+            for (int x = 0; x < 24; ++x)
+                volume(x, y, z) = static_cast<uint8_t>(dist(rng));
+
+    VolumeUtils::MacrocellGrid<uint8_t> grid;
+    grid.Build(volume);
+    grid.UpdateOccupancy([](const auto &cell) { return cell.maxValue > 0; });
+    const VolumeUtils::GradientVolume gradients = VolumeUtils::BuildGradientVolume(volume);
+
+    // Odd size so tiles hang over the edges
+    const int width = 37;
+    const int height = 23;
+    VolumeUtils::PacketSettings settings;
+    settings.volume = &volume;
+    const std::size_t bytes = static_cast<std::size_t>(width * height * 4);
+    const Simd::Level supported = Simd::DetectLevel();
+    for (const bool orthographic : {false, true})
+    {
+        const VolumeUtils::RayCamera camera = VolumeUtils::MakeRayCamera(
+            {3.0F, -4.0F, -30.0F}, {0.0F, 0.0F, 0.0F}, {0.0F, 1.0F, 0.0F}, orthographic ? 30.0F : 60.0F,
+            orthographic, width, height);
+        for (const int classification : {0, 1, 2})
+        for (const bool dda : {false, true})
+        {
+            // Density, transfer function, pre-integrated transfer function
+            if (classification == 0)
+                settings.SetDensity(0.5F);
+            else
+                settings.SetTransferFunction(VolumeUtils::TissuePreset(), {1.0F / 255.0F, 0.0F},
+                                             2.0F, classification == 2);
+            for (const bool skip : {false, true})
+            {
+                // Shading rides along with the skipping variant
+                settings.gradients = skip ? &gradients : nullptr;
+                settings.dda = dda;
+                settings.trilinear = !dda;
+                settings.macrocells = skip ? &grid : nullptr;
+                std::vector<uint8_t> scalar(bytes, 0);
+                uint64_t scalarSamples = 0;
+                VolumeUtils::RenderTile(Simd::Level::Scalar, camera, settings, 0, 0, width, height, scalar.data(),
+                                        {}, &scalarSamples);
+                REQUIRE(std::any_of(scalar.begin(), scalar.end(), [](uint8_t v) { return v != 0 && v != 255; }));
+                REQUIRE(scalarSamples > 0);
+                for (const Simd::Level level : {Simd::Level::Avx2, Simd::Level::Avx512})
+                {
+                    if (level > supported)
+                        continue;
+                    std::vector<uint8_t> wide(bytes, 0);
+                    uint64_t wideSamples = 0;
+                    VolumeUtils::RenderTile(level, camera, settings, 0, 0, width, height, wide.data(), {},
+                                            &wideSamples);
+                    REQUIRE(wide == scalar);
+                    REQUIRE(wideSamples == scalarSamples);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Ray camera offsets span the view", "[camera]")
+{
+    const VolumeUtils::Vec3 position{0.0F, 0.0F, -10.0F};
+    const VolumeUtils::Vec3 target{0.0F, 0.0F, 0.0F};
+    const VolumeUtils::Vec3 up{0.0F, 1.0F, 0.0F};
+
+    // Perspective: the center pixel looks straight ahead, the top edge is fov / 2 above it
+    const auto perspective = VolumeUtils::MakeRayCamera(position, target, up, 90.0F, false, 200, 100);
+    for (std::size_t axis = 0; axis < 3; ++axis)
+    {
+        const float center = perspective.corner[axis] + 50.0F * perspective.deltaY[axis] +
+                             100.0F * perspective.deltaX[axis];
+        REQUIRE_THAT(center, Catch::Matchers::WithinAbs(perspective.forward[axis], 1e-5));
+    }
+    REQUIRE_THAT(perspective.corner[1] / perspective.corner[2], Catch::Matchers::WithinAbs(1.0, 1e-5));
+    REQUIRE_THAT(perspective.corner[0] / perspective.corner[2], Catch::Matchers::WithinAbs(-2.0, 1e-5));
+
+    // Orthographic: parallel rays from a plane through the camera, fovy tall
+    const auto orthographic = VolumeUtils::MakeRayCamera(position, target, up, 8.0F, true, 200, 100);
+    REQUIRE_THAT(orthographic.corner[1], Catch::Matchers::WithinAbs(4.0, 1e-5));
+    REQUIRE_THAT(orthographic.corner[2], Catch::Matchers::WithinAbs(0.0, 1e-5));
+    REQUIRE_THAT(orthographic.deltaY[1] * 100.0F, Catch::Matchers::WithinAbs(-8.0, 1e-5));
+    REQUIRE_THAT(orthographic.deltaX[0] * 200.0F, Catch::Matchers::WithinAbs(16.0, 1e-5));
+}
+
+TEST_CASE("Progressive passes converge to the full frame", "[progressive]")
+{
+    VolumeUtils::Volume<uint8_t> volume(16, 16, 16);
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<int> dist(0, 255);
+    for (int z = 0; z < 16; ++z)
+        for (int y = 0; y < 16; ++y)
+            for (int x = 0; x < 16; ++x)
+                volume(x, y, z) = static_cast<uint8_t>(dist(rng));
+    VolumeUtils::PacketSettings settings;
+    settings.volume = &volume;
+    settings.SetDensity(0.2F);
+
+    const int width = 45;
+    const int height = 27;
+    const auto camera = VolumeUtils::MakeRayCamera(
+        {2.0F, 3.0F, -25.0F}, {0.0F, 0.0F, 0.0F}, {0.0F, 1.0F, 0.0F}, 60.0F, false, width, height);
+    const std::size_t bytes = static_cast<std::size_t>(width * height * 4);
+    std::vector<uint8_t> full(bytes, 0);
+    VolumeUtils::RenderTile(Simd::DetectLevel(), camera, settings, 0, 0, width, height, full.data());
+
+    VolumeUtils::ProgressiveRefiner refiner;
+    std::vector<uint8_t> image(bytes, 0);
+    auto passes = refiner.NextFrame(true, 0.0F);
+    REQUIRE(passes.size() == 1);
+    REQUIRE(passes[0].stride == refiner.CoarseStride());
+    int frames = 0;
+    while (!passes.empty())
+    {
+        for (const auto &lattice : passes)
+            VolumeUtils::RenderTile(Simd::DetectLevel(), camera, settings, 0, 0, width, height, image.data(), lattice);
+        // Every pass leaves a complete (if blocky) frame behind
+        for (std::size_t i = 3; i < bytes; i += 4)
+            REQUIRE(image[i] == 255);
+        passes = refiner.NextFrame(false, 0.0F);
+        ++frames;
+    }
+    REQUIRE(frames == 3); // stride 4, 2, 1
+    REQUIRE(refiner.Converged());
+    REQUIRE(image == full);
+    REQUIRE(refiner.NextFrame(false, 0.0F).empty());
+
+    // A slow coarse frame coarsens the next one, a view change starts over
+    refiner.NextFrame(true, 0.0F);
+    REQUIRE(refiner.NextFrame(true, 100.0F)[0].stride == 8);
+    REQUIRE_FALSE(refiner.Converged());
+}
+
+TEST_CASE("Frame cache keeps the most recently used views", "[cache]")
+{
+    const auto key = [](float x, int mode) { return VolumeUtils::StateHash().Add(x).Add(mode).Value(); };
+    REQUIRE(key(1.0F, 0) == key(1.0F, 0));
+    REQUIRE(key(1.0F, 0) != key(1.0F, 1));
+    REQUIRE(key(1.0F, 0) != key(2.0F, 0));
+
+    VolumeUtils::FrameCache<std::vector<int>> cache(2);
+    cache.Insert(key(1.0F, 0)).assign(4, 1);
+    cache.Insert(key(2.0F, 0)).assign(4, 2);
+    REQUIRE(cache.Find(key(1.0F, 0))->front() == 1); // view 2 is now the oldest
+    REQUIRE(cache.Find(key(3.0F, 0)) == nullptr);
+
+    // A full cache hands back the storage of the evicted frame
+    std::vector<int> &slot = cache.Insert(key(3.0F, 0));
+    REQUIRE(slot.front() == 2);
+    slot.assign(4, 3);
+    REQUIRE(cache.Size() == 2);
+    REQUIRE(cache.Find(key(2.0F, 0)) == nullptr);
+    REQUIRE(cache.Find(key(1.0F, 0))->front() == 1);
+    REQUIRE(cache.Find(key(3.0F, 0))->front() == 3);
+    REQUIRE(cache.Hits() == 3);
+    REQUIRE(cache.Misses() == 2);
+
+    // Cleared frames are gone, new ones start from empty storage
+    cache.Clear();
+    REQUIRE(cache.Size() == 0);
+    REQUIRE(cache.Find(key(3.0F, 0)) == nullptr);
+    REQUIRE(cache.Insert(key(3.0F, 0)).empty());
+}
+
+TEST_CASE("Tile scheduler renders every pixel once and keeps tile timings", "[scheduler]")
+{
+    Scheduler::TileScheduler scheduler(4, 16);
+    const int width = 100;
+    const int height = 37;
+    std::vector<std::atomic<int>> hits(static_cast<std::size_t>(width * height));
+    for (int frame = 0; frame < 3; ++frame)
+    {
+        for (std::atomic<int> &hit : hits)
+            hit = 0;
+        scheduler.Run(width, height, [&](const Scheduler::Tile &tile) {
+            for (int y = tile.y0; y < tile.y1; ++y)
+                for (int x = tile.x0; x < tile.x1; ++x)
+                    ++hits[static_cast<std::size_t>(y * width + x)];
+        });
+        REQUIRE(std::all_of(hits.begin(), hits.end(), [](const std::atomic<int> &hit) { return hit == 1; }));
+    }
+    REQUIRE(scheduler.Columns() == 7);
+    REQUIRE(scheduler.Rows() == 3);
+    REQUIRE(scheduler.TileMilliseconds().size() == 21);
+    REQUIRE(std::all_of(scheduler.TileThreads().begin(), scheduler.TileThreads().end(),
+                        [](int thread) { return thread >= 0 && thread < 4; }));
+}
+
+TEST_CASE("Tile scheduler frames started in the background finish on Wait", "[scheduler]")
+{
+    // A single thread has no workers, the whole frame is rendered by Wait
+    for (const int threadCount : {1, 3})
+    {
+        const int width = 30;
+        const int height = 20;
+        std::vector<std::atomic<int>> hits(static_cast<std::size_t>(width * height));
+        Scheduler::TileScheduler scheduler(threadCount, 8);
+        scheduler.Wait(); // nothing started
+        for (int frame = 0; frame < 2; ++frame)
+        {
+            for (std::atomic<int> &hit : hits)
+                hit = 0;
+            scheduler.Start(width, height, [&hits](const Scheduler::Tile &tile) {
+                for (int y = tile.y0; y < tile.y1; ++y)
+                    for (int x = tile.x0; x < tile.x1; ++x)
+                        ++hits[static_cast<std::size_t>(y * width + x)];
+            });
+            REQUIRE(scheduler.Busy());
+            scheduler.Wait();
+            REQUIRE_FALSE(scheduler.Busy());
+            REQUIRE(std::all_of(hits.begin(), hits.end(), [](const std::atomic<int> &hit) { return hit == 1; }));
+        }
+        REQUIRE(scheduler.FrameMilliseconds() >= 0.0f);
+        // a frame still running when the scheduler goes away is finished first
+        scheduler.Start(width, height, [&hits](const Scheduler::Tile &tile) {
+            ++hits[static_cast<std::size_t>(tile.y0 * width + tile.x0)];
+        });
+    }
+}
+
+TEST_CASE("Slice loader fills each gap once both neighbours are loaded", "[loader]")
+{
+    struct Worker
+    {
+        int slices{0};
+    };
+    const int sliceCount = 57;
+    std::vector<std::atomic<int>> loaded(static_cast<std::size_t>(sliceCount));
+    std::vector<std::atomic<int>> filled(static_cast<std::size_t>(sliceCount - 1));
+    std::atomic<int> early{0};
+    Scheduler::LoadSlices<Worker>(
+        sliceCount,
+        4,
+        [&](Worker &worker, int slice) {
+            ++worker.slices;
+            ++loaded[static_cast<std::size_t>(slice)];
+        },
+        [&](int gap) {
+            if (loaded[static_cast<std::size_t>(gap)] != 1 || loaded[static_cast<std::size_t>(gap + 1)] != 1)
+                ++early;
+            ++filled[static_cast<std::size_t>(gap)];
+        });
+    REQUIRE(early == 0);
+    REQUIRE(std::all_of(loaded.begin(), loaded.end(), [](const std::atomic<int> &count) { return count == 1; }));
+    REQUIRE(std::all_of(filled.begin(), filled.end(), [](const std::atomic<int> &count) { return count == 1; }));
+
+    // A failing slice stops the load and reaches the caller
+    REQUIRE_THROWS_AS(Scheduler::LoadSlices<Worker>(
+                          sliceCount,
+                          4,
+                          [](Worker &, int slice) {
+                              if (slice == 20)
+                                  throw std::runtime_error("bad slice");
+                          },
+                          [](int) {}),
+                      std::runtime_error);
+}
+
+TEST_CASE("Series slices are ordered by position with their spacing", "[series]")
+{
+    const VolumeUtils::SliceOrder order = VolumeUtils::OrderSlices(
+        {{12.5f, "c"}, {5.0f, "a"}, {10.0f, "b2"}, {7.5f, "b"}, {10.0f, "b3"}, {10.0f, "b4"}});
+    REQUIRE(order.files == std::vector<std::string>{"a", "b", "b2", "c"});
+    REQUIRE_THAT(order.spacing, Catch::Matchers::WithinAbs(2.5f, 1e-5f));
+    REQUIRE_THAT(order.spacingError, Catch::Matchers::WithinAbs(0.0f, 1e-5f));
+
+    const VolumeUtils::SliceOrder gap = VolumeUtils::OrderSlices({{0.0f, "a"}, {1.0f, "b"}, {4.0f, "c"}});
+    REQUIRE_THAT(gap.spacing, Catch::Matchers::WithinAbs(2.0f, 1e-5f));
+    REQUIRE_THAT(gap.spacingError, Catch::Matchers::WithinAbs(1.0f, 1e-5f));
+    REQUIRE(VolumeUtils::OrderSlices({{3.0f, "only"}}).spacing == 0.0f);
+    REQUIRE_THROWS_AS(VolumeUtils::OrderSlices({}), std::runtime_error);
+
+    // The finest axis keeps the cell size, coarser ones are stretched
+    const VolumeUtils::Vec3 size = VolumeUtils::VoxelSize({0.5f, 2.0f, 0.5f}, 0.125f);
+    REQUIRE_THAT(size[0], Catch::Matchers::WithinAbs(0.125f, 1e-6f));
+    REQUIRE_THAT(size[1], Catch::Matchers::WithinAbs(0.5f, 1e-6f));
+    REQUIRE_THAT(size[2], Catch::Matchers::WithinAbs(0.125f, 1e-6f));
+}
+
+// One explicit VR little endian element, bulk VRs with the 4 byte length
+std::string dicomElement(uint16_t group, uint16_t element, const std::string &vr, std::string value)
+{
+    if (value.size() % 2 != 0)
+        value += vr == "UI" ? '\0' : ' ';
+    std::string bytes;
+    const auto put = [&bytes](std::size_t number, int count) {
+        for (int i = 0; i < count; ++i)
+            bytes += static_cast<char>((number >> (8 * i)) & 0xFF);
+    };
+    put(group, 2);
+    put(element, 2);
+    bytes += vr;
+    if (vr == "OB" || vr == "OW")
+    {
+        put(0, 2);
+        put(value.size(), 4);
+    }
+    else
+    {
+        put(value.size(), 2);
+    }
+    return bytes + value;
+}
+
+std::string dicomShort(uint16_t value)
+{
+    return {static_cast<char>(value & 0xFF), static_cast<char>(value >> 8)};
+}
+
+// Preamble, transfer syntax and the size tags of a 16 bit width x height slice
+std::string dicomHeader(const std::string &transferSyntax, uint16_t width, uint16_t height)
+{
+    return std::string(128, '\0') + "DICM" + dicomElement(0x0002, 0x0010, "UI", transferSyntax) +
+           dicomElement(0x0020, 0x000E, "UI", "1.2.3") + dicomElement(0x0028, 0x0010, "US", dicomShort(height)) +
+           dicomElement(0x0028, 0x0011, "US", dicomShort(width)) +
+           dicomElement(0x0028, 0x0100, "US", dicomShort(16)) + dicomElement(0x0028, 0x0103, "US", dicomShort(1));
+}
+
+std::string writeDicom(const std::string &name, const std::string &bytes)
+{
+    const std::string path = (std::filesystem::temp_directory_path() / name).string();
+    std::ofstream(path, std::ios::binary).write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    return path;
+}
+
+TEST_CASE("Mapped DICOM files read in place and zero fill past the end", "[dicom]")
+{
+    const std::string bytes = dicomHeader("1.2.840.10008.1.2.1", 2, 2);
+    const std::string path = writeDicom("dvr_test_mapped.dcm", bytes);
+    const long size = static_cast<long>(bytes.size());
+
+    DICOMFile file;
+    REQUIRE(file.Open(path));
+    REQUIRE(file.IsMapped());
+    REQUIRE(file.GetSize() == size);
+    file.SkipToPos(128);
+    const unsigned char *magic = file.ReadMapped(4);
+    REQUIRE(magic != nullptr);
+    REQUIRE(std::memcmp(magic, "DICM", 4) == 0);
+    REQUIRE(file.Tell() == 132);
+    REQUIRE(file.ReadMapped(size) == nullptr); // fewer bytes left
+    REQUIRE(file.Tell() == 132);
+
+    file.SkipToPos(size - 2);
+    unsigned char tail[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+    file.Read(tail, 4);
+    REQUIRE(std::memcmp(tail, bytes.data() + size - 2, 2) == 0);
+    REQUIRE(tail[2] == 0);
+    REQUIRE(tail[3] == 0);
+    REQUIRE(file.Tell() == size);
+    file.Close();
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Raw pixel data comes straight from the file and is reset per file", "[dicom]")
+{
+    const std::vector<int16_t> pixels{-1000, -1, 0, 1, 2, 3, 255, 256, 1000, 2000, -32768, 32767};
+    std::string little(pixels.size() * sizeof(int16_t), '\0');
+    std::memcpy(little.data(), pixels.data(), little.size());
+    std::string big = little;
+    for (std::size_t i = 0; i < big.size(); i += 2)
+        std::swap(big[i], big[i + 1]);
+    const std::string littleBytes = dicomHeader("1.2.840.10008.1.2.1", 4, 3) + dicomElement(0x7FE0, 0x0010, "OW", little);
+    const std::string bigBytes = dicomHeader("1.2.840.10008.1.2.2", 4, 3) + dicomElement(0x7FE0, 0x0010, "OW", big);
+    const std::string littlePath = writeDicom("dvr_test_little.dcm", littleBytes);
+    const std::string bigPath = writeDicom("dvr_test_big.dcm", bigBytes);
+    // cut off before the pixel data, the header alone still scans
+    const std::string headerPath = writeDicom("dvr_test_header.dcm", dicomHeader("1.2.840.10008.1.2.1", 4, 3));
+
+    DICOMParser parser;
+    DICOMAppHelper appHelper;
+    appHelper.SetCopyImageData(false);
+    const auto read = [&](const std::string &path, bool mapped) {
+        parser.ClearAllDICOMTagCallbacks();
+        appHelper.Clear();
+        appHelper.ResetImageInfo();
+        parser.SetUseMemoryMap(mapped);
+        REQUIRE(parser.OpenFile(path));
+        appHelper.RegisterCallbacks(&parser);
+        appHelper.RegisterPixelDataCallback(&parser);
+        REQUIRE(parser.ReadHeader());
+        const void *data = nullptr;
+        unsigned long length = 0;
+        appHelper.GetRawImageData(data, length);
+        return std::pair<const void *, unsigned long>{data, length};
+    };
+    const auto samePixels = [&](const std::pair<const void *, unsigned long> &raw) {
+        return raw.first != nullptr && raw.second == little.size() &&
+               std::memcmp(raw.first, little.data(), little.size()) == 0;
+    };
+
+    REQUIRE(samePixels(read(littlePath, true)));
+    REQUIRE(appHelper.GetWidth() == 4);
+    REQUIRE(appHelper.GetHeight() == 3);
+    REQUIRE(samePixels(read(littlePath, false)));
+
+    // big endian pixels are swapped in the copy-on-write mapping, the file keeps its bytes
+    REQUIRE(samePixels(read(bigPath, true)));
+    REQUIRE(samePixels(read(bigPath, true)));
+    REQUIRE(samePixels(read(bigPath, false)));
+    std::ifstream bigFile(bigPath, std::ios::binary);
+    REQUIRE(std::string(std::istreambuf_iterator<char>(bigFile), {}) == bigBytes);
+
+    // no pixel data must not hand out the last file's, which OpenFile unmapped
+    REQUIRE(samePixels(read(littlePath, true)));
+    const std::pair<const void *, unsigned long> none = read(headerPath, true);
+    REQUIRE(none.first == nullptr);
+    REQUIRE(none.second == 0);
+    REQUIRE(appHelper.GetWidth() == 4);
+
+    for (const std::string &path : {littlePath, bigPath, headerPath})
+        std::filesystem::remove(path);
+}
+
+struct TagCounter
+{
+    int count{0};
+
+    void Seen(DICOMParser *, doublebyte, doublebyte, DICOMParser::VRTypes, unsigned char *, quadbyte)
+    {
+        ++count;
+    }
+};
+
+TEST_CASE("Header scans stop once every tag is seen or at the pixel data", "[dicom]")
+{
+    const std::vector<int16_t> pixels(4 * 3, 7);
+    std::string pixelBytes(pixels.size() * sizeof(int16_t), '\0');
+    std::memcpy(pixelBytes.data(), pixels.data(), pixelBytes.size());
+    // trailing padding after the pixel data shows how far a parse went
+    const std::string path = writeDicom("dvr_test_scan.dcm", dicomHeader("1.2.840.10008.1.2.1", 4, 3) +
+                                                                 dicomElement(0x7FE0, 0x0010, "OW", pixelBytes) +
+                                                                 dicomElement(0xFFFC, 0xFFFC, "OB", "pad"));
+    DICOMParser parser;
+    std::vector<doublebyte> groups;
+    std::vector<doublebyte> elements;
+    std::vector<DICOMParser::VRTypes> types;
+
+    // the rows are the only tag asked for (besides the transfer syntax, always registered)
+    TagCounter rows;
+    DICOMMemberCallback<TagCounter> rowsCallback;
+    rowsCallback.SetCallbackFunction(&rows, &TagCounter::Seen);
+    REQUIRE(parser.OpenFile(path));
+    parser.AddDICOMTagCallback(0x0028, 0x0010, DICOMParser::VR_US, &rowsCallback);
+    REQUIRE(parser.ScanHeader());
+    REQUIRE(rows.count == 1);
+    parser.GetGroupsElementsDatatypes(groups, elements, types);
+    REQUIRE(groups.back() == 0x0028);
+    REQUIRE(elements.back() == 0x0010); // the columns after it are not read
+    const std::size_t scanned = groups.size();
+
+    REQUIRE(parser.OpenFile(path));
+    REQUIRE(parser.ReadHeader());
+    REQUIRE(rows.count == 2);
+    parser.GetGroupsElementsDatatypes(groups, elements, types);
+    REQUIRE(groups.back() == 0xFFFC);
+    REQUIRE(groups.size() == scanned + 5);
+
+    // tags missing from the file keep the scan going up to the pixel data, which it skips
+    parser.ClearAllDICOMTagCallbacks();
+    DICOMAppHelper appHelper;
+    appHelper.SetCopyImageData(false);
+    REQUIRE(parser.OpenFile(path));
+    appHelper.RegisterCallbacks(&parser);
+    REQUIRE(parser.ScanHeader());
+    parser.GetGroupsElementsDatatypes(groups, elements, types);
+    REQUIRE(groups.back() == 0x7FE0);
+    REQUIRE(elements.back() == 0x0010);
+    REQUIRE(appHelper.GetWidth() == 4);
+    REQUIRE(appHelper.GetHeight() == 3);
+    const void *data = nullptr;
+    unsigned long length = 0;
+    appHelper.GetRawImageData(data, length);
+    REQUIRE(data == nullptr);
+    REQUIRE(length == 0);
+
+    parser.ClearAllDICOMTagCallbacks();
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Trilinear samples blend neighbouring slices", "[packet]")
+{
+    // Two slices of 0 and two of 200 meet at z = 0, halfway between two slice centres
+    VolumeUtils::Volume<uint8_t> ramp(6, 6, 4);
+    VolumeUtils::Volume<uint8_t> uniform(6, 6, 4);
+    for (int z = 0; z < 4; ++z)
+        for (int y = 0; y < 6; ++y)
+            for (int x = 0; x < 6; ++x)
+            {
+                ramp(x, y, z) = z < 2 ? 0 : 200;
+                uniform(x, y, z) = 100;
+            }
+
+    VolumeUtils::PacketSettings settings;
+    settings.dda = false;
+    settings.trilinear = true;
+    settings.SetDensity(0.2F);
+    const VolumeUtils::Vec3 origin{-10.0F, 0.3F, 0.0F};
+    const VolumeUtils::Vec3 direction{1.0F, 0.0F, 0.0F};
+    settings.volume = &uniform;
+    const VolumeUtils::Rgba expected = VolumeUtils::TraceRay(origin, direction, settings);
+    REQUIRE(expected[3] > 0.0F);
+    settings.volume = &ramp;
+    REQUIRE(VolumeUtils::TraceRay(origin, direction, settings) == expected);
+
+    // Nearest sampling sees one slice or the other
+    settings.trilinear = false;
+    REQUIRE(VolumeUtils::TraceRay(origin, direction, settings) != expected);
+}
+
+TEST_CASE("Window maps stored values through the rescale to [0, 1]", "[window]")
+{
+    // Stored 0 is -1024 HU, the soft tissue window spans -160 to 240 HU
+    const VolumeUtils::Rescale rescale{1.0F, -1024.0F};
+    const VolumeUtils::WindowMapping mapping = VolumeUtils::MapWindow({40.0F, 400.0F}, rescale);
+    REQUIRE_THAT(mapping(864.0F), Catch::Matchers::WithinAbs(0.0F, 1e-6F));
+    REQUIRE_THAT(mapping(1064.0F), Catch::Matchers::WithinAbs(0.5F, 1e-6F));
+    REQUIRE_THAT(mapping(1264.0F), Catch::Matchers::WithinAbs(1.0F, 1e-6F));
+    REQUIRE(mapping(0.0F) == 0.0F);
+    REQUIRE(mapping(4000.0F) == 1.0F);
+
+    // The 8-bit copy keeps the layout and bakes the window in
+    VolumeUtils::Volume<int16_t> volume(9, 3, 2, VolumeUtils::Layout::Bricked);
+    volume(0, 0, 0) = 864;
+    volume(4, 1, 1) = 1064;
+    volume(8, 2, 1) = 2000;
+    const VolumeUtils::Volume<uint8_t> quantized = VolumeUtils::QuantizeWindow(volume, mapping);
+    REQUIRE(quantized.GetLayout() == VolumeUtils::Layout::Bricked);
+    REQUIRE(quantized(0, 0, 0) == 0);
+    REQUIRE(quantized(4, 1, 1) >= 127);
+    REQUIRE(quantized(4, 1, 1) <= 128);
+    REQUIRE(quantized(8, 2, 1) == 255);
+
+    // The packet tracer applies the window through its classification tables
+    VolumeUtils::PacketSettings settings;
+    settings.SetDensity(1.0F, VolumeUtils::MapWindow({100.0F, 100.0F}));
+    REQUIRE(settings.stepAlpha[50] == 0.0F);
+    REQUIRE_THAT(settings.stepAlpha[75], Catch::Matchers::WithinAbs(0.25F, 1e-6F));
+    REQUIRE(settings.stepAlpha[150] == 1.0F);
+}
+
+TEST_CASE("Transfer functions interpolate and pre-integrate segments", "[transfer]")
+{
+    VolumeUtils::TransferFunction transfer{{{1.0F, {1.0F, 0.5F, 0.0F, 1.0F}},
+                                            {0.0F, {0.0F, 0.0F, 0.0F, 0.0F}}}};
+    transfer.Sort();
+    const VolumeUtils::Rgba middle = transfer.Evaluate(0.5F);
+    REQUIRE_THAT(middle[0], Catch::Matchers::WithinAbs(0.5F, 1e-6F));
+    REQUIRE_THAT(middle[1], Catch::Matchers::WithinAbs(0.25F, 1e-6F));
+    REQUIRE_THAT(middle[3], Catch::Matchers::WithinAbs(0.5F, 1e-6F));
+    REQUIRE(transfer.Bake(5).back() == transfer.points.back().color);
+
+    // A constant segment is the opacity corrected for its length, a segment running across a
+    // thin spike picks it up even though neither end sees it
+    std::vector<VolumeUtils::Rgba> table(256);
+    table[128] = {1.0F, 1.0F, 1.0F, 0.9F};
+    table[10] = {1.0F, 0.0F, 0.0F, 0.3F};
+    const std::vector<VolumeUtils::Rgba> segments = VolumeUtils::PreIntegrate(table, 2.0F);
+    REQUIRE_THAT(segments[10 * 256 + 10][3],
+                 Catch::Matchers::WithinAbs(VolumeUtils::CorrectOpacity(0.3F, 2.0F), 1e-5F));
+    REQUIRE_THAT(segments[10 * 256 + 10][0],
+                 Catch::Matchers::WithinAbs(segments[10 * 256 + 10][3], 1e-5F));
+    REQUIRE(segments[150 * 256 + 100][3] > 0.0F);
+    REQUIRE(segments[150 * 256 + 100][3] == segments[100 * 256 + 150][3]);
+    REQUIRE(segments[100 * 256 + 99][3] == 0.0F);
+
+    // Coarse steps through a ramp: the pre-integrated table stays close to fine sampling
+    VolumeUtils::Volume<uint8_t> ramp(64, 4, 4);
+    for (int z = 0; z < 4; ++z)
+        for (int y = 0; y < 4; ++y)
+            for (int x = 0; x < 64; ++x)
+                ramp(x, y, z) = static_cast<uint8_t>(x * 4);
+    VolumeUtils::TransferFunction spike{{{0.47F, {1.0F, 1.0F, 1.0F, 0.0F}},
+                                         {0.5F, {1.0F, 1.0F, 1.0F, 0.05F}},
+                                         {0.53F, {1.0F, 1.0F, 1.0F, 0.0F}}}};
+    const VolumeUtils::WindowMapping identity{1.0F / 255.0F, 0.0F};
+    const VolumeUtils::Vec3 origin{-40.0F, 0.1F, 0.1F};
+    const VolumeUtils::Vec3 direction{1.0F, 0.0F, 0.0F};
+    VolumeUtils::PacketSettings settings;
+    settings.volume = &ramp;
+    settings.dda = false;
+    settings.trilinear = true;
+    settings.opacityCutoff = 1.0F;
+    settings.stepSize = 0.1F;
+    settings.SetTransferFunction(spike, identity);
+    const float reference = VolumeUtils::TraceRay(origin, direction, settings)[3];
+    REQUIRE(reference > 0.2F);
+
+    settings.stepSize = 4.0F;
+    settings.SetTransferFunction(spike, identity, 40.0F);
+    const float postClassified = VolumeUtils::TraceRay(origin, direction, settings)[3];
+    settings.SetTransferFunction(spike, identity, 40.0F, true);
+    REQUIRE(settings.PreIntegrated());
+    const float preIntegrated = VolumeUtils::TraceRay(origin, direction, settings)[3];
+    REQUIRE(std::abs(preIntegrated - reference) < std::abs(postClassified - reference));
+    REQUIRE(std::abs(preIntegrated - reference) < 0.02F);
+}
+
+TEST_CASE("Gradient volumes pack central differences", "[gradient]")
+{
+    // Octahedral directions survive 8 bits per coordinate to within a degree or so
+    for (const VolumeUtils::Vec3 &n : {VolumeUtils::Vec3{0.0F, 0.0F, 1.0F},
+                                       VolumeUtils::Vec3{0.0F, 0.0F, -1.0F},
+                                       VolumeUtils::Vec3{0.6F, -0.8F, 0.0F},
+                                       VolumeUtils::Vec3{-0.48F, 0.6F, -0.64F}})
+    {
+        const std::array<float, 2> map = VolumeUtils::EncodeOctahedral(n);
+        const float u = std::round((map[0] + 1.0F) * 127.5F) / 127.5F - 1.0F;
+        const float v = std::round((map[1] + 1.0F) * 127.5F) / 127.5F - 1.0F;
+        const VolumeUtils::Vec3 decoded = VolumeUtils::DecodeOctahedral(u, v);
+        REQUIRE(decoded[0] * n[0] + decoded[1] * n[1] + decoded[2] * n[2] > 0.999F);
+    }
+
+    // A ramp along y in both layouts, with slices twice as far apart as the rows
+    for (const VolumeUtils::Layout layout : {VolumeUtils::Layout::Linear, VolumeUtils::Layout::Bricked})
+    {
+        VolumeUtils::Volume<int16_t> ramp(40, 20, 12, layout, {1.0F, 1.0F, 2.0F});
+        for (int z = 0; z < 12; ++z)
+            for (int y = 0; y < 20; ++y)
+                for (int x = 0; x < 40; ++x)
+                    ramp(x, y, z) = static_cast<int16_t>(10 * y + 4 * z);
+        const VolumeUtils::GradientVolume gradients = VolumeUtils::BuildGradientVolume(ramp);
+        REQUIRE(gradients.gradients.GetLayout() == layout);
+        REQUIRE_THAT(gradients.maxMagnitude, Catch::Matchers::WithinAbs(std::sqrt(104.0F), 1e-3F));
+        const VolumeUtils::Vec3 normal = gradients.Normal(17, 9, 5);
+        REQUIRE_THAT(normal[0], Catch::Matchers::WithinAbs(0.0F, 0.01F));
+        REQUIRE_THAT(normal[1], Catch::Matchers::WithinAbs(10.0F / std::sqrt(104.0F), 0.01F));
+        REQUIRE_THAT(normal[2], Catch::Matchers::WithinAbs(2.0F / std::sqrt(104.0F), 0.01F));
+        REQUIRE_THAT(gradients.Magnitude(39, 0, 11), Catch::Matchers::WithinAbs(gradients.maxMagnitude, 1e-3F));
+
+        // Every thread count packs the same bytes
+        const VolumeUtils::GradientVolume serial = VolumeUtils::BuildGradientVolume(ramp, 1);
+        const auto *a = reinterpret_cast<const uint8_t *>(serial.gradients.Data());
+        const auto *b = reinterpret_cast<const uint8_t *>(gradients.gradients.Data());
+        REQUIRE(std::equal(a, a + serial.gradients.SizeInBytes(), b));
+    }
+}
+
+TEST_CASE("Brick pyramids average levels and keep conservative ranges", "[pyramid]")
+{
+    // 70 x 40 x 9 voxels in 16^3 bricks: 5x3x1, 3x2x1, 2x1x1 then a single brick
+    VolumeUtils::Volume<int16_t> volume(70, 40, 9, VolumeUtils::Layout::Bricked);
+    for (int z = 0; z < 9; ++z)
+        for (int y = 0; y < 40; ++y)
+            for (int x = 0; x < 70; ++x)
+                volume(x, y, z) = static_cast<int16_t>(x + 100 * z);
+    volume(66, 38, 8) = 5000; // a single bright voxel the averages wash out
+    const VolumeUtils::BrickPyramid<int16_t> pyramid(volume, 16);
+    REQUIRE(pyramid.LevelCount() == 4);
+    REQUIRE(pyramid.BrickCount() == 15 + 6 + 2 + 1);
+    REQUIRE(pyramid.Level(1).Dimensions() == VolumeUtils::Int3{35, 20, 5});
+    REQUIRE(pyramid.Level(3).Dimensions() == VolumeUtils::Int3{9, 5, 2});
+    REQUIRE(pyramid.Level(1)(3, 2, 1) == 6 + 1 + 250);
+    REQUIRE(pyramid.Level(1)(3, 2, 4) == 6 + 1 + 800); // the odd last slice averages with itself
+    REQUIRE(pyramid.Level(3)(8, 4, 1) < 5000);
+
+    // Every brick has a distinct id
+    std::set<std::size_t> ids;
+    for (int level = 0; level < pyramid.LevelCount(); ++level)
+    {
+        const VolumeUtils::Int3 counts = pyramid.BrickCounts(level);
+        for (int z = 0; z < counts[2]; ++z)
+            for (int y = 0; y < counts[1]; ++y)
+                for (int x = 0; x < counts[0]; ++x)
+                    ids.insert(pyramid.BrickId({level, {x, y, z}}));
+    }
+    REQUIRE(ids.size() == pyramid.BrickCount());
+
+    // Ranges include the apron and every finer voxel under a coarse brick
+    REQUIRE(pyramid.BrickRange({0, {0, 0, 0}}).min == 0);
+    REQUIRE(pyramid.BrickRange({0, {0, 0, 0}}).max == 16 + 800);
+    REQUIRE(pyramid.BrickRange({3, {0, 0, 0}}).max == 5000);
+    REQUIRE(pyramid.BrickRange({2, {1, 0, 0}}).max == 5000);
+    REQUIRE(pyramid.BrickRange({2, {0, 0, 0}}).max < 5000);
+
+    // A copied brick starts one voxel early and repeats the edge past the volume
+    std::vector<int16_t> brick(static_cast<std::size_t>(18 * 18 * 18));
+    pyramid.CopyBrick({0, {1, 0, 0}}, brick.data());
+    REQUIRE(brick[0] == 15);
+    REQUIRE(brick[17] == 32);
+    pyramid.CopyBrick({0, {4, 2, 0}}, brick.data());
+    const auto at = [&brick](int x, int y, int z) { return brick[static_cast<std::size_t>(x + 18 * (y + 18 * z))]; };
+    REQUIRE(at(17, 0, 0) == 69);
+    REQUIRE(at(0, 17, 17) == 63 + 800);
+    REQUIRE(at(3, 7, 9) == 5000);
+}
+
+TEST_CASE("Brick selection refines magnified bricks within the budget", "[pyramid]")
+{
+    VolumeUtils::Volume<int16_t> volume(64, 64, 64);
+    for (int z = 0; z < 64; ++z)
+        for (int y = 0; y < 64; ++y)
+            for (int x = 0; x < 64; ++x)
+                volume(x, y, z) = static_cast<int16_t>(x < 16 ? 0 : 100);
+    const VolumeUtils::BrickPyramid<int16_t> pyramid(volume, 8);
+    REQUIRE(pyramid.LevelCount() == 4);
+    const auto all = [](const auto &) { return true; };
+    const auto covered = [&](const std::vector<VolumeUtils::BrickKey> &bricks) {
+        std::size_t voxels = 0;
+        for (const VolumeUtils::BrickKey &key : bricks)
+            voxels += std::size_t{512} << (3 * key.level);
+        return voxels;
+    };
+
+    // Orthographic pixels a quarter voxel wide want every finest brick, a tight budget stops
+    // refining early but still covers the volume once
+    VolumeUtils::LodView view;
+    view.pixelSize = 0.25F;
+    REQUIRE(VolumeUtils::SelectBricks(pyramid, view, 1000, all).size() == 512);
+    const std::vector<VolumeUtils::BrickKey> tight = VolumeUtils::SelectBricks(pyramid, view, 100, all);
+    REQUIRE(tight.size() <= 100);
+    REQUIRE(covered(tight) == 64 * 64 * 64);
+
+    // Pixels four voxels wide are happy with the coarsest level but one
+    view.pixelSize = 4.0F;
+    const std::vector<VolumeUtils::BrickKey> coarse = VolumeUtils::SelectBricks(pyramid, view, 1000, all);
+    REQUIRE(coarse.size() == 8);
+    REQUIRE(coarse.front().level == 2);
+
+    // Perspective: bricks close to the eye are finer than far ones
+    view.pixelSize = 0.0F;
+    view.pixelSlope = 0.05F;
+    view.eye = {32.0F, 32.0F, -10.0F};
+    const std::vector<VolumeUtils::BrickKey> perspective = VolumeUtils::SelectBricks(pyramid, view, 1000, all);
+    REQUIRE(covered(perspective) == 64 * 64 * 64);
+    for (const VolumeUtils::BrickKey &key : perspective)
+    {
+        const int front = (8 * key.index[2]) << key.level; // first slice of the brick
+        if (front < 8)
+            REQUIRE(key.level == 0);
+        if (front >= 32)
+            REQUIRE(key.level > 0);
+    }
+
+    // Invisible bricks are dropped with everything under them
+    view.pixelSize = 0.25F;
+    view.pixelSlope = 0.0F;
+    const auto bright = [](const auto &range) { return range.max > 50; };
+    const std::vector<VolumeUtils::BrickKey> visible = VolumeUtils::SelectBricks(pyramid, view, 1000, bright);
+    REQUIRE(covered(visible) == 64 * 64 * (64 - 8)); // the apron keeps the bricks at x 8..15
+}
+
+TEST_CASE("Brick cache evicts least recently used bricks of older frames", "[pyramid]")
+{
+    VolumeUtils::BrickCache cache(3);
+    REQUIRE(cache.Acquire(10, 1).load);
+    REQUIRE(cache.Acquire(11, 1).load);
+    REQUIRE(cache.Acquire(12, 1).load);
+    // every slot holds a brick of this frame
+    REQUIRE(cache.Acquire(13, 1).slot == VolumeUtils::BrickCache::kNoSlot);
+
+    const int slot10 = cache.Touch(10, 2);
+    REQUIRE(slot10 != VolumeUtils::BrickCache::kNoSlot);
+    const VolumeUtils::BrickCache::Lookup lookup = cache.Acquire(13, 2);
+    REQUIRE(lookup.load);
+    REQUIRE(lookup.slot != slot10);
+    REQUIRE_FALSE(cache.Contains(11)); // the oldest
+    REQUIRE(cache.Contains(12));
+    REQUIRE(cache.Acquire(10, 2).slot == slot10);
+    REQUIRE_FALSE(cache.Acquire(10, 2).load);
+    REQUIRE(cache.Touch(11, 2) == VolumeUtils::BrickCache::kNoSlot);
+    REQUIRE(cache.Evictions() == 1);
+    REQUIRE(cache.Size() == 3);
+
+    cache.Clear();
+    REQUIRE(cache.Size() == 0);
+    REQUIRE(cache.Acquire(10, 3).load);
+
+    // the atlas replaces its cache by move assignment, the slots must keep tracking the moved list
+    static_assert(!std::is_copy_constructible_v<VolumeUtils::BrickCache>);
+    static_assert(!std::is_copy_assignable_v<VolumeUtils::BrickCache>);
+    VolumeUtils::BrickCache moved(2);
+    REQUIRE(moved.Acquire(20, 1).load);
+    moved = std::move(cache);
+    REQUIRE(moved.Touch(10, 4) != VolumeUtils::BrickCache::kNoSlot);
+    REQUIRE(moved.Acquire(14, 4).load);
+    REQUIRE(moved.Acquire(15, 4).load);
+    REQUIRE(moved.Acquire(16, 4).slot == VolumeUtils::BrickCache::kNoSlot);
+    REQUIRE(moved.Size() == 3);
+}
+
+TEST_CASE("Volume cache files round trip and reject stale or damaged ones", "[volumecache]")
+{
+    VolumeUtils::Volume<int16_t> volume(20, 12, 9, VolumeUtils::Layout::Linear, {0.5F, 2.0F, 0.5F});
+    VolumeUtils::Volume<uint8_t> mask(20, 12, 9);
+    for (int z = 0; z < 9; ++z)
+        for (int y = 0; y < 12; ++y)
+            for (int x = 0; x < 20; ++x)
+            {
+                volume(x, y, z) = static_cast<int16_t>(x * 100 - y * 7 + z - 900);
+                mask(x, y, z) = static_cast<uint8_t>((x + z) % 3);
+            }
+    VolumeUtils::MacrocellGrid<int16_t> macrocells;
+    macrocells.Build(volume, &mask);
+    const VolumeUtils::GradientVolume gradients = VolumeUtils::BuildGradientVolume(volume, 2);
+
+    const std::string path = (std::filesystem::temp_directory_path() / "dvr_test.dvrcache").string();
+    VolumeUtils::VolumeCacheContents contents;
+    contents.key = 42;
+    contents.seriesUID = "1.2.840.1";
+    contents.rescale = {1.0F, -1024.0F};
+    contents.volume = &volume;
+    contents.mask = &mask;
+    contents.gradients = &gradients;
+    contents.macrocells = &macrocells;
+    REQUIRE(VolumeUtils::WriteVolumeCache(path, contents));
+
+    VolumeUtils::VolumeCacheFile cache;
+    REQUIRE_FALSE(cache.Open(path, 43)); // written for other source files
+    REQUIRE(cache.Open(path, 42));
+    REQUIRE(std::string(cache.Header().seriesUID.data()) == "1.2.840.1");
+    REQUIRE(cache.Header().rescale.offset == -1024.0F);
+    REQUIRE(cache.Header().minValue == -900 - 77);
+    REQUIRE(cache.Header().maxValue == 1900 + 8 - 900);
+
+    VolumeUtils::Volume<int16_t> readVolume;
+    VolumeUtils::Volume<uint8_t> readMask;
+    VolumeUtils::GradientVolume readGradients;
+    VolumeUtils::MacrocellGrid<int16_t> readMacrocells;
+    REQUIRE_FALSE(cache.Read(VolumeUtils::CacheSection::Volume, readMask)); // wrong voxel type
+    REQUIRE(cache.Read(VolumeUtils::CacheSection::Volume, readVolume));
+    REQUIRE(cache.Read(VolumeUtils::CacheSection::Mask, readMask));
+    REQUIRE(cache.Read(readGradients));
+    REQUIRE(cache.Read(readMacrocells));
+    REQUIRE(readVolume.Dimensions() == volume.Dimensions());
+    REQUIRE(readVolume.Spacing() == volume.Spacing());
+    REQUIRE(std::equal(volume.Data(), volume.Data() + volume.VoxelCount(), readVolume.Data()));
+    REQUIRE(std::equal(mask.Data(), mask.Data() + mask.VoxelCount(), readMask.Data()));
+    REQUIRE(readGradients.maxMagnitude == gradients.maxMagnitude);
+    REQUIRE(readGradients.Normal(5, 6, 4)[0] == gradients.Normal(5, 6, 4)[0]);
+    REQUIRE(readMacrocells.Dimensions() == macrocells.Dimensions());
+    REQUIRE(readMacrocells.At(2, 1, 1).maxValue == macrocells.At(2, 1, 1).maxValue);
+    REQUIRE(readMacrocells.At(2, 1, 1).labels == macrocells.At(2, 1, 1).labels);
+    cache.Close();
+
+    // A flipped byte in the volume section fails its checksum, the other sections still read
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(static_cast<std::streamoff>(VolumeUtils::kCacheAlignment + 100));
+        file.put('\x5a');
+    }
+    REQUIRE(cache.Open(path, 42));
+    REQUIRE_FALSE(cache.Read(VolumeUtils::CacheSection::Volume, readVolume));
+    REQUIRE(cache.Read(VolumeUtils::CacheSection::Mask, readMask));
+    cache.Close();
+
+    // A table entry whose dimensions or layout do not match its size rejects the whole file
+    // before anything is allocated from it
+    const auto damageEntry = [&](std::size_t field, int32_t value) {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(static_cast<std::streamoff>(sizeof(VolumeUtils::VolumeCacheHeader) + field));
+        file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    };
+    const std::size_t dims = offsetof(VolumeUtils::CacheSectionEntry, dims);
+    const std::size_t layout = offsetof(VolumeUtils::CacheSectionEntry, layout);
+    for (const int32_t width : {-20, 0, 2000000000, 21})
+    {
+        damageEntry(dims, width);
+        REQUIRE_FALSE(cache.Open(path, 42));
+    }
+    damageEntry(dims, 20);
+    damageEntry(layout, 7);
+    REQUIRE_FALSE(cache.Open(path, 42));
+    damageEntry(layout, static_cast<int32_t>(VolumeUtils::Layout::Bricked)); // padded size differs
+    REQUIRE_FALSE(cache.Open(path, 42));
+    damageEntry(layout, static_cast<int32_t>(VolumeUtils::Layout::Linear));
+    REQUIRE(cache.Open(path, 42));
+    cache.Close();
+
+    // So does a file of another format version
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(8);
+        const uint32_t version = VolumeUtils::kCacheVersion + 1;
+        file.write(reinterpret_cast<const char *>(&version), sizeof(version));
+    }
+    REQUIRE_FALSE(cache.Open(path, 42));
+    REQUIRE_FALSE(cache.IsOpen());
+    std::filesystem::remove(path);
+    REQUIRE_FALSE(cache.Open(path, 42));
+}
+
+TEST_CASE("Benchmark phantoms are the same on any thread count and layout", "[phantom]")
+{
+    const VolumeUtils::Volume<int16_t> serial = VolumeUtils::MakeCtPhantom(24, VolumeUtils::Layout::Linear, 1);
+    const VolumeUtils::Volume<int16_t> parallel = VolumeUtils::MakeCtPhantom(24, VolumeUtils::Layout::Bricked, 3);
+    for (int z = 0; z < 24; ++z)
+    {
+        for (int y = 0; y < 24; ++y)
+        {
+            for (int x = 0; x < 24; ++x)
+            {
+                REQUIRE(serial(x, y, z) == parallel(x, y, z));
+            }
+        }
+    }
+    // Air in the corners, soft tissue at the centre, bone in the spine
+    REQUIRE(serial(0, 0, 0) <= -980);
+    REQUIRE(std::abs(serial(12, 12, 12) - 40) <= 20);
+    REQUIRE(VolumeUtils::CtPhantomValue(0.0f, 0.0f, 0.39f) == 300.0f);
+    REQUIRE(VolumeUtils::CtPhantomValue(0.0f, 0.0f, 0.47f) == 1200.0f);
+
+    VolumeUtils::Volume<uint8_t> checker(4, 4, 4);
+    VolumeUtils::FillChecker(checker);
+    REQUIRE(checker(0, 0, 0) == 2);
+    REQUIRE(checker(1, 0, 0) == 0);
+    REQUIRE(checker(1, 1, 0) == 2);
+}
+
+TEST_CASE("Frame profiler keeps rolling percentiles and writes a Chrome trace", "[profiler]")
+{
+    Profiler::StageHistory history(4);
+    for (const float milliseconds : {5.0f, 1.0f, 3.0f, 2.0f, 4.0f})
+    {
+        history.Add(milliseconds);
+    }
+    // 5 dropped out of the ring, 1 is the oldest left
+    REQUIRE(history.Count() == 5);
+    REQUIRE(history.Samples().size() == 4);
+    REQUIRE(history.Offset() == 1);
+    REQUIRE(history.Samples()[history.Offset()] == 1.0f);
+    REQUIRE(history.Last() == 4.0f);
+    REQUIRE(history.Percentile(0.5f) == 2.0f);
+    REQUIRE(history.Percentile(0.99f) == 4.0f);
+
+    Profiler::FrameProfiler profiler(8);
+    const Profiler::Clock::time_point start = Profiler::Clock::now();
+    profiler.Record("Parse", Profiler::kLoadStage, start, start + std::chrono::milliseconds(3));
+    {
+        Profiler::StageTimer stages(profiler);
+        stages.Begin("Ray Cast");
+        stages.Begin("Upload");
+    }
+    profiler.RecordGpu("Upload", start, 0.5);
+    std::thread([&profiler, start]() {
+        profiler.Record("Parse", Profiler::kLoadStage, start, start + std::chrono::milliseconds(1));
+    }).join();
+
+    std::vector<std::string> stages;
+    std::size_t parses = 0;
+    profiler.ForEachStage([&](const Profiler::FrameProfiler::Stage &stage) {
+        stages.push_back(std::string(stage.category) + "/" + stage.name);
+        if (stage.name == "Parse")
+        {
+            parses = stage.history.Count();
+            REQUIRE(stage.history.Percentile(1.0f) == 3.0f);
+        }
+    });
+    // Stages of the same name in another category are kept apart
+    REQUIRE(stages == std::vector<std::string>{"load/Parse", "frame/Ray Cast", "frame/Upload", "gpu/Upload"});
+    REQUIRE(parses == 2);
+    REQUIRE(profiler.EventCount() == 5);
+
+    std::ostringstream trace;
+    profiler.WriteChromeTrace(trace);
+    const std::string json = trace.str();
+    REQUIRE(json.find(R"("traceEvents":[)") != std::string::npos);
+    // Times are in microseconds since the profiler was made, the main thread is track 1
+    const auto event = [&json](const std::string &prefix, const std::string &duration) {
+        const std::size_t at = json.find(prefix);
+        return at != std::string::npos && json.find(",\"dur\":" + duration + "}", at) == json.find(",\"dur\":", at);
+    };
+    REQUIRE(event(R"({"name":"Parse","cat":"load","ph":"X","pid":1,"tid":1,"ts":)", "3000.000"));
+    REQUIRE(event(R"("cat":"gpu","ph":"X","pid":1,"tid":0,"ts":)", "500.000"));
+    REQUIRE(event(R"("cat":"load","ph":"X","pid":1,"tid":2,"ts":)", "1000.000"));
+    REQUIRE(json.find(R"("args":{"name":"Worker 1"})") != std::string::npos);
+
+    profiler.Clear();
+    REQUIRE(profiler.EventCount() == 0);
+}
+
+TEST_CASE("JSON strings escape quotes, backslashes and control characters", "[profiler]")
+{
+    REQUIRE(Profiler::JsonEscaped("orbit") == "orbit");
+    REQUIRE(Profiler::JsonEscaped(R"(C:\scans\"head".cam)") == R"(C:\\scans\\\"head\".cam)");
+    REQUIRE(Profiler::JsonEscaped("a\tb\nc\r") == R"(a\tb\nc\r)");
+    REQUIRE(Profiler::JsonEscaped(std::string{'x', '\x01', '\x1f'}) == R"(x\u0001\u001f)");
+}
+
+TEST_CASE("Peak memory covers memory the process has touched", "[profiler]")
+{
+    constexpr std::size_t kBytes = 64U << 20U;
+    std::vector<std::uint8_t> block(kBytes, 1);
+    REQUIRE(block.back() == 1);
+    REQUIRE(Profiler::PeakResidentBytes() >= kBytes);
+}
@@ -9,6 +9,7 @@
 #include <imgui.h>
 #include <raylib.h>
 #include <rlImGui.h>
+#include <rlgl.h>
 
 namespace Application {
     inline RenderTexture gameTexture;
@@ -36,7 +37,10 @@ namespace Application {
             }
             */
 
-            Game::Update_Debug_Mode(); // Poll for F9 Key
+            {
+                Profiler::ScopedTimer inputTimer(Game::profiler, "Input");
+                Game::Update_Debug_Mode(); // Poll for F9 Key
+            }
             Game::Update(CameraUtils::camera, Application::windowSize.x, Application::windowSize.y); // Perform Ray Casting (Build framebuffer)
         }
     }
@@ -62,8 +66,13 @@ namespace Application {
         // Main Loop
         while (!WindowShouldClose())
         {
+            Profiler::ScopedTimer frameTimer(Game::profiler, "Frame");
+            Game::gpuTimer.Collect(Game::profiler);
             Update();
 
+            Profiler::StageTimer stages(Game::profiler);
+            stages.Begin("Draw");
+            Game::gpuTimer.Begin("Draw");
             BeginDrawing();
             rlImGuiBegin();
             ClearBackground(DARKGRAY);
@@ -71,6 +80,7 @@ namespace Application {
             if (Game::debugMenu)
             {
                 CameraUtils::Draw(CameraUtils::camera); // Draw Camera Controls using ImGui
+                Game::DrawSettings(); // Draw Render Settings using ImGui
 
                 BeginTextureMode(Application::gameTexture);
                 ClearBackground(RAYWHITE);
@@ -104,8 +114,14 @@ namespace Application {
             }
             DrawFPS(10, 10);
             rlImGuiEnd();
+            // the batch is flushed here rather than in EndDrawing, inside the query
+            rlDrawRenderBatchActive();
+            Game::gpuTimer.End();
+            stages.End();
             EndDrawing();
         }
+        Game::Shutdown();
+        Game::gpuTimer.Release();
         return 0;
     }
 }
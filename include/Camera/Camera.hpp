@@ -3,11 +3,13 @@
 #define CAMERA_H
 
 #include "Constants.hpp"
+#include "Volume/RayCamera.hpp"
 
 #include <raylib.h>
 #include <imgui.h>
 
 #include <algorithm>
+#include <cmath>
 
 namespace CameraUtils {
     inline Camera3D camera;
@@ -99,6 +101,33 @@ namespace CameraUtils {
         }
         ImGui::PopID();
 
+        // Camera Projection Control
+        bool orthographic = camera.projection == CAMERA_ORTHOGRAPHIC;
+        if (ImGui::Checkbox("Orthographic", &orthographic))
+        {
+            // Keep the target framed the same way across the switch
+            const float distance = std::hypot(camera.target.x - camera.position.x,
+                                              camera.target.y - camera.position.y,
+                                              camera.target.z - camera.position.z);
+            camera.fovy = orthographic ? VolumeUtils::OrthographicHeight(camera.fovy, distance)
+                                       : VolumeUtils::PerspectiveFovy(camera.fovy, distance);
+            camera.projection = orthographic ? CAMERA_ORTHOGRAPHIC : CAMERA_PERSPECTIVE;
+        }
+
+        if (orthographic)
+        {
+            // Camera View Height Control
+            ImGui::Text("View Height:");
+            ImGui::PushID("CameraViewHeight");
+            if (ImGui::InputFloat("View Height", &camera.fovy, 0.0f, 0.0f, "%.1f"))
+            {
+                camera.fovy = std::clamp(camera.fovy, 0.1f, 1000.0f);
+            }
+            ImGui::PopID();
+            ImGui::End();
+            return;
+        }
+
         // Camera FOV Control
         ImGui::Text("Field of View:");
         ImGui::PushID("CameraFOV");
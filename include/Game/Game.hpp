@@ -5,17 +5,39 @@
 #include "Constants.hpp"
 #include "DICOMAppHelper.h"
 #include "DICOMParser.h"
+#include "Gui/ProfilerOverlay.hpp"
+#include "Gui/TransferFunctionEditor.hpp"
+#include "Profiler/FrameProfiler.hpp"
+#include "Profiler/GpuTimer.hpp"
+#include "Scheduler/TileScheduler.hpp"
+#include "Simd/Simd.hpp"
+#include "Volume/FrameCache.hpp"
+#include "Volume/GradientVolume.hpp"
+#include "Volume/MacrocellGrid.hpp"
+#include "Volume/PacketTracer.hpp"
+#include "Volume/Phantoms.hpp"
+#include "Volume/Progressive.hpp"
+#include "Volume/RayCamera.hpp"
+#include "Volume/Series.hpp"
+#include "Volume/TransferFunction.hpp"
+#include "Volume/Volume.hpp"
+#include "Volume/Window.hpp"
 
 #include <fmt/format.h>
 #include <imgui.h>
 #include <raylib.h>
 #include <raymath.h>
-#include <omp.h>
 
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <queue>
 #include <random>
 #include <string>
+#include <vector>
 
 namespace Game
 {
@@ -24,154 +46,281 @@ namespace Game
     inline std::queue<int> keyQueue = std::queue<int>();
     inline bool debugMenu = false;
 
-    inline std::vector<std::vector<std::vector<int>>> cube(Constants::kCubeSize, std::vector<std::vector<int>>(Constants::kCubeSize, std::vector<int>(Constants::kCubeSize)));
+    inline VolumeUtils::Volume<uint8_t> cube(Constants::kCubeSize, Constants::kCubeSize, Constants::kCubeSize, VolumeUtils::Layout::Bricked);
+
+    // How rays walk through the volume
+    enum class TraversalMode
+    {
+        FixedStep, // sample every kStepSize world units
+        DDA,       // visit each crossed voxel exactly once
+    };
+    inline TraversalMode traversalMode = TraversalMode::DDA;
+    inline constexpr std::array<const char *, 2> kTraversalModeNames{"Fixed step", "3D DDA"};
+    inline bool trilinear = true; // fixed steps interpolate between voxels
+
+    // Min/max macrocells over the cube, used to skip bricks that cannot contribute
+    inline VolumeUtils::MacrocellGrid<uint8_t> macrocells;
+    inline bool emptySpaceSkipping = true;
+
+    // Front-to-back compositing settings
+    inline float density = 1.0f;          // opacity of a full intensity voxel per fixed step
+    inline float opacityCutoff = 0.95f;   // stop a ray once it is this opaque
+    inline VolumeUtils::Window window{127.5f, 255.0f}; // in voxel values, applied when classifying
+
+    // How windowed values turn into colour and opacity
+    enum class Classification
+    {
+        Density,          // grey, opacity proportional to the value
+        TransferFunction, // colour and opacity from the transfer function
+    };
+    inline Classification classification = Classification::Density;
+    inline constexpr std::array<const char *, 2> kClassificationNames{"Density", "Transfer function"};
+    inline VolumeUtils::TransferFunction transferFunction = VolumeUtils::TissuePreset();
+    inline bool preIntegrated = true; // fixed steps look up the whole segment between samples
+    inline float stepScale = 1.0f;    // fixed-step length in units of kStepSize
+
+    // Headlight shading from gradients precomputed the first time it is turned on
+    inline bool shading = false;
+    inline float gradientOpacity = 0.0f; // how much the gradient magnitude scales opacity
+    inline VolumeUtils::GradientVolume gradients;
+    inline double gradientMilliseconds = 0.0; // time the last gradient build took
+
+    // Instruction set of the packet tracer, every level renders the same image
+    inline const Simd::Level supportedSimdLevel = Simd::DetectLevel();
+    inline Simd::Level simdLevel = supportedSimdLevel;
+
+    // Tiles of the frame are spread over every core, their timings feed the next frame's order
+    inline Scheduler::TileScheduler scheduler;
+
+    // Scheduler timings of the last finished frame. The scheduler's own are rewritten while the
+    // next frame is traced, the settings window and the tile tint read these instead.
+    struct FrameStats
+    {
+        std::vector<Scheduler::Tile> tiles{};
+        std::vector<float> tileMilliseconds{};
+        std::vector<float> busyMilliseconds{};
+        float frameMilliseconds{0.0f};
+        std::size_t steals{0};
+    };
+    inline FrameStats frameStats;
+    inline bool showTileCosts = false;
+    inline constexpr std::array<int, 3> kTileSizes{16, 32, 64};
+    inline constexpr std::array<const char *, 3> kTileSizeNames{"16x16", "32x32", "64x64"};
+
+    // Coarse frames while the view changes, refined until converged once it holds still
+    inline VolumeUtils::ProgressiveRefiner refiner;
+    inline bool progressive = true;
+
+    // Finished frames of recent views, going back to one of them is a copy
+    inline VolumeUtils::FrameCache<std::vector<uint8_t>> frameCache;
+
+    // Stage timings of every frame, GPU ones from timer queries, saved as a Chrome trace on demand
+    inline Profiler::FrameProfiler profiler;
+    inline Profiler::GpuTimer gpuTimer;
+    inline bool showProfiler = false;
+    inline const std::string kTracePath = "dvr_trace.json";
+
+    // Re-derive which macrocells are visible, call whenever the classification changes
+    inline void UpdateMacrocellOccupancy()
+    {
+        // Voxels at or below the bottom of the window add nothing to the accumulated color
+        const VolumeUtils::WindowMapping mapping = VolumeUtils::MapWindow(window);
+        if (classification == Classification::Density)
+        {
+            macrocells.UpdateOccupancy([mapping](const VolumeUtils::MacrocellGrid<uint8_t>::Cell &cell) {
+                return mapping(static_cast<float>(cell.maxValue)) > 0.0f;
+            });
+            return;
+        }
+
+        // A cell is visible if the transfer function is not transparent anywhere in its value range
+        constexpr std::size_t kTableSize = 256;
+        const std::vector<VolumeUtils::Rgba> table = transferFunction.Bake(kTableSize);
+        macrocells.UpdateOccupancy([&](const VolumeUtils::MacrocellGrid<uint8_t>::Cell &cell) {
+            const float low = mapping(static_cast<float>(cell.minValue));
+            const float high = mapping(static_cast<float>(cell.maxValue));
+            return VolumeUtils::MaxOpacity(table, kTableSize, low, high) > 0.0f;
+        });
+    }
 
     // Anonymous namespace for private functions
     namespace
     {
-        // Clamp value between 0 and 255
-        inline unsigned char ClampColorValue(int value)
+        constexpr float kCellSize = 1.0f;  // World size of a voxel along its finest axis
+        constexpr float kStepSize = 0.1f;  // Step size for fixed-step traversal
+
+        // Classification tables, rebuilt when their inputs change
+        inline VolumeUtils::PacketSettings packetSettings;
+        inline std::uint64_t lastClassificationKey{0};
+
+        // Hash of everything that changes the rendered image
+        inline std::uint64_t lastViewKey{0};
+
+        // Frames are pipelined: the next one is traced on the worker threads while the main thread
+        // uploads and presents the last. Every tile is copied into one of two pixel buffer objects
+        // as soon as it is traced, so the upload itself is a copy the GPU makes on its own.
+        inline std::array<unsigned int, 2> pixelBuffers{};
+        inline std::size_t tracedBuffer{0};   // buffer of the frame in flight, the other was uploaded last
+        inline bool frameInFlight{false};
+        inline bool frameMapped{false};       // its buffer is mapped, otherwise it goes up from the image
+        inline bool frameConverged{false};    // it completes its view, for the frame cache
+        inline std::uint64_t frameViewKey{0};
+        inline bool occupancyStale{false}; // the classification changed, not applied while tracing
+
+        std::uint64_t MakeClassificationKey()
         {
-            if (value < 0) return 0;
-            if (value > 255) return 255;
-            return (unsigned char)value;
+            VolumeUtils::StateHash hash;
+            hash.Add(classification)
+                .Add(density)
+                .Add(window.center)
+                .Add(window.width)
+                .Add(stepScale)
+                .Add(preIntegrated)
+                .Add(transferFunction.Hash());
+            return hash.Value();
         }
 
-        // Add two colors (component-wise) with clamping
-        inline Color ColorAdd(const Color &c1, const Color &c2)
+        std::uint64_t MakeViewKey(const Camera &camera, int screenWidth, int screenHeight)
         {
-            return Color{
-                ClampColorValue(c1.r + c2.r),
-                ClampColorValue(c1.g + c2.g),
-                ClampColorValue(c1.b + c2.b),
-                ClampColorValue(c1.a + c2.a)};
+            VolumeUtils::StateHash hash;
+            hash.Add(camera.position)
+                .Add(camera.target)
+                .Add(camera.up)
+                .Add(camera.fovy)
+                .Add(camera.projection)
+                .Add(screenWidth)
+                .Add(screenHeight)
+                .Add(traversalMode)
+                .Add(trilinear)
+                .Add(emptySpaceSkipping)
+                .Add(opacityCutoff)
+                .Add(shading)
+                .Add(gradientOpacity)
+                .Add(MakeClassificationKey());
+            return hash.Value();
         }
 
-        // Helper function to calculate ray direction from screen coordinates
-        Vector3 ScreenToRayDirection(int x, int y, const Camera &camera, int screenWidth, int screenHeight)
+        // Tint every tile by how long it took to render in the last frame, the slowest is reddest
+        void DrawTileCosts()
         {
-            // "normalize" x and y: [0, screenWidth or screenHeight] -> [-1,1]
-            float normX = (((float)x / (float)screenWidth) - 0.5f) * 2.0f;
-            float normY = (((float)y / (float)screenHeight) - 0.5f) * 2.0f;
-            float aspectRatio = static_cast<float>(screenWidth) / static_cast<float>(screenHeight);
-
-            Vector3 cameraDirection = Vector3Normalize(camera.target - camera.position);
-            Vector3 horizontal = Vector3CrossProduct(camera.up, cameraDirection);
-
-            // distance between camera & perspective plane = cot(fov / 2)
-            float d = 1.0f / tanf((camera.fovy * DEG2RAD) * 0.5f);
-            Vector3 rayDirection = cameraDirection * d + camera.up * (-normY) + horizontal * (normX * aspectRatio);
-
-            return Vector3Normalize(rayDirection);
+            const std::vector<Scheduler::Tile> &tiles = frameStats.tiles;
+            const std::vector<float> &costs = frameStats.tileMilliseconds;
+            const float slowest = costs.empty() ? 0.0f : *std::max_element(costs.begin(), costs.end());
+            if (slowest <= 0.0f)
+            {
+                return;
+            }
+            for (std::size_t i = 0; i < tiles.size(); ++i)
+            {
+                const Scheduler::Tile &tile = tiles[i];
+                const int width = tile.x1 - tile.x0;
+                const int height = tile.y1 - tile.y0;
+                DrawRectangle(tile.x0, tile.y0, width, height, Fade(RED, 0.6f * costs[i] / slowest));
+                DrawRectangleLines(tile.x0, tile.y0, width, height, Fade(BLACK, 0.2f));
+            }
         }
 
-        // Helper function to trace a ray through the 3D volume
-        Color RayCastThroughVolume(const Vector3 &rayOrigin, const Vector3 &rayDir,
-                                   const std::vector<std::vector<std::vector<int>>> &volume)
+        // Rebuild the macrocell value ranges after the cube data changed
+        void BuildMacrocells()
         {
-            const float cellSize = 1.0f;
-            const int volumeSize = Constants::kCubeSize;
-
-            // Define cube bounds (assuming cube is centered at origin)
-            const float cubeMin = -volumeSize * 0.5f * cellSize;
-            const float cubeMax = volumeSize * 0.5f * cellSize;
-
-            // Ray-box intersection
-            Vector3 invRayDir = {
-                (rayDir.x != 0.0f) ? 1.0f / rayDir.x : INFINITY,
-                (rayDir.y != 0.0f) ? 1.0f / rayDir.y : INFINITY,
-                (rayDir.z != 0.0f) ? 1.0f / rayDir.z : INFINITY
-            };
+            macrocells.Build(cube);
+            UpdateMacrocellOccupancy();
+            gradients = {}; // stale, rebuilt when next shaded
+        }
 
-            Vector3 tMin = (Vector3{cubeMin, cubeMin, cubeMin} - rayOrigin) * invRayDir;
-            Vector3 tMax = (Vector3{cubeMax, cubeMax, cubeMax} - rayOrigin) * invRayDir;
+        // Central-difference gradients of the cube on every core, timed for the settings window
+        void BuildGradients()
+        {
+            const auto start = std::chrono::steady_clock::now();
+            gradients = VolumeUtils::BuildGradientVolume(cube);
+            const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            gradientMilliseconds = elapsed.count();
+        }
 
-            Vector3 tEnter = Vector3Min(tMin, tMax);
-            Vector3 tExit = Vector3Max(tMin, tMax);
+        // Map a pixel buffer for the workers to write into, its old contents are dropped so the
+        // driver never waits for an upload still reading them. Null if it cannot be mapped.
+        uint8_t *MapPixelBuffer(unsigned int buffer, std::size_t bytes)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+            void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
+                                            0,
+                                            static_cast<GLsizeiptr>(bytes),
+                                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return static_cast<uint8_t *>(mapped);
+        }
 
-            float tStart = std::max({ tEnter.x, tEnter.y, tEnter.z });
-            float tEnd = std::min({ tExit.x, tExit.y, tExit.z });
+        // Unmap a traced pixel buffer and copy it into the texture, the call returns before the copy
+        void UploadPixelBuffer(unsigned int buffer)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindTexture(GL_TEXTURE_2D, raycastTexture.id);
+            glTexSubImage2D(GL_TEXTURE_2D,
+                            0,
+                            0,
+                            0,
+                            raycastTexture.width,
+                            raycastTexture.height,
+                            GL_RGBA,
+                            GL_UNSIGNED_BYTE,
+                            nullptr);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
 
-            if (tStart > tEnd || tEnd < 0.0f)
+        // Wait for the frame in flight, keep its timings and upload it
+        void FinishFrame()
+        {
+            if (!frameInFlight)
             {
-                return BLACK; // No intersection
+                return;
             }
-
-            // Ray traversal through the volume
-            Vector3 currentPosition = rayOrigin + rayDir * tStart;
-            float stepSize = 0.1f; // Step size for ray traversal
-            float maxAlpha = 0.0f;
-            Color accumulatedColor = BLACK;
-
-            while (tStart < tEnd)
             {
-                // Map world position to volume indices
-                int x = static_cast<int>((currentPosition.x - cubeMin) / cellSize);
-                int y = static_cast<int>((currentPosition.y - cubeMin) / cellSize);
-                int z = static_cast<int>((currentPosition.z - cubeMin) / cellSize);
-
-                if (x >= 0 && x < volumeSize && y >= 0 && y < volumeSize && z >= 0 && z < volumeSize)
-                {
-                    // Get voxel value and map it to a color (grayscale)
-                    int value = volume[x][y][z];
-                    float voxelAlpha = float(value) / 255.0f;
-                    Color voxelColor = { static_cast<unsigned char>(value),
-                                         static_cast<unsigned char>(value),
-                                         static_cast<unsigned char>(value),
-                                         static_cast<unsigned char>(voxelAlpha) };
-
-                    // Accumulate color (simple maximum intensity projection)
-                    accumulatedColor = ColorAdd(accumulatedColor, voxelColor);
-
-                    // maximum intensity projection
-                    if (voxelAlpha > maxAlpha) {
-                        maxAlpha = voxelAlpha;
-                    }
-                }
-
-                // Advance ray position
-                currentPosition += rayDir * stepSize;
-                tStart += stepSize;
+                // only the part of the trace that drawing the last frame did not hide
+                Profiler::ScopedTimer waitTimer(profiler, "Ray Cast");
+                scheduler.Wait();
+            }
+            frameInFlight = false;
+            frameStats.tiles = scheduler.Tiles();
+            frameStats.tileMilliseconds = scheduler.TileMilliseconds();
+            frameStats.busyMilliseconds = scheduler.ThreadBusyMilliseconds();
+            frameStats.frameMilliseconds = scheduler.FrameMilliseconds();
+            frameStats.steals = scheduler.Steals();
+
+            auto *pixels = static_cast<uint8_t *>(raycastImage.data);
+            if (frameConverged)
+            {
+                const auto frameBytes = static_cast<std::size_t>(raycastImage.width * raycastImage.height * 4);
+                frameCache.Insert(frameViewKey).assign(pixels, pixels + frameBytes);
             }
 
-            return accumulatedColor;
-            return Color{1, 1, 1, (unsigned char)maxAlpha};
+            Profiler::ScopedTimer uploadTimer(profiler, "Upload");
+            Profiler::ScopedGpuTimer uploadGpuTimer(gpuTimer, "Upload");
+            if (frameMapped)
+            {
+                UploadPixelBuffer(pixelBuffers[tracedBuffer]);
+                tracedBuffer = 1 - tracedBuffer;
+            }
+            else
+            {
+                UpdateTexture(raycastTexture, pixels);
+            }
         }
 
         // Function to generate random 3D cube data
         void GenerateRandomCubeData()
         {
-            std::mt19937 rng(std::random_device{}());
-            std::uniform_int_distribution<int> dist(0, Constants::kMaxRandomValue);
-
-            for (int x = 0; x < Constants::kCubeSize; ++x)
-            {
-                for (int y = 0; y < Constants::kCubeSize; ++y)
-                {
-                    for (int z = 0; z < Constants::kCubeSize; ++z)
-                    {
-                        cube[x][y][z] = dist(rng);
-                    }
-                }
-            }
+            VolumeUtils::FillRandom(cube, Constants::kMaxRandomValue, std::random_device{}());
         }
 
         // Function to generate 3D cube data with checker pattern
         void GenerateCheckerCubeData()
         {
-            for (int x = 0; x < Constants::kCubeSize; ++x)
-            {
-                for (int y = 0; y < Constants::kCubeSize; ++y)
-                {
-                    for (int z = 0; z < Constants::kCubeSize; ++z)
-                    {
-                        cube[x][y][z] = 2 * ((x+y+z) % 2 == 0);
-                    }
-                }
-            }
+            VolumeUtils::FillChecker(cube);
         }
 
-        void loadVolumeData(std::vector<std::vector<std::vector<int>>>& cube)
+        void loadVolumeData(VolumeUtils::Volume<uint8_t>& cube)
         {
             DICOMAppHelper appHelper;
             DICOMParser parser;
@@ -213,8 +362,10 @@ namespace Game
                             // Assign compressed values to the corresponding slices
                             for (int slice = 0; slice < 4; ++slice)
                             {
-                                if (fileCount + slice < maxFileCount) {
-                                    cube[fileCount + slice][i][j] = compressed;
+                                const int row = static_cast<int>(i);
+                                const int col = static_cast<int>(j);
+                                if (cube.Contains(fileCount + slice, row, col)) {
+                                    cube(fileCount + slice, row, col) = compressed;
                                 }
                             }
                         }
@@ -230,6 +381,7 @@ namespace Game
     {
         //GenerateRandomCubeData();
         GenerateCheckerCubeData();
+        BuildMacrocells();
 
         // Initialize the cube with some values
             // for (int x = 0; x < Constants::kCubeSize; ++x) {
@@ -242,39 +394,262 @@ namespace Game
             // loadVolumeData(cube);
         raycastImage = GenImageColor(windowSize.x, windowSize.y, RAYWHITE); // Start with a blank white image
         raycastTexture = LoadTextureFromImage(raycastImage);  // Convert image to texture
+
+        const auto frameBytes = static_cast<GLsizeiptr>(raycastImage.width * raycastImage.height * 4);
+        glGenBuffers(static_cast<GLsizei>(pixelBuffers.size()), pixelBuffers.data());
+        for (const unsigned int buffer : pixelBuffers)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, frameBytes, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // Finish the frame in flight and free the pixel buffers, while the GL context is still current
+    inline void Shutdown()
+    {
+        FinishFrame();
+        glDeleteBuffers(static_cast<GLsizei>(pixelBuffers.size()), pixelBuffers.data());
+        pixelBuffers = {};
     }
 
     inline void Draw()
     {
         // Draw the updated texture to the screen (scaled to the full screen size)
         DrawTexture(raycastTexture, 0, 0, WHITE);
+
+        if (showTileCosts)
+        {
+            DrawTileCosts();
+        }
     }
 
-    // Function to render raycasting to a texture
+    // Function to render raycasting to a texture. The frame started by the last call is finished
+    // and uploaded, then the next one is started and left tracing while the caller draws.
     inline void Update(const Camera &camera, int screenWidth, int screenHeight)
     {
-        // Access the pixel data of the image
-        Color* pixels = reinterpret_cast<Color*>(raycastImage.data);
+        FinishFrame();
+        if (occupancyStale)
+        {
+            UpdateMacrocellOccupancy();
+            occupancyStale = false;
+        }
 
-        // Parallelize raycasting for the whole grid of pixels
-    #pragma omp parallel for num_threads(Constants::kOMPThreads) schedule(guided)
-        for (int y = 0; y < screenHeight; ++y)
+        const std::uint64_t viewKey = MakeViewKey(camera, screenWidth, screenHeight);
+        const bool viewChanged = viewKey != lastViewKey;
+        lastViewKey = viewKey;
+        const std::size_t frameBytes = static_cast<std::size_t>(screenWidth * screenHeight * 4);
+        auto *pixels = static_cast<uint8_t *>(raycastImage.data);
+        if (viewChanged)
         {
-            for (int x = 0; x < screenWidth; ++x)
+            if (const std::vector<uint8_t> *cached = frameCache.Find(viewKey))
             {
-                // Calculate the ray direction based on the camera and pixel coordinates
-                Vector3 rayDir = ScreenToRayDirection(x, y, camera, screenWidth, screenHeight);
+                std::copy(cached->begin(), cached->end(), pixels);
+                Profiler::ScopedTimer uploadTimer(profiler, "Upload");
+                Profiler::ScopedGpuTimer uploadGpuTimer(gpuTimer, "Upload");
+                UpdateTexture(raycastTexture, pixels);
+                refiner.MarkConverged();
+                return;
+            }
+        }
+
+        std::vector<VolumeUtils::PixelLattice> passes{};
+        if (progressive)
+        {
+            passes = refiner.NextFrame(viewChanged, scheduler.FrameMilliseconds());
+        }
+        else if (viewChanged || !refiner.Converged())
+        {
+            passes.emplace_back();
+            refiner.MarkConverged();
+        }
+        if (passes.empty())
+        {
+            // Converged, the texture already holds the final image
+            return;
+        }
+
+        // Camera basis and pixel deltas are set up once per frame
+        const VolumeUtils::Vec3 position{camera.position.x, camera.position.y, camera.position.z};
+        const VolumeUtils::Vec3 target{camera.target.x, camera.target.y, camera.target.z};
+        const VolumeUtils::Vec3 up{camera.up.x, camera.up.y, camera.up.z};
+        const bool orthographic = camera.projection == CAMERA_ORTHOGRAPHIC;
+        const VolumeUtils::RayCamera rayCamera =
+            VolumeUtils::MakeRayCamera(position, target, up, camera.fovy, orthographic, screenWidth, screenHeight);
+
+        packetSettings.volume = &cube;
+        packetSettings.macrocells = emptySpaceSkipping ? &macrocells : nullptr;
+        packetSettings.dda = traversalMode == TraversalMode::DDA;
+        packetSettings.trilinear = trilinear;
+        packetSettings.voxelSize = VolumeUtils::VoxelSize(cube.Spacing(), kCellSize);
+        // The step scale belongs to the transfer function, density opacities are per kStepSize
+        const bool transfer = classification == Classification::TransferFunction;
+        packetSettings.stepSize = kStepSize * (transfer ? stepScale : 1.0f);
+        packetSettings.opacityCutoff = opacityCutoff;
+        if (shading && gradients.Empty())
+        {
+            BuildGradients();
+        }
+        packetSettings.gradients = shading ? &gradients : nullptr;
+        packetSettings.gradientOpacity = gradientOpacity;
+        // a magnitude of one windowed unit per voxel counts fully
+        packetSettings.magnitudeScale = gradients.maxMagnitude * VolumeUtils::MapWindow(window).scale;
+        const std::uint64_t classificationKey = MakeClassificationKey();
+        if (classificationKey != lastClassificationKey)
+        {
+            lastClassificationKey = classificationKey;
+            const VolumeUtils::WindowMapping mapping = VolumeUtils::MapWindow(window);
+            if (transfer)
+            {
+                packetSettings.SetTransferFunction(transferFunction, mapping, stepScale, preIntegrated);
+            }
+            else
+            {
+                packetSettings.SetDensity(density, mapping);
+            }
+        }
+
+        // Each tile is traced in screen tile packets, one lattice after the other, then copied into
+        // the mapped pixel buffer. The settings are not touched again before the frame is finished.
+        uint8_t *mapped = MapPixelBuffer(pixelBuffers[tracedBuffer], frameBytes);
+        const std::size_t rowBytes = static_cast<std::size_t>(screenWidth) * 4;
+        scheduler.Start(
+            screenWidth,
+            screenHeight,
+            [level = simdLevel, rayCamera, passes = std::move(passes), pixels, mapped, rowBytes](
+                const Scheduler::Tile &tile) {
+                for (const VolumeUtils::PixelLattice &lattice : passes)
+                {
+                    VolumeUtils::RenderTile(
+                        level, rayCamera, packetSettings, tile.x0, tile.y0, tile.x1, tile.y1, pixels, lattice);
+                }
+                if (mapped == nullptr)
+                {
+                    return;
+                }
+                const auto tileBytes = static_cast<std::size_t>(tile.x1 - tile.x0) * 4;
+                for (int y = tile.y0; y < tile.y1; ++y)
+                {
+                    const std::size_t offset =
+                        static_cast<std::size_t>(y) * rowBytes + static_cast<std::size_t>(tile.x0) * 4;
+                    std::memcpy(mapped + offset, pixels + offset, tileBytes);
+                }
+            });
+        frameInFlight = true;
+        frameMapped = mapped != nullptr;
+        frameConverged = refiner.Converged();
+        frameViewKey = viewKey;
+    }
 
-                // Perform raycasting through the 3D volume (cube) to get the color for this pixel
-                Color pixelColor = RayCastThroughVolume(camera.position, rayDir, cube);
+    // Draw renderer settings using ImGui
+    inline void DrawSettings()
+    {
+        ImGui::Begin("Render Settings");
 
-                // Store the color directly in the image's pixel data
-                pixels[y * screenWidth + x] = pixelColor;
+        int mode = static_cast<int>(traversalMode);
+        if (ImGui::Combo("Traversal", &mode, kTraversalModeNames.data(), static_cast<int>(kTraversalModeNames.size())))
+        {
+            traversalMode = static_cast<TraversalMode>(mode);
+        }
+        if (traversalMode == TraversalMode::FixedStep)
+        {
+            ImGui::Checkbox("Trilinear", &trilinear);
+        }
+        // Only offer the instruction sets this CPU supports
+        const std::array<const char *, 3> levelNames{Simd::LevelName(Simd::Level::Scalar),
+                                                     Simd::LevelName(Simd::Level::Avx2),
+                                                     Simd::LevelName(Simd::Level::Avx512)};
+        int level = static_cast<int>(simdLevel);
+        if (ImGui::Combo("SIMD", &level, levelNames.data(), static_cast<int>(supportedSimdLevel) + 1))
+        {
+            simdLevel = static_cast<Simd::Level>(level);
+        }
+        ImGui::Checkbox("Skip empty space", &emptySpaceSkipping);
+        ImGui::Text("Occupied macrocells: %zu / %zu", macrocells.OccupiedCount(), macrocells.CellCount());
+        ImGui::SliderFloat("Opacity cutoff", &opacityCutoff, 0.5f, 1.0f, "%.3f");
+        bool classificationChanged = ImGui::SliderFloat("Level", &window.center, 0.0f, 255.0f, "%.1f");
+        classificationChanged |= ImGui::SliderFloat("Window", &window.width, 1.0f, 255.0f, "%.1f");
+        int classify = static_cast<int>(classification);
+        if (ImGui::Combo("Classification",
+                         &classify,
+                         kClassificationNames.data(),
+                         static_cast<int>(kClassificationNames.size())))
+        {
+            classification = static_cast<Classification>(classify);
+            classificationChanged = true;
+        }
+        if (classification == Classification::Density)
+        {
+            ImGui::SliderFloat("Density", &density, 0.0f, 8.0f, "%.2f");
+        }
+        else
+        {
+            if (traversalMode == TraversalMode::FixedStep)
+            {
+                ImGui::SliderFloat("Step scale", &stepScale, 0.25f, 16.0f, "%.2f");
+                ImGui::Checkbox("Pre-integrated", &preIntegrated);
             }
+            classificationChanged |= Gui::EditTransferFunction(transferFunction);
+        }
+        if (classificationChanged)
+        {
+            occupancyStale = true;
+        }
+        ImGui::Checkbox("Shading", &shading);
+        if (shading)
+        {
+            ImGui::SliderFloat("Gradient opacity", &gradientOpacity, 0.0f, 1.0f, "%.2f");
+            ImGui::Text("Gradients: %.1f MB, built in %.1f ms",
+                        static_cast<double>(gradients.gradients.SizeInBytes()) / (1024.0 * 1024.0),
+                        gradientMilliseconds);
         }
 
-        // Once the image is populated, we need to update the texture
-        UpdateTexture(raycastTexture, pixels); // Upload the pixel data to the texture
+        ImGui::Separator();
+        const auto tileSizeIt = std::find(kTileSizes.begin(), kTileSizes.end(), scheduler.TileSize());
+        int tileSize = static_cast<int>(std::distance(kTileSizes.begin(), tileSizeIt));
+        if (ImGui::Combo("Tile size", &tileSize, kTileSizeNames.data(), static_cast<int>(kTileSizeNames.size())))
+        {
+            scheduler.SetTileSize(kTileSizes[static_cast<std::size_t>(tileSize)]);
+        }
+        const std::vector<float> &costs = frameStats.tileMilliseconds;
+        const float slowest = costs.empty() ? 0.0f : *std::max_element(costs.begin(), costs.end());
+        ImGui::Text(
+            "Threads: %d, tiles: %zu, steals: %zu", scheduler.ThreadCount(), costs.size(), frameStats.steals);
+        ImGui::Text("Frame: %.2f ms, slowest tile: %.2f ms", frameStats.frameMilliseconds, slowest);
+        const std::vector<float> &busy = frameStats.busyMilliseconds;
+        ImGui::PlotHistogram(
+            "Busy per thread (ms)", busy.data(), static_cast<int>(busy.size()), 0, nullptr, 0.0f);
+        ImGui::Checkbox("Show tile cost", &showTileCosts);
+
+        ImGui::Separator();
+        if (ImGui::Checkbox("Progressive", &progressive))
+        {
+            refiner.Restart();
+        }
+        if (progressive)
+        {
+            float budget = refiner.BudgetMilliseconds();
+            if (ImGui::SliderFloat("Frame budget (ms)", &budget, 4.0f, 100.0f, "%.0f"))
+            {
+                refiner.SetBudgetMilliseconds(budget);
+            }
+            ImGui::Text("Coarse stride: %d, traced stride: %d%s",
+                        refiner.CoarseStride(),
+                        refiner.Stride(),
+                        refiner.Converged() ? " (converged)" : "");
+        }
+        ImGui::Text("Frame cache: %zu / %zu, hits: %zu, misses: %zu",
+                    frameCache.Size(),
+                    frameCache.Capacity(),
+                    frameCache.Hits(),
+                    frameCache.Misses());
+        ImGui::Checkbox("Profiler", &showProfiler);
+
+        ImGui::End();
+        if (showProfiler)
+        {
+            Gui::DrawProfiler(profiler, kTracePath);
+        }
     }
 
     inline void Update_Debug_Mode()
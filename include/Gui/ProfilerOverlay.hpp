@@ -0,0 +1,89 @@
+#pragma once
+#ifndef PROFILER_OVERLAY_H
+#define PROFILER_OVERLAY_H
+
+#include "Profiler/FrameProfiler.hpp"
+
+#include <imgui.h>
+
+#include <array>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace Gui
+{
+    // Window with the rolling durations of every profiled stage (newest on the right) and their
+    // median and 99th percentile, grouped into load, frame and GPU stages. "Save Trace" writes the
+    // recorded events to tracePath as a Chrome trace.
+    inline void DrawProfiler(Profiler::FrameProfiler &profiler, const std::string &tracePath)
+    {
+        static std::string status{};
+        ImGui::Begin("Profiler");
+
+        constexpr std::array<std::pair<const char *, const char *>, 3> kGroups{{
+            {Profiler::kLoadStage, "Load"},
+            {Profiler::kFrameStage, "Frame (CPU)"},
+            {Profiler::kGpuStage, "Frame (GPU)"},
+        }};
+        for (const auto &[category, title] : kGroups)
+        {
+            bool first = true;
+            profiler.ForEachStage([&](const Profiler::FrameProfiler::Stage &stage) {
+                if (std::string_view(stage.category) != category)
+                {
+                    return;
+                }
+                if (first)
+                {
+                    ImGui::Separator();
+                    ImGui::TextUnformatted(title);
+                    first = false;
+                }
+                const Profiler::StageHistory &history = stage.history;
+                const float median = history.Percentile(0.5f);
+                const float tail = history.Percentile(0.99f);
+                std::array<char, 96> overlay{};
+                std::snprintf(overlay.data(),
+                              overlay.size(),
+                              "%.2f ms, p50 %.2f, p99 %.2f (%zu)",
+                              static_cast<double>(history.Last()),
+                              static_cast<double>(median),
+                              static_cast<double>(tail),
+                              history.Count());
+                ImGui::PushID(category);
+                // Scaled to the 99th percentile so a single hitch does not flatten the rest
+                ImGui::PlotHistogram(stage.name.c_str(),
+                                     history.Samples().data(),
+                                     static_cast<int>(history.Samples().size()),
+                                     static_cast<int>(history.Offset()),
+                                     overlay.data(),
+                                     0.0f,
+                                     tail > 0.0f ? tail * 1.25f : 1.0f,
+                                     ImVec2(0.0f, 40.0f));
+                ImGui::PopID();
+            });
+        }
+
+        ImGui::Separator();
+        if (ImGui::Button("Save Trace"))
+        {
+            status = profiler.WriteChromeTrace(tracePath) ? "Wrote " + tracePath : "Could not write " + tracePath;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Reset"))
+        {
+            profiler.Clear();
+            status.clear();
+        }
+        ImGui::Text("Events: %zu", profiler.EventCount());
+        if (!status.empty())
+        {
+            ImGui::TextUnformatted(status.c_str());
+        }
+        ImGui::End();
+    }
+} // namespace Gui
+
+#endif // PROFILER_OVERLAY_H
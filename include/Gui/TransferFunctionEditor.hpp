@@ -0,0 +1,84 @@
+#pragma once
+#ifndef TRANSFER_FUNCTION_EDITOR_H
+#define TRANSFER_FUNCTION_EDITOR_H
+
+#include "Volume/TransferFunction.hpp"
+
+#include <imgui.h>
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+namespace Gui
+{
+    // Control points of a 1D transfer function: value, colour and opacity of each point plus the
+    // baked opacity curve. Returns whether the function changed.
+    inline bool EditTransferFunction(VolumeUtils::TransferFunction &transfer)
+    {
+        constexpr std::size_t kPreviewSize = 128;
+        const std::vector<VolumeUtils::Rgba> baked = transfer.Bake(kPreviewSize);
+        std::array<float, kPreviewSize> opacity{};
+        for (std::size_t i = 0; i < kPreviewSize; ++i)
+        {
+            opacity[i] = baked[i][3];
+        }
+        ImGui::PlotLines("Opacity",
+                         opacity.data(),
+                         static_cast<int>(opacity.size()),
+                         0,
+                         nullptr,
+                         0.0f,
+                         1.0f,
+                         ImVec2(0.0f, 60.0f));
+
+        bool changed = false;
+        std::size_t removed = transfer.points.size();
+        for (std::size_t i = 0; i < transfer.points.size(); ++i)
+        {
+            VolumeUtils::TransferPoint &point = transfer.points[i];
+            ImGui::PushID(static_cast<int>(i));
+            changed |= ImGui::DragFloat("##value", &point.value, 0.002f, 0.0f, 1.0f, "%.3f");
+            ImGui::SameLine();
+            changed |= ImGui::ColorEdit4("##color", point.color.data());
+            ImGui::SameLine();
+            if (transfer.points.size() > 1 && ImGui::Button("-"))
+            {
+                removed = i;
+            }
+            ImGui::PopID();
+        }
+        if (removed < transfer.points.size())
+        {
+            transfer.points.erase(transfer.points.begin() + static_cast<std::ptrdiff_t>(removed));
+            changed = true;
+        }
+        if (ImGui::Button("Add point"))
+        {
+            // Split the widest gap between neighbouring points
+            transfer.Sort();
+            VolumeUtils::TransferPoint point{0.5f, transfer.Evaluate(0.5f)};
+            float widest = 0.0f;
+            for (std::size_t i = 1; i < transfer.points.size(); ++i)
+            {
+                const float gap = transfer.points[i].value - transfer.points[i - 1].value;
+                if (gap > widest)
+                {
+                    widest = gap;
+                    point.value = transfer.points[i - 1].value + gap * 0.5f;
+                    point.color = transfer.Evaluate(point.value);
+                }
+            }
+            transfer.points.push_back(point);
+            changed = true;
+        }
+        // Reordering under a drag would hand it to the neighbouring point, wait for the release
+        if (!ImGui::IsAnyItemActive())
+        {
+            transfer.Sort();
+        }
+        return changed;
+    }
+} // namespace Gui
+
+#endif // TRANSFER_FUNCTION_EDITOR_H
@@ -0,0 +1,327 @@
+#pragma once
+#ifndef FRAME_PROFILER_H
+#define FRAME_PROFILER_H
+
+#include "Profiler/Json.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace Profiler
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Categories of stages, also the groups of the overlay and of the trace
+    inline constexpr const char *kFrameStage = "frame"; // CPU work of every frame
+    inline constexpr const char *kLoadStage = "load";   // loading and preprocessing, once
+    inline constexpr const char *kGpuStage = "gpu";     // GPU time of timer queries
+
+    // Durations of the most recent runs of one stage in a ring: once full, the oldest sample is
+    // at Offset(), the layout ImGui::PlotHistogram takes as values_offset
+    class StageHistory
+    {
+    public:
+        static constexpr std::size_t kDefaultLength{240};
+
+        explicit StageHistory(std::size_t length = kDefaultLength)
+            : capacity(std::max<std::size_t>(length, 1))
+        {
+        }
+
+        void Add(float milliseconds)
+        {
+            if (samples.size() < capacity)
+            {
+                samples.push_back(milliseconds);
+            }
+            else
+            {
+                samples[next] = milliseconds;
+            }
+            next = (next + 1) % capacity;
+            ++count;
+        }
+
+        [[nodiscard]] const std::vector<float> &Samples() const
+        {
+            return samples;
+        }
+
+        [[nodiscard]] std::size_t Offset() const
+        {
+            return samples.size() < capacity ? 0 : next;
+        }
+
+        // Every run so far, including those that dropped out of the ring
+        [[nodiscard]] std::size_t Count() const
+        {
+            return count;
+        }
+
+        [[nodiscard]] float Last() const
+        {
+            return samples.empty() ? 0.0f : samples[(next + capacity - 1) % capacity];
+        }
+
+        // Nearest-rank percentile of the samples in the ring, fraction in [0, 1]
+        [[nodiscard]] float Percentile(float fraction) const
+        {
+            if (samples.empty())
+            {
+                return 0.0f;
+            }
+            std::vector<float> sorted = samples;
+            const auto rank = static_cast<std::size_t>(std::ceil(fraction * static_cast<float>(sorted.size())));
+            const std::size_t index = std::min(std::max<std::size_t>(rank, 1), sorted.size()) - 1;
+            std::nth_element(sorted.begin(), sorted.begin() + static_cast<std::ptrdiff_t>(index), sorted.end());
+            return sorted[index];
+        }
+
+    private:
+        std::size_t capacity;
+        std::size_t next{0};
+        std::size_t count{0};
+        std::vector<float> samples{};
+    };
+
+    // One complete event of the trace, times in microseconds since the profiler started
+    struct TraceEvent
+    {
+        std::string name{};
+        const char *category{kFrameStage};
+        double start{0.0};
+        double duration{0.0};
+        int thread{0};
+    };
+
+    // Collects the timings of named stages: a rolling history per stage for the overlay and the
+    // most recent events for a Chrome trace (chrome://tracing, Perfetto). Stages can be recorded
+    // from any thread, each thread gets a track of its own and GPU timings share one more.
+    class FrameProfiler
+    {
+    public:
+        static constexpr std::size_t kDefaultTraceCapacity{1U << 17U};
+        static constexpr int kGpuTrack{0}; // the thread that made the profiler is 1, others follow
+
+        struct Stage
+        {
+            std::string name{};
+            const char *category{kFrameStage};
+            StageHistory history{};
+        };
+
+        explicit FrameProfiler(std::size_t historyLength = StageHistory::kDefaultLength,
+                               std::size_t traceCapacity = kDefaultTraceCapacity)
+            : length(historyLength), capacity(traceCapacity)
+        {
+        }
+
+        FrameProfiler(const FrameProfiler &) = delete;
+        FrameProfiler &operator=(const FrameProfiler &) = delete;
+
+        // A stage that ran on the calling thread from start to end
+        void Record(const char *name, const char *category, Clock::time_point start, Clock::time_point end)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Add(name, category, Microseconds(start), Microseconds(end) - Microseconds(start), Track());
+        }
+
+        // GPU time of a stage, placed in the trace where its commands were submitted
+        void RecordGpu(const char *name, Clock::time_point submitted, double milliseconds)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Add(name, kGpuStage, Microseconds(submitted), milliseconds * 1000.0, kGpuTrack);
+        }
+
+        // visit(const Stage &) for every stage in the order they were first recorded
+        template <typename Visit>
+        void ForEachStage(Visit &&visit) const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const Stage &stage : stages)
+            {
+                visit(stage);
+            }
+        }
+
+        [[nodiscard]] std::size_t EventCount() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return events.size();
+        }
+
+        // Forget the histories and events, the stages stay in their order
+        void Clear()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (Stage &stage : stages)
+            {
+                stage.history = StageHistory(length);
+            }
+            events.clear();
+        }
+
+        // Trace event format: a complete ("X") event per recorded stage, metadata names the tracks
+        void WriteChromeTrace(std::ostream &out) const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+            out << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << kGpuTrack
+                << R"(,"args":{"name":"GPU"}})";
+            for (std::size_t i = 0; i < threads.size(); ++i)
+            {
+                out << ",\n"
+                    << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << i + 1 << R"(,"args":{"name":")"
+                    << (i == 0 ? "Main" : "Worker " + std::to_string(i)) << "\"}}";
+            }
+            const auto precision = out.precision(3);
+            const auto flags = out.setf(std::ios::fixed, std::ios::floatfield);
+            for (const TraceEvent &event : events)
+            {
+                out << ",\n{\"name\":\"" << JsonEscaped(event.name) << "\",\"cat\":\"" << event.category
+                    << R"(","ph":"X","pid":1,"tid":)" << event.thread << ",\"ts\":" << event.start
+                    << ",\"dur\":" << event.duration << "}";
+            }
+            out.precision(precision);
+            out.flags(flags);
+            out << "\n]}\n";
+        }
+
+        // False if the file could not be written
+        bool WriteChromeTrace(const std::string &path) const
+        {
+            std::ofstream file(path);
+            WriteChromeTrace(file);
+            return static_cast<bool>(file);
+        }
+
+    private:
+        void Add(const char *name, const char *category, double start, double duration, int track)
+        {
+            auto stage = std::find_if(stages.begin(), stages.end(), [&](const Stage &candidate) {
+                return std::string_view(candidate.category) == category && candidate.name == name;
+            });
+            if (stage == stages.end())
+            {
+                stage = stages.insert(stages.end(), Stage{name, category, StageHistory(length)});
+            }
+            stage->history.Add(static_cast<float>(duration / 1000.0));
+
+            if (capacity == 0)
+            {
+                return;
+            }
+            if (events.size() == capacity)
+            {
+                events.pop_front();
+            }
+            events.push_back(TraceEvent{name, category, start, duration, track});
+        }
+
+        [[nodiscard]] double Microseconds(Clock::time_point time) const
+        {
+            return std::chrono::duration<double, std::micro>(time - epoch).count();
+        }
+
+        // Track of the calling thread, numbered in order of appearance
+        int Track()
+        {
+            const std::thread::id id = std::this_thread::get_id();
+            auto thread = std::find(threads.begin(), threads.end(), id);
+            if (thread == threads.end())
+            {
+                thread = threads.insert(threads.end(), id);
+            }
+            return static_cast<int>(thread - threads.begin()) + 1;
+        }
+
+        std::size_t length;
+        std::size_t capacity;
+        Clock::time_point epoch{Clock::now()};
+        mutable std::mutex mutex{};
+        std::vector<Stage> stages{};
+        std::deque<TraceEvent> events{};
+        std::vector<std::thread::id> threads{std::this_thread::get_id()};
+    };
+
+    // Records the time from construction to destruction as a run of `name`
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer(FrameProfiler &owner, const char *name, const char *category = kFrameStage)
+            : profiler(owner), stage(name), group(category), start(Clock::now())
+        {
+        }
+
+        ~ScopedTimer()
+        {
+            profiler.Record(stage, group, start, Clock::now());
+        }
+
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+    private:
+        FrameProfiler &profiler;
+        const char *stage;
+        const char *group;
+        Clock::time_point start;
+    };
+
+    // Consecutive stages of a frame: beginning one ends the one before, the last ends with End()
+    // or when the timer goes out of scope
+    class StageTimer
+    {
+    public:
+        explicit StageTimer(FrameProfiler &owner, const char *category = kFrameStage)
+            : profiler(owner), group(category)
+        {
+        }
+
+        ~StageTimer()
+        {
+            End();
+        }
+
+        StageTimer(const StageTimer &) = delete;
+        StageTimer &operator=(const StageTimer &) = delete;
+
+        void Begin(const char *name)
+        {
+            const Clock::time_point now = Clock::now();
+            if (stage != nullptr)
+            {
+                profiler.Record(stage, group, start, now);
+            }
+            stage = name;
+            start = now;
+        }
+
+        void End()
+        {
+            if (stage != nullptr)
+            {
+                profiler.Record(stage, group, start, Clock::now());
+                stage = nullptr;
+            }
+        }
+
+    private:
+        FrameProfiler &profiler;
+        const char *group;
+        const char *stage{nullptr};
+        Clock::time_point start{};
+    };
+} // namespace Profiler
+
+#endif // FRAME_PROFILER_H
@@ -0,0 +1,119 @@
+#pragma once
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+// GL entry points come from the loader raylib was built with
+#include "external/glad.h"
+#include "Profiler/FrameProfiler.hpp"
+
+#include <deque>
+#include <vector>
+
+namespace Profiler
+{
+    // GL_TIME_ELAPSED queries around GPU stages. Results are collected frames later, once the GPU
+    // has them, so timing never waits for the pipeline to drain. Queries cannot nest: beginning a
+    // stage ends the one still open.
+    class GpuTimer
+    {
+    public:
+        GpuTimer() = default;
+        GpuTimer(const GpuTimer &) = delete;
+        GpuTimer &operator=(const GpuTimer &) = delete;
+
+        void Begin(const char *stage)
+        {
+            End();
+            GLuint query = 0;
+            if (idle.empty())
+            {
+                glGenQueries(1, &query);
+            }
+            else
+            {
+                query = idle.back();
+                idle.pop_back();
+            }
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            pending.push_back({query, stage, Clock::now()});
+            open = true;
+        }
+
+        void End()
+        {
+            if (open)
+            {
+                glEndQuery(GL_TIME_ELAPSED);
+                open = false;
+            }
+        }
+
+        // Hand the finished queries to the profiler, in the order they were issued
+        void Collect(FrameProfiler &profiler)
+        {
+            while (pending.size() > (open ? 1U : 0U))
+            {
+                const Query &query = pending.front();
+                GLint available = 0;
+                glGetQueryObjectiv(query.id, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (available == 0)
+                {
+                    return;
+                }
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(query.id, GL_QUERY_RESULT, &nanoseconds);
+                profiler.RecordGpu(query.stage, query.submitted, static_cast<double>(nanoseconds) * 1e-6);
+                idle.push_back(query.id);
+                pending.pop_front();
+            }
+        }
+
+        // Delete the queries, call while the GL context is still current
+        void Release()
+        {
+            End();
+            for (const Query &query : pending)
+            {
+                idle.push_back(query.id);
+            }
+            pending.clear();
+            glDeleteQueries(static_cast<GLsizei>(idle.size()), idle.data());
+            idle.clear();
+        }
+
+    private:
+        struct Query
+        {
+            GLuint id{0};
+            const char *stage{""};
+            Clock::time_point submitted{};
+        };
+
+        std::vector<GLuint> idle{};
+        std::deque<Query> pending{};
+        bool open{false};
+    };
+
+    // Times the GL commands issued from construction to destruction as `stage`
+    class ScopedGpuTimer
+    {
+    public:
+        ScopedGpuTimer(GpuTimer &owner, const char *stage) : timer(owner)
+        {
+            timer.Begin(stage);
+        }
+
+        ~ScopedGpuTimer()
+        {
+            timer.End();
+        }
+
+        ScopedGpuTimer(const ScopedGpuTimer &) = delete;
+        ScopedGpuTimer &operator=(const ScopedGpuTimer &) = delete;
+
+    private:
+        GpuTimer &timer;
+    };
+} // namespace Profiler
+
+#endif // GPU_TIMER_H
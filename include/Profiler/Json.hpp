@@ -0,0 +1,55 @@
+#pragma once
+#ifndef PROFILER_JSON_H
+#define PROFILER_JSON_H
+
+#include <array>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+namespace Profiler
+{
+    // Text as the contents of a JSON string: quotes and backslashes (Windows paths) escaped,
+    // control characters written as escapes
+    inline std::string JsonEscaped(std::string_view text)
+    {
+        std::string escaped;
+        escaped.reserve(text.size());
+        for (const char c : text)
+        {
+            switch (c)
+            {
+            case '"':
+                escaped += "\\\"";
+                break;
+            case '\\':
+                escaped += "\\\\";
+                break;
+            case '\n':
+                escaped += "\\n";
+                break;
+            case '\r':
+                escaped += "\\r";
+                break;
+            case '\t':
+                escaped += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    std::array<char, 8> code{};
+                    std::snprintf(code.data(), code.size(), "\\u%04x", static_cast<unsigned>(static_cast<unsigned char>(c)));
+                    escaped += code.data();
+                }
+                else
+                {
+                    escaped += c;
+                }
+                break;
+            }
+        }
+        return escaped;
+    }
+} // namespace Profiler
+
+#endif // PROFILER_JSON_H
@@ -0,0 +1,44 @@
+#pragma once
+#ifndef PEAK_MEMORY_H
+#define PEAK_MEMORY_H
+
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace Profiler
+{
+    // Most physical memory the process has held at once so far, in bytes; 0 if the OS does not say
+    inline std::size_t PeakResidentBytes()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters{};
+        if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) == 0)
+        {
+            return 0;
+        }
+        return counters.PeakWorkingSetSize;
+#else
+        rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+        {
+            return 0;
+        }
+#ifdef __APPLE__
+        return static_cast<std::size_t>(usage.ru_maxrss); // bytes
+#else
+        return static_cast<std::size_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+    }
+} // namespace Profiler
+
+#endif // PEAK_MEMORY_H
@@ -0,0 +1,71 @@
+#pragma once
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Scheduler
+{
+    // Run body(i) for every i in [0, count) on every core, each thread claiming the next index as
+    // it finishes one, so uneven items balance out. The first exception thrown stops the remaining
+    // work and is rethrown here. threadCount 0 uses every hardware thread, the calling thread works
+    // as one of them.
+    template <typename Body>
+    void ParallelFor(int count, int threadCount, const Body &body)
+    {
+        if (count <= 0)
+        {
+            return;
+        }
+        if (threadCount <= 0)
+        {
+            threadCount = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1U));
+        }
+        threadCount = std::min(threadCount, count);
+
+        std::atomic<int> next{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error{};
+        std::mutex errorMutex{};
+        const auto work = [&]() {
+            try
+            {
+                for (int i = next.fetch_add(1); i < count && !failed.load(); i = next.fetch_add(1))
+                {
+                    body(i);
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+                failed.store(true);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (int thread = 1; thread < threadCount; ++thread)
+        {
+            threads.emplace_back(work);
+        }
+        work();
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+} // namespace Scheduler
+
+#endif // PARALLEL_FOR_H
@@ -0,0 +1,97 @@
+#pragma once
+#ifndef SLICE_LOADER_H
+#define SLICE_LOADER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Scheduler
+{
+    // Load the slices of a series on every core. Each thread owns a Worker (default constructed,
+    // e.g. a parser that is not safe to share) and claims the next slice to load. The gap between
+    // slices i and i + 1 is filled by whichever thread finishes the second of the two, as soon as
+    // it does, so interpolation overlaps with loading instead of waiting for the whole series.
+    //   loadSlice(Worker &, int slice)  writes slice straight into its final place
+    //   fillGap(int slice)              fills everything between slice and slice + 1
+    // The first exception thrown stops the remaining work and is rethrown here. threadCount 0 uses
+    // every hardware thread, the calling thread works as one of them.
+    template <typename Worker, typename LoadSlice, typename FillGap>
+    void LoadSlices(int sliceCount, int threadCount, const LoadSlice &loadSlice, const FillGap &fillGap)
+    {
+        if (sliceCount <= 0)
+        {
+            return;
+        }
+        if (threadCount <= 0)
+        {
+            threadCount = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1U));
+        }
+        threadCount = std::min(threadCount, sliceCount);
+
+        std::atomic<int> nextSlice{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error{};
+        std::mutex errorMutex{};
+        // Slices of each gap done so far (value-initialized to 0), the one that brings it to 2
+        // fills the gap
+        std::vector<std::atomic<int>> gapSlices(static_cast<std::size_t>(sliceCount - 1));
+
+        const auto completeGap = [&](int gap) {
+            if (gapSlices[static_cast<std::size_t>(gap)].fetch_add(1, std::memory_order_acq_rel) == 1)
+            {
+                fillGap(gap);
+            }
+        };
+
+        const auto work = [&]() {
+            try
+            {
+                Worker worker{};
+                for (int slice = nextSlice.fetch_add(1); slice < sliceCount && !failed.load();
+                     slice = nextSlice.fetch_add(1))
+                {
+                    loadSlice(worker, slice);
+                    if (slice > 0)
+                    {
+                        completeGap(slice - 1);
+                    }
+                    if (slice + 1 < sliceCount)
+                    {
+                        completeGap(slice);
+                    }
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+                failed.store(true);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (int thread = 1; thread < threadCount; ++thread)
+        {
+            threads.emplace_back(work);
+        }
+        work();
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+} // namespace Scheduler
+
+#endif // SLICE_LOADER_H
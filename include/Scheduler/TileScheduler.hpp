@@ -0,0 +1,369 @@
+#pragma once
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace Scheduler
+{
+    // Screen rectangle [x0, x1) x [y0, y1)
+    struct Tile
+    {
+        int x0{0};
+        int y0{0};
+        int x1{0};
+        int y1{0};
+    };
+
+    // Splits a frame into square tiles and renders them on every core. Each thread owns a deque of
+    // tiles and takes work from its front; a thread that runs dry steals from the back of another
+    // thread's deque. Tiles are dealt out most expensive first, using the time each tile took in
+    // the previous frame, so the slow ones (dense tissue) start early and cheap ones (empty
+    // background) fill the gaps at the end. The calling thread works as thread 0.
+    class TileScheduler
+    {
+    public:
+        static constexpr int kDefaultTileSize{32};
+
+        using RenderFunction = std::function<void(const Tile &)>;
+
+        // threadCount 0 uses every hardware thread
+        explicit TileScheduler(int threadCount = 0, int size = kDefaultTileSize)
+            : tileSize(std::max(size, 1))
+        {
+            if (threadCount <= 0)
+            {
+                threadCount = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1U));
+            }
+            for (int worker = 0; worker < threadCount; ++worker)
+            {
+                queues.push_back(std::make_unique<Queue>());
+            }
+            busyMilliseconds.assign(queues.size(), 0.0f);
+            doneMilliseconds.assign(queues.size(), 0.0f);
+            for (int worker = 1; worker < threadCount; ++worker)
+            {
+                threads.emplace_back([this, worker]() { WorkerLoop(worker); });
+            }
+        }
+
+        ~TileScheduler()
+        {
+            Wait();
+            {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (std::thread &thread : threads)
+            {
+                thread.join();
+            }
+        }
+
+        TileScheduler(const TileScheduler &) = delete;
+        TileScheduler &operator=(const TileScheduler &) = delete;
+
+        // Render a width x height frame, returns once every tile is done. `render` is called
+        // concurrently from all threads, each tile exactly once.
+        void Run(int width, int height, const RenderFunction &render)
+        {
+            Start(width, height, render);
+            Wait();
+        }
+
+        // Start a frame on the worker threads and return at once, Wait() finishes it with the
+        // calling thread taking the tiles still left. In between only ThreadCount, TileSize and
+        // SetTileSize (for the next frame) may be called; the timings belong to the last frame.
+        void Start(int width, int height, RenderFunction render)
+        {
+            Wait();
+            frameStart = std::chrono::steady_clock::now();
+            PrepareTiles(width, height);
+            DealTiles();
+
+            std::fill(busyMilliseconds.begin(), busyMilliseconds.end(), 0.0f);
+            std::fill(doneMilliseconds.begin(), doneMilliseconds.end(), 0.0f);
+            steals.store(0, std::memory_order_relaxed);
+            frameJob = std::move(render);
+            {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                job = &frameJob;
+                running = threads.size();
+                ++generation;
+            }
+            started = true;
+            wake.notify_all();
+        }
+
+        // Returns once every tile of the started frame is done, at once if none is
+        void Wait()
+        {
+            if (!started)
+            {
+                return;
+            }
+            Work(0, frameJob);
+
+            std::unique_lock<std::mutex> lock(stateMutex);
+            finished.wait(lock, [this]() { return running == 0; });
+            job = nullptr;
+            started = false;
+            // from the start to the last tile, not to whenever the caller came back for the frame
+            frameMilliseconds = *std::max_element(doneMilliseconds.begin(), doneMilliseconds.end());
+        }
+
+        // A frame was started and not waited for yet
+        [[nodiscard]] bool Busy() const
+        {
+            return started;
+        }
+
+        [[nodiscard]] int ThreadCount() const
+        {
+            return static_cast<int>(queues.size());
+        }
+
+        [[nodiscard]] int TileSize() const
+        {
+            return tileSize;
+        }
+
+        // Takes effect on the next frame, the cost history is dropped
+        void SetTileSize(int size)
+        {
+            tileSize = std::max(size, 1);
+        }
+
+        [[nodiscard]] int Columns() const
+        {
+            return columns;
+        }
+
+        [[nodiscard]] int Rows() const
+        {
+            return rows;
+        }
+
+        // Tiles of the last frame, row-major
+        [[nodiscard]] const std::vector<Tile> &Tiles() const
+        {
+            return tiles;
+        }
+
+        // Render time of each tile in the last frame
+        [[nodiscard]] const std::vector<float> &TileMilliseconds() const
+        {
+            return tileMilliseconds;
+        }
+
+        // Thread that rendered each tile in the last frame
+        [[nodiscard]] const std::vector<int> &TileThreads() const
+        {
+            return tileThreads;
+        }
+
+        // Time each thread spent inside `render` in the last frame
+        [[nodiscard]] const std::vector<float> &ThreadBusyMilliseconds() const
+        {
+            return busyMilliseconds;
+        }
+
+        [[nodiscard]] float FrameMilliseconds() const
+        {
+            return frameMilliseconds;
+        }
+
+        // Tiles taken from another thread's deque in the last frame
+        [[nodiscard]] std::size_t Steals() const
+        {
+            return steals.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct Queue
+        {
+            std::mutex mutex{};
+            std::deque<int> tiles{};
+        };
+
+        static float MillisecondsSince(std::chrono::steady_clock::time_point start)
+        {
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            return std::chrono::duration<float, std::milli>(elapsed).count();
+        }
+
+        // Rebuild the tile grid when the frame or tile size changed
+        void PrepareTiles(int width, int height)
+        {
+            if (width == frameWidth && height == frameHeight && tileSize == gridTileSize)
+            {
+                return;
+            }
+            frameWidth = width;
+            frameHeight = height;
+            gridTileSize = tileSize;
+            columns = (std::max(width, 0) + tileSize - 1) / tileSize;
+            rows = (std::max(height, 0) + tileSize - 1) / tileSize;
+
+            tiles.clear();
+            for (int row = 0; row < rows; ++row)
+            {
+                for (int column = 0; column < columns; ++column)
+                {
+                    const int x0 = column * tileSize;
+                    const int y0 = row * tileSize;
+                    const int x1 = std::min(x0 + tileSize, width);
+                    const int y1 = std::min(y0 + tileSize, height);
+                    tiles.push_back({x0, y0, x1, y1});
+                }
+            }
+            tileMilliseconds.assign(tiles.size(), 0.0f);
+            tileThreads.assign(tiles.size(), 0);
+            order.resize(tiles.size());
+        }
+
+        // Most expensive tiles first, dealt round-robin so every deque gets a share of them
+        void DealTiles()
+        {
+            std::iota(order.begin(), order.end(), 0);
+            const auto slower = [this](int a, int b) {
+                const auto costA = tileMilliseconds[static_cast<std::size_t>(a)];
+                return costA > tileMilliseconds[static_cast<std::size_t>(b)];
+            };
+            std::stable_sort(order.begin(), order.end(), slower);
+            for (const std::unique_ptr<Queue> &queue : queues)
+            {
+                queue->tiles.clear();
+            }
+            for (std::size_t rank = 0; rank < order.size(); ++rank)
+            {
+                queues[rank % queues.size()]->tiles.push_back(order[rank]);
+            }
+        }
+
+        bool PopOwn(int self, int &tile)
+        {
+            Queue &queue = *queues[static_cast<std::size_t>(self)];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tiles.empty())
+            {
+                return false;
+            }
+            tile = queue.tiles.front();
+            queue.tiles.pop_front();
+            return true;
+        }
+
+        bool Steal(int self, int &tile)
+        {
+            const int count = ThreadCount();
+            for (int offset = 1; offset < count; ++offset)
+            {
+                Queue &victim = *queues[static_cast<std::size_t>((self + offset) % count)];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.tiles.empty())
+                {
+                    tile = victim.tiles.back();
+                    victim.tiles.pop_back();
+                    steals.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Drain the own deque, then help the others until no work is left anywhere
+        void Work(int self, const RenderFunction &render)
+        {
+            int tile = 0;
+            float busy = 0.0f;
+            bool rendered = false;
+            while (PopOwn(self, tile) || Steal(self, tile))
+            {
+                const auto start = std::chrono::steady_clock::now();
+                render(tiles[static_cast<std::size_t>(tile)]);
+                const float elapsed = MillisecondsSince(start);
+                // Every tile is handed out once, so these writes never race
+                tileMilliseconds[static_cast<std::size_t>(tile)] = elapsed;
+                tileThreads[static_cast<std::size_t>(tile)] = self;
+                busy += elapsed;
+                rendered = true;
+            }
+            busyMilliseconds[static_cast<std::size_t>(self)] = busy;
+            if (rendered)
+            {
+                doneMilliseconds[static_cast<std::size_t>(self)] = MillisecondsSince(frameStart);
+            }
+        }
+
+        void WorkerLoop(int self)
+        {
+            std::uint64_t seen = 0;
+            for (;;)
+            {
+                const RenderFunction *render = nullptr;
+                {
+                    std::unique_lock<std::mutex> lock(stateMutex);
+                    wake.wait(lock, [this, seen]() { return stopping || generation != seen; });
+                    if (stopping)
+                    {
+                        return;
+                    }
+                    seen = generation;
+                    render = job;
+                }
+
+                Work(self, *render);
+
+                std::lock_guard<std::mutex> lock(stateMutex);
+                if (--running == 0)
+                {
+                    finished.notify_one();
+                }
+            }
+        }
+
+        int tileSize;
+        int gridTileSize{0};
+        int frameWidth{-1};
+        int frameHeight{-1};
+        int columns{0};
+        int rows{0};
+        std::vector<Tile> tiles{};
+        std::vector<int> order{};
+        std::vector<float> tileMilliseconds{};
+        std::vector<int> tileThreads{};
+        std::vector<float> busyMilliseconds{};
+        std::vector<float> doneMilliseconds{}; // per thread, when its last tile of the frame was done
+        std::chrono::steady_clock::time_point frameStart{};
+        float frameMilliseconds{0.0f};
+        std::atomic<std::size_t> steals{0};
+
+        std::vector<std::unique_ptr<Queue>> queues{};
+        std::vector<std::thread> threads{};
+        std::mutex stateMutex{};
+        std::condition_variable wake{};
+        std::condition_variable finished{};
+        RenderFunction frameJob{};
+        const RenderFunction *job{nullptr};
+        bool started{false};
+        std::size_t running{0};
+        std::uint64_t generation{0};
+        bool stopping{false};
+    };
+} // namespace Scheduler
+
+#endif // TILE_SCHEDULER_H
@@ -0,0 +1,679 @@
+#pragma once
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DVR_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#else
+#define DVR_SIMD_X86 0
+#endif
+
+// Code using the wide lanes is compiled for the instruction set through function attributes so the
+// rest of the program keeps the baseline target and runs on any x86-64 CPU.
+#if defined(__GNUC__) || defined(__clang__)
+#define DVR_SIMD_INLINE inline __attribute__((always_inline))
+#define DVR_TARGET_AVX2 __attribute__((target("avx2")))
+#define DVR_TARGET_AVX512 __attribute__((target("avx512f")))
+#elif defined(_MSC_VER)
+#define DVR_SIMD_INLINE __forceinline
+#define DVR_TARGET_AVX2
+#define DVR_TARGET_AVX512
+#else
+#define DVR_SIMD_INLINE inline
+#define DVR_TARGET_AVX2
+#define DVR_TARGET_AVX512
+#endif
+
+// Everything defined between BEGIN and END is compiled for the instruction set. AVX-512 implies
+// FMA, contraction is turned off so a * b + c rounds twice like it does in the scalar code.
+#if defined(__clang__)
+#define DVR_SIMD_BEGIN_AVX2                                                                        \
+    _Pragma("clang attribute push(__attribute__((target(\"avx2\"))), apply_to = function)")        \
+    _Pragma("clang fp contract(off)")
+#define DVR_SIMD_BEGIN_AVX512                                                                      \
+    _Pragma("clang attribute push(__attribute__((target(\"avx512f\"))), apply_to = function)")     \
+    _Pragma("clang fp contract(off)")
+#define DVR_SIMD_END                                                                               \
+    _Pragma("clang attribute pop")                                                                 \
+    _Pragma("clang fp contract(on)")
+#elif defined(__GNUC__)
+#define DVR_SIMD_BEGIN_AVX2                                                                        \
+    _Pragma("GCC push_options")                                                                    \
+    _Pragma("GCC target(\"avx2\")")                                                                \
+    _Pragma("GCC optimize(\"fp-contract=off\")")
+#define DVR_SIMD_BEGIN_AVX512                                                                      \
+    _Pragma("GCC push_options")                                                                    \
+    _Pragma("GCC target(\"avx512f\")")                                                             \
+    _Pragma("GCC optimize(\"fp-contract=off\")")
+#define DVR_SIMD_END _Pragma("GCC pop_options")
+#else
+#define DVR_SIMD_BEGIN_AVX2
+#define DVR_SIMD_BEGIN_AVX512
+#define DVR_SIMD_END
+#endif
+
+// Thin lane wrappers: every pack type offers the same operators and free functions, so a kernel
+// written once against `typename P::Float` runs 1, 8 or 16 rays at a time. All operations are
+// plain IEEE single precision (no FMA, no approximations), which keeps the lanes of the wide
+// packs bit-identical to the scalar pack.
+namespace Simd
+{
+    enum class Level
+    {
+        Scalar,
+        Avx2,
+        Avx512,
+    };
+
+    inline const char *LevelName(Level level)
+    {
+        switch (level)
+        {
+        case Level::Avx512:
+            return "AVX-512";
+        case Level::Avx2:
+            return "AVX2";
+        default:
+            return "Scalar";
+        }
+    }
+
+    // Widest instruction set the CPU and OS support
+    inline Level DetectLevel()
+    {
+#if DVR_SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+        {
+            return Level::Avx512;
+        }
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return Level::Avx2;
+        }
+#elif DVR_SIMD_X86 && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        if (osxsave)
+        {
+            const unsigned long long xcr0 = _xgetbv(0);
+            __cpuidex(info, 7, 0);
+            if ((xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 16)) != 0)
+            {
+                return Level::Avx512;
+            }
+            if ((xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0)
+            {
+                return Level::Avx2;
+            }
+        }
+#endif
+        return Level::Scalar;
+    }
+
+    //------------------------------------------------------------------------------------------
+    // Scalar: one lane, native types
+    //------------------------------------------------------------------------------------------
+    struct ScalarPack
+    {
+        static constexpr int kWidth{1};
+        static constexpr int kTileWidth{1};
+        using Float = float;
+        using Int = std::int32_t;
+        using Mask = bool;
+    };
+
+    DVR_SIMD_INLINE bool Any(bool m)
+    {
+        return m;
+    }
+    DVR_SIMD_INLINE float Select(bool m, float a, float b)
+    {
+        return m ? a : b;
+    }
+    DVR_SIMD_INLINE std::int32_t Select(bool m, std::int32_t a, std::int32_t b)
+    {
+        return m ? a : b;
+    }
+    // Same operand order and NaN behaviour as minps / maxps
+    DVR_SIMD_INLINE float Min(float a, float b)
+    {
+        return a < b ? a : b;
+    }
+    DVR_SIMD_INLINE float Max(float a, float b)
+    {
+        return a > b ? a : b;
+    }
+    DVR_SIMD_INLINE std::int32_t Min(std::int32_t a, std::int32_t b)
+    {
+        return a < b ? a : b;
+    }
+    DVR_SIMD_INLINE std::int32_t Max(std::int32_t a, std::int32_t b)
+    {
+        return a > b ? a : b;
+    }
+    DVR_SIMD_INLINE float Floor(float a)
+    {
+        return std::floor(a);
+    }
+    DVR_SIMD_INLINE float Ceil(float a)
+    {
+        return std::ceil(a);
+    }
+    DVR_SIMD_INLINE float Sqrt(float a)
+    {
+        return std::sqrt(a);
+    }
+    DVR_SIMD_INLINE std::int32_t ToInt(float a)
+    {
+        return static_cast<std::int32_t>(a);
+    }
+    DVR_SIMD_INLINE float ToFloat(std::int32_t a)
+    {
+        return static_cast<float>(a);
+    }
+    DVR_SIMD_INLINE float AsFloat(std::int32_t a)
+    {
+        float f;
+        std::memcpy(&f, &a, sizeof(f));
+        return f;
+    }
+    DVR_SIMD_INLINE std::int32_t ShiftRight(std::int32_t a, std::int32_t n)
+    {
+        const auto bits = static_cast<std::uint32_t>(a);
+        return static_cast<std::int32_t>(bits >> static_cast<std::uint32_t>(n & 31));
+    }
+    DVR_SIMD_INLINE std::int32_t LoadInt(ScalarPack, const std::int32_t *p)
+    {
+        return *p;
+    }
+    DVR_SIMD_INLINE void Store(std::int32_t *p, std::int32_t a)
+    {
+        *p = a;
+    }
+    DVR_SIMD_INLINE float Gather(const float *base, std::int32_t index, bool m)
+    {
+        return m ? base[index] : 0.0f;
+    }
+    DVR_SIMD_INLINE std::int32_t Gather(const std::uint32_t *base, std::int32_t index, bool m)
+    {
+        return m ? static_cast<std::int32_t>(base[index]) : 0;
+    }
+    DVR_SIMD_INLINE std::int32_t Gather(const std::uint8_t *base, std::int32_t index, bool m)
+    {
+        return m ? static_cast<std::int32_t>(base[index]) : 0;
+    }
+
+#if DVR_SIMD_X86
+    //------------------------------------------------------------------------------------------
+    // AVX2: 8 lanes
+    //------------------------------------------------------------------------------------------
+    // Default construction leaves the lanes uninitialized (trivial, so std::array of packs stays
+    // usable inside the targeted kernels), value-initialize with {} for zeros
+    struct Mask8
+    {
+        __m256 v;
+        Mask8() = default;
+        DVR_TARGET_AVX2 DVR_SIMD_INLINE explicit Mask8(__m256 m) : v(m)
+        {
+        }
+        DVR_TARGET_AVX2 DVR_SIMD_INLINE Mask8(bool b)
+            : v(b ? _mm256_castsi256_ps(_mm256_set1_epi32(-1)) : _mm256_setzero_ps())
+        {
+        }
+    };
+
+    struct Float8
+    {
+        __m256 v;
+        Float8() = default;
+        DVR_TARGET_AVX2 DVR_SIMD_INLINE explicit Float8(__m256 f) : v(f)
+        {
+        }
+        DVR_TARGET_AVX2 DVR_SIMD_INLINE Float8(float f) : v(_mm256_set1_ps(f))
+        {
+        }
+    };
+
+    struct Int8
+    {
+        __m256i v;
+        Int8() = default;
+        DVR_TARGET_AVX2 DVR_SIMD_INLINE explicit Int8(__m256i i) : v(i)
+        {
+        }
+        DVR_TARGET_AVX2 DVR_SIMD_INLINE Int8(std::int32_t i) : v(_mm256_set1_epi32(i))
+        {
+        }
+    };
+
+    struct Avx2Pack
+    {
+        static constexpr int kWidth{8};
+        static constexpr int kTileWidth{4};
+        using Float = Float8;
+        using Int = Int8;
+        using Mask = Mask8;
+    };
+
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Mask8 operator&(Mask8 a, Mask8 b)
+    {
+        return Mask8(_mm256_and_ps(a.v, b.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Mask8 operator|(Mask8 a, Mask8 b)
+    {
+        return Mask8(_mm256_or_ps(a.v, b.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Mask8 operator!(Mask8 a)
+    {
+        return Mask8(_mm256_xor_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(-1))));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE bool Any(Mask8 m)
+    {
+        return _mm256_movemask_ps(m.v) != 0;
+    }
+
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Float8 operator+(Float8 a, Float8 b)
+    {
+        return Float8(_mm256_add_ps(a.v, b.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Float8 operator-(Float8 a, Float8 b)
+    {
+        return Float8(_mm256_sub_ps(a.v, b.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Float8 operator*(Float8 a, Float8 b)
+    {
+        return Float8(_mm256_mul_ps(a.v, b.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Float8 operator/(Float8 a, Float8 b)
+    {
+        return Float8(_mm256_div_ps(a.v, b.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Float8 operator-(Float8 a)
+    {
+        return Float8(_mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Mask8 operator<(Float8 a, Float8 b)
+    {
+        return Mask8(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Mask8 operator>(Float8 a, Float8 b)
+    {
+        return Mask8(_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Mask8 operator>=(Float8 a, Float8 b)
+    {
+        return Mask8(_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Mask8 operator!=(Float8 a, Float8 b)
+    {
+        return Mask8(_mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Float8 Select(Mask8 m, Float8 a, Float8 b)
+    {
+        return Float8(_mm256_blendv_ps(b.v, a.v, m.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Float8 Min(Float8 a, Float8 b)
+    {
+        return Float8(_mm256_min_ps(a.v, b.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Float8 Max(Float8 a, Float8 b)
+    {
+        return Float8(_mm256_max_ps(a.v, b.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Float8 Floor(Float8 a)
+    {
+        return Float8(_mm256_floor_ps(a.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Float8 Ceil(Float8 a)
+    {
+        return Float8(_mm256_ceil_ps(a.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Float8 Sqrt(Float8 a)
+    {
+        return Float8(_mm256_sqrt_ps(a.v));
+    }
+
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Int8 operator+(Int8 a, Int8 b)
+    {
+        return Int8(_mm256_add_epi32(a.v, b.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Int8 operator-(Int8 a, Int8 b)
+    {
+        return Int8(_mm256_sub_epi32(a.v, b.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Int8 operator*(Int8 a, Int8 b)
+    {
+        return Int8(_mm256_mullo_epi32(a.v, b.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Int8 operator&(Int8 a, Int8 b)
+    {
+        return Int8(_mm256_and_si256(a.v, b.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Int8 operator|(Int8 a, Int8 b)
+    {
+        return Int8(_mm256_or_si256(a.v, b.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Int8 operator<<(Int8 a, int n)
+    {
+        return Int8(_mm256_sll_epi32(a.v, _mm_cvtsi32_si128(n)));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Int8 operator>>(Int8 a, int n)
+    {
+        return Int8(_mm256_srl_epi32(a.v, _mm_cvtsi32_si128(n)));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Mask8 operator<(Int8 a, Int8 b)
+    {
+        return Mask8(_mm256_castsi256_ps(_mm256_cmpgt_epi32(b.v, a.v)));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Mask8 operator>=(Int8 a, Int8 b)
+    {
+        return !(a < b);
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Mask8 operator!=(Int8 a, Int8 b)
+    {
+        return !Mask8(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a.v, b.v)));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Int8 Select(Mask8 m, Int8 a, Int8 b)
+    {
+        const __m256 blended =
+            _mm256_blendv_ps(_mm256_castsi256_ps(b.v), _mm256_castsi256_ps(a.v), m.v);
+        return Int8(_mm256_castps_si256(blended));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Int8 Min(Int8 a, Int8 b)
+    {
+        return Int8(_mm256_min_epi32(a.v, b.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Int8 Max(Int8 a, Int8 b)
+    {
+        return Int8(_mm256_max_epi32(a.v, b.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Int8 ToInt(Float8 a)
+    {
+        return Int8(_mm256_cvttps_epi32(a.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Float8 ToFloat(Int8 a)
+    {
+        return Float8(_mm256_cvtepi32_ps(a.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Float8 AsFloat(Int8 a)
+    {
+        return Float8(_mm256_castsi256_ps(a.v));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Int8 ShiftRight(Int8 a, Int8 n)
+    {
+        return Int8(_mm256_srlv_epi32(a.v, _mm256_and_si256(n.v, _mm256_set1_epi32(31))));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Int8 LoadInt(Avx2Pack, const std::int32_t *p)
+    {
+        return Int8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE void Store(std::int32_t *p, Int8 a)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), a.v);
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Float8 Gather(const float *base, Int8 index, Mask8 m)
+    {
+        return Float8(_mm256_mask_i32gather_ps(_mm256_setzero_ps(), base, index.v, m.v, 4));
+    }
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Int8 Gather(const std::uint32_t *base, Int8 index, Mask8 m)
+    {
+        const auto *words = reinterpret_cast<const int *>(base);
+        const __m256i active = _mm256_castps_si256(m.v);
+        return Int8(_mm256_mask_i32gather_epi32(_mm256_setzero_si256(), words, index.v, active, 4));
+    }
+    // There is no byte gather, and a dword gather could read past the end of the buffer
+    DVR_TARGET_AVX2 DVR_SIMD_INLINE Int8 Gather(const std::uint8_t *base, Int8 index, Mask8 m)
+    {
+        alignas(32) std::int32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), index.v);
+        const int active = _mm256_movemask_ps(m.v);
+        for (int i = 0; i < 8; ++i)
+        {
+            lanes[i] = (active & (1 << i)) != 0 ? base[lanes[i]] : 0;
+        }
+        return Int8(_mm256_load_si256(reinterpret_cast<const __m256i *>(lanes)));
+    }
+
+    //------------------------------------------------------------------------------------------
+    // AVX-512: 16 lanes
+    //------------------------------------------------------------------------------------------
+#if defined(__GNUC__) && !defined(__clang__)
+// Without optimization GCC expands some of these intrinsics to macros that cast masks to short
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#endif
+    struct Mask16
+    {
+        __mmask16 v;
+        Mask16() = default;
+        DVR_TARGET_AVX512 DVR_SIMD_INLINE explicit Mask16(__mmask16 m) : v(m)
+        {
+        }
+        DVR_TARGET_AVX512 DVR_SIMD_INLINE Mask16(bool b) : v(static_cast<__mmask16>(b ? 0xFFFF : 0))
+        {
+        }
+    };
+
+    struct Float16
+    {
+        __m512 v;
+        Float16() = default;
+        DVR_TARGET_AVX512 DVR_SIMD_INLINE explicit Float16(__m512 f) : v(f)
+        {
+        }
+        DVR_TARGET_AVX512 DVR_SIMD_INLINE Float16(float f) : v(_mm512_set1_ps(f))
+        {
+        }
+    };
+
+    struct Int16
+    {
+        __m512i v;
+        Int16() = default;
+        DVR_TARGET_AVX512 DVR_SIMD_INLINE explicit Int16(__m512i i) : v(i)
+        {
+        }
+        DVR_TARGET_AVX512 DVR_SIMD_INLINE Int16(std::int32_t i) : v(_mm512_set1_epi32(i))
+        {
+        }
+    };
+
+    struct Avx512Pack
+    {
+        static constexpr int kWidth{16};
+        static constexpr int kTileWidth{4};
+        using Float = Float16;
+        using Int = Int16;
+        using Mask = Mask16;
+    };
+
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Mask16 operator&(Mask16 a, Mask16 b)
+    {
+        return Mask16(static_cast<__mmask16>(a.v & b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Mask16 operator|(Mask16 a, Mask16 b)
+    {
+        return Mask16(static_cast<__mmask16>(a.v | b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Mask16 operator!(Mask16 a)
+    {
+        return Mask16(static_cast<__mmask16>(~a.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE bool Any(Mask16 m)
+    {
+        return m.v != 0;
+    }
+
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Float16 operator+(Float16 a, Float16 b)
+    {
+        return Float16(_mm512_add_ps(a.v, b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Float16 operator-(Float16 a, Float16 b)
+    {
+        return Float16(_mm512_sub_ps(a.v, b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Float16 operator*(Float16 a, Float16 b)
+    {
+        return Float16(_mm512_mul_ps(a.v, b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Float16 operator/(Float16 a, Float16 b)
+    {
+        return Float16(_mm512_div_ps(a.v, b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Float16 operator-(Float16 a)
+    {
+        const __m512i sign = _mm512_set1_epi32(INT32_MIN);
+        return Float16(_mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a.v), sign)));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Mask16 operator<(Float16 a, Float16 b)
+    {
+        return Mask16(_mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Mask16 operator>(Float16 a, Float16 b)
+    {
+        return Mask16(_mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Mask16 operator>=(Float16 a, Float16 b)
+    {
+        return Mask16(_mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Mask16 operator!=(Float16 a, Float16 b)
+    {
+        return Mask16(_mm512_cmp_ps_mask(a.v, b.v, _CMP_NEQ_UQ));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Float16 Select(Mask16 m, Float16 a, Float16 b)
+    {
+        return Float16(_mm512_mask_blend_ps(m.v, b.v, a.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Float16 Min(Float16 a, Float16 b)
+    {
+        return Float16(_mm512_min_ps(a.v, b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Float16 Max(Float16 a, Float16 b)
+    {
+        return Float16(_mm512_max_ps(a.v, b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Float16 Floor(Float16 a)
+    {
+        return Float16(_mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Float16 Ceil(Float16 a)
+    {
+        return Float16(_mm512_roundscale_ps(a.v, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Float16 Sqrt(Float16 a)
+    {
+        return Float16(_mm512_sqrt_ps(a.v));
+    }
+
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Int16 operator+(Int16 a, Int16 b)
+    {
+        return Int16(_mm512_add_epi32(a.v, b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Int16 operator-(Int16 a, Int16 b)
+    {
+        return Int16(_mm512_sub_epi32(a.v, b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Int16 operator*(Int16 a, Int16 b)
+    {
+        return Int16(_mm512_mullo_epi32(a.v, b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Int16 operator&(Int16 a, Int16 b)
+    {
+        return Int16(_mm512_and_si512(a.v, b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Int16 operator|(Int16 a, Int16 b)
+    {
+        return Int16(_mm512_or_si512(a.v, b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Int16 operator<<(Int16 a, int n)
+    {
+        return Int16(_mm512_sll_epi32(a.v, _mm_cvtsi32_si128(n)));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Int16 operator>>(Int16 a, int n)
+    {
+        return Int16(_mm512_srl_epi32(a.v, _mm_cvtsi32_si128(n)));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Mask16 operator<(Int16 a, Int16 b)
+    {
+        return Mask16(_mm512_cmplt_epi32_mask(a.v, b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Mask16 operator>=(Int16 a, Int16 b)
+    {
+        return Mask16(_mm512_cmpge_epi32_mask(a.v, b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Mask16 operator!=(Int16 a, Int16 b)
+    {
+        return Mask16(_mm512_cmpneq_epi32_mask(a.v, b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Int16 Select(Mask16 m, Int16 a, Int16 b)
+    {
+        return Int16(_mm512_mask_blend_epi32(m.v, b.v, a.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Int16 Min(Int16 a, Int16 b)
+    {
+        return Int16(_mm512_min_epi32(a.v, b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Int16 Max(Int16 a, Int16 b)
+    {
+        return Int16(_mm512_max_epi32(a.v, b.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Int16 ToInt(Float16 a)
+    {
+        return Int16(_mm512_cvttps_epi32(a.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Float16 ToFloat(Int16 a)
+    {
+        return Float16(_mm512_cvtepi32_ps(a.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Float16 AsFloat(Int16 a)
+    {
+        return Float16(_mm512_castsi512_ps(a.v));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Int16 ShiftRight(Int16 a, Int16 n)
+    {
+        return Int16(_mm512_srlv_epi32(a.v, _mm512_and_si512(n.v, _mm512_set1_epi32(31))));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Int16 LoadInt(Avx512Pack, const std::int32_t *p)
+    {
+        return Int16(_mm512_loadu_si512(p));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE void Store(std::int32_t *p, Int16 a)
+    {
+        _mm512_storeu_si512(p, a.v);
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Float16 Gather(const float *base, Int16 index, Mask16 m)
+    {
+        return Float16(_mm512_mask_i32gather_ps(_mm512_setzero_ps(), m.v, index.v, base, 4));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Int16 Gather(const std::uint32_t *base, Int16 index, Mask16 m)
+    {
+        return Int16(_mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m.v, index.v, base, 4));
+    }
+    DVR_TARGET_AVX512 DVR_SIMD_INLINE Int16 Gather(const std::uint8_t *base, Int16 index, Mask16 m)
+    {
+        alignas(64) std::int32_t lanes[16];
+        _mm512_store_si512(lanes, index.v);
+        for (int i = 0; i < 16; ++i)
+        {
+            lanes[i] = (m.v & (1U << i)) != 0 ? base[lanes[i]] : 0;
+        }
+        return Int16(_mm512_load_si512(lanes));
+    }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif // DVR_SIMD_X86
+} // namespace Simd
+
+#endif // SIMD_H
@@ -0,0 +1,154 @@
+#pragma once
+#ifndef BRICK_CACHE_H
+#define BRICK_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace VolumeUtils
+{
+    // Which brick sits in each of a fixed number of slots (of a texture atlas, say). Bricks are
+    // evicted least recently used first, but never one used during the current frame.
+    class BrickCache
+    {
+    public:
+        static constexpr int kNoSlot{-1};
+
+        // Slot of a brick and whether it has to be filled because the brick was not resident
+        struct Lookup
+        {
+            int slot{kNoSlot};
+            bool load{false};
+        };
+
+        explicit BrickCache(std::size_t slotCount = 0) : slots(slotCount)
+        {
+            for (std::size_t slot = 0; slot < slotCount; ++slot)
+            {
+                order.push_back(static_cast<int>(slot));
+                slots[slot].position = std::prev(order.end());
+            }
+        }
+
+        // Slots hold iterators into order: a copy would point back into the original's list,
+        // moving the list keeps them valid
+        BrickCache(const BrickCache &) = delete;
+        BrickCache &operator=(const BrickCache &) = delete;
+        BrickCache(BrickCache &&) = default;
+        BrickCache &operator=(BrickCache &&) = default;
+        ~BrickCache() = default;
+
+        // Slot of a resident brick, now the most recently used, or kNoSlot
+        int Touch(std::size_t brick, std::uint64_t frame)
+        {
+            const auto found = resident.find(brick);
+            if (found == resident.end())
+            {
+                return kNoSlot;
+            }
+            Use(found->second, frame);
+            ++hits;
+            return found->second;
+        }
+
+        // Slot of a brick, taking over the least recently used slot when it is not resident.
+        // kNoSlot if every slot already holds a brick of this frame.
+        Lookup Acquire(std::size_t brick, std::uint64_t frame)
+        {
+            if (const int slot = Touch(brick, frame); slot != kNoSlot)
+            {
+                return {slot, false};
+            }
+            if (order.empty())
+            {
+                return {};
+            }
+            const int slot = order.back();
+            Slot &oldest = slots[static_cast<std::size_t>(slot)];
+            if (oldest.filled && oldest.lastUsed == frame)
+            {
+                return {};
+            }
+            if (oldest.filled)
+            {
+                resident.erase(oldest.brick);
+                ++evictions;
+            }
+            oldest.brick = brick;
+            oldest.filled = true;
+            resident[brick] = slot;
+            Use(slot, frame);
+            ++misses;
+            return {slot, true};
+        }
+
+        [[nodiscard]] bool Contains(std::size_t brick) const
+        {
+            return resident.count(brick) != 0;
+        }
+
+        // Forget every brick, e.g. when the volume behind them changes
+        void Clear()
+        {
+            for (Slot &slot : slots)
+            {
+                slot.filled = false;
+            }
+            resident.clear();
+        }
+
+        [[nodiscard]] std::size_t SlotCount() const
+        {
+            return slots.size();
+        }
+
+        [[nodiscard]] std::size_t Size() const
+        {
+            return resident.size();
+        }
+
+        [[nodiscard]] std::size_t Hits() const
+        {
+            return hits;
+        }
+
+        [[nodiscard]] std::size_t Misses() const
+        {
+            return misses;
+        }
+
+        [[nodiscard]] std::size_t Evictions() const
+        {
+            return evictions;
+        }
+
+    private:
+        struct Slot
+        {
+            std::size_t brick{0};
+            std::uint64_t lastUsed{0};
+            bool filled{false};
+            std::list<int>::iterator position{};
+        };
+
+        void Use(int slot, std::uint64_t frame)
+        {
+            Slot &used = slots[static_cast<std::size_t>(slot)];
+            used.lastUsed = frame;
+            order.splice(order.begin(), order, used.position);
+        }
+
+        std::vector<Slot> slots;
+        std::list<int> order{}; // slots, most recently used first
+        std::unordered_map<std::size_t, int> resident{};
+        std::size_t hits{0};
+        std::size_t misses{0};
+        std::size_t evictions{0};
+    };
+} // namespace VolumeUtils
+
+#endif // BRICK_CACHE_H
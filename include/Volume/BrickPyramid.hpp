@@ -0,0 +1,383 @@
+#pragma once
+#ifndef BRICK_PYRAMID_H
+#define BRICK_PYRAMID_H
+
+#include "Scheduler/ParallelFor.hpp"
+#include "Volume/GridTraversal.hpp"
+#include "Volume/Volume.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace VolumeUtils
+{
+    // Brick `index` of pyramid level `level`, level 0 being the full resolution
+    struct BrickKey
+    {
+        int level{0};
+        Int3 index{};
+    };
+
+    // Multi-resolution pyramid of a volume cut into cubic bricks, for rendering volumes that do not
+    // fit in video memory. Level l + 1 halves level l along every axis (2x2x2 averages, an odd last
+    // voxel is averaged with itself) until a single brick covers it. Level 0 is the source volume
+    // itself, which has to outlive the pyramid, so the coarser levels cost about a seventh more.
+    template <typename T>
+    class BrickPyramid
+    {
+    public:
+        // Voxels copied from the neighbours on every side of a brick, so that filtering inside a
+        // brick never needs the next one
+        static constexpr int kApron{1};
+
+        // Lowest and highest finest-level value a brick (apron included) covers
+        struct Range
+        {
+            T min{};
+            T max{};
+        };
+
+        BrickPyramid() = default;
+        BrickPyramid(const BrickPyramid &) = default;
+        BrickPyramid(BrickPyramid &&) noexcept = default;
+        BrickPyramid &operator=(const BrickPyramid &) = default;
+        BrickPyramid &operator=(BrickPyramid &&) noexcept = default;
+        ~BrickPyramid() = default;
+
+        // Build the coarser levels and the brick ranges on every core (threadCount 0) or on
+        // threadCount threads
+        BrickPyramid(const Volume<T> &volume, int newBrickSize, int threadCount = 0)
+            : source(&volume), brickSize(std::max(newBrickSize, 1))
+        {
+            Int3 dims = volume.Dimensions();
+            while (!volume.Empty())
+            {
+                const Int3 counts = CountBricks(dims);
+                firstBrick.push_back(brickTotal);
+                brickTotal += static_cast<std::size_t>(counts[0]) * static_cast<std::size_t>(counts[1]) *
+                              static_cast<std::size_t>(counts[2]);
+                levelDims.push_back(dims);
+                if (counts[0] * counts[1] * counts[2] == 1)
+                {
+                    break;
+                }
+                dims = {(dims[0] + 1) / 2, (dims[1] + 1) / 2, (dims[2] + 1) / 2};
+            }
+            for (std::size_t level = 1; level < levelDims.size(); ++level)
+            {
+                coarse.push_back(Downsample(Level(static_cast<int>(level) - 1), threadCount));
+            }
+            BuildRanges(threadCount);
+        }
+
+        [[nodiscard]] bool Empty() const
+        {
+            return levelDims.empty();
+        }
+
+        // Voxels along a brick edge, apron excluded
+        [[nodiscard]] int BrickSize() const
+        {
+            return brickSize;
+        }
+
+        // Voxels along the edge of a copied brick, apron included
+        [[nodiscard]] int StoredSize() const
+        {
+            return brickSize + 2 * kApron;
+        }
+
+        [[nodiscard]] int LevelCount() const
+        {
+            return static_cast<int>(levelDims.size());
+        }
+
+        [[nodiscard]] const Volume<T> &Level(int level) const
+        {
+            return level == 0 ? *source : coarse[static_cast<std::size_t>(level - 1)];
+        }
+
+        [[nodiscard]] Int3 BrickCounts(int level) const
+        {
+            return CountBricks(levelDims[static_cast<std::size_t>(level)]);
+        }
+
+        // Bricks over every level
+        [[nodiscard]] std::size_t BrickCount() const
+        {
+            return brickTotal;
+        }
+
+        // Dense id of a brick over every level, finest level first
+        [[nodiscard]] std::size_t BrickId(const BrickKey &key) const
+        {
+            const Int3 counts = BrickCounts(key.level);
+            return firstBrick[static_cast<std::size_t>(key.level)] +
+                   static_cast<std::size_t>(key.index[0]) +
+                   static_cast<std::size_t>(counts[0]) *
+                       (static_cast<std::size_t>(key.index[1]) +
+                        static_cast<std::size_t>(counts[1]) * static_cast<std::size_t>(key.index[2]));
+        }
+
+        [[nodiscard]] const Range &BrickRange(const BrickKey &key) const
+        {
+            return ranges[BrickId(key)];
+        }
+
+        // Copy a brick and its apron, StoredSize()^3 voxels with x fastest. Voxels past the edge
+        // of the level repeat the edge.
+        void CopyBrick(const BrickKey &key, T *out) const
+        {
+            const Volume<T> &level = Level(key.level);
+            const Int3 dims = level.Dimensions();
+            const int stored = StoredSize();
+            for (int z = 0; z < stored; ++z)
+            {
+                const int sz = std::clamp(key.index[2] * brickSize - kApron + z, 0, dims[2] - 1);
+                for (int y = 0; y < stored; ++y)
+                {
+                    const int sy = std::clamp(key.index[1] * brickSize - kApron + y, 0, dims[1] - 1);
+                    for (int x = 0; x < stored; ++x)
+                    {
+                        const int sx = std::clamp(key.index[0] * brickSize - kApron + x, 0, dims[0] - 1);
+                        *out++ = level(sx, sy, sz);
+                    }
+                }
+            }
+        }
+
+        // Bytes of the coarser levels, level 0 belongs to the source
+        [[nodiscard]] std::size_t SizeInBytes() const
+        {
+            std::size_t bytes = 0;
+            for (const Volume<T> &level : coarse)
+            {
+                bytes += level.SizeInBytes();
+            }
+            return bytes;
+        }
+
+    private:
+        [[nodiscard]] Int3 CountBricks(const Int3 &dims) const
+        {
+            return {(dims[0] + brickSize - 1) / brickSize,
+                    (dims[1] + brickSize - 1) / brickSize,
+                    (dims[2] + brickSize - 1) / brickSize};
+        }
+
+        static Volume<T> Downsample(const Volume<T> &fine, int threadCount)
+        {
+            const Int3 dims = fine.Dimensions();
+            const std::array<float, 3> &spacing = fine.Spacing();
+            Volume<T> half((dims[0] + 1) / 2,
+                           (dims[1] + 1) / 2,
+                           (dims[2] + 1) / 2,
+                           Layout::Linear,
+                           {spacing[0] * 2.0f, spacing[1] * 2.0f, spacing[2] * 2.0f});
+            Scheduler::ParallelFor(half.Depth(), threadCount, [&](int z) {
+                for (int y = 0; y < half.Height(); ++y)
+                {
+                    for (int x = 0; x < half.Width(); ++x)
+                    {
+                        double sum = 0.0;
+                        for (int corner = 0; corner < 8; ++corner)
+                        {
+                            sum += static_cast<double>(fine(std::min(2 * x + (corner & 1), dims[0] - 1),
+                                                            std::min(2 * y + (corner >> 1 & 1), dims[1] - 1),
+                                                            std::min(2 * z + (corner >> 2), dims[2] - 1)));
+                        }
+                        half(x, y, z) = static_cast<T>(std::lround(sum / 8.0));
+                    }
+                }
+            });
+            return half;
+        }
+
+        // Level 0 ranges from the voxels, every coarser brick the union of the (up to 8) bricks
+        // under it, so a brick is never judged by averages that hide a bright voxel
+        void BuildRanges(int threadCount)
+        {
+            ranges.assign(brickTotal, Range{});
+            if (Empty())
+            {
+                return;
+            }
+            const Int3 counts = BrickCounts(0);
+            Scheduler::ParallelFor(counts[0] * counts[1] * counts[2], threadCount, [&](int brick) {
+                const Int3 index{brick % counts[0], brick / counts[0] % counts[1], brick / (counts[0] * counts[1])};
+                const Int3 dims = levelDims[0];
+                Range range{(*source)(0, 0, 0), (*source)(0, 0, 0)};
+                bool first = true;
+                for (int z = std::max(index[2] * brickSize - kApron, 0);
+                     z < std::min((index[2] + 1) * brickSize + kApron, dims[2]);
+                     ++z)
+                {
+                    for (int y = std::max(index[1] * brickSize - kApron, 0);
+                         y < std::min((index[1] + 1) * brickSize + kApron, dims[1]);
+                         ++y)
+                    {
+                        for (int x = std::max(index[0] * brickSize - kApron, 0);
+                             x < std::min((index[0] + 1) * brickSize + kApron, dims[0]);
+                             ++x)
+                        {
+                            const T value = (*source)(x, y, z);
+                            range.min = first ? value : std::min(range.min, value);
+                            range.max = first ? value : std::max(range.max, value);
+                            first = false;
+                        }
+                    }
+                }
+                ranges[BrickId({0, index})] = range;
+            });
+
+            for (int level = 1; level < LevelCount(); ++level)
+            {
+                const Int3 parents = BrickCounts(level);
+                const Int3 children = BrickCounts(level - 1);
+                for (int z = 0; z < parents[2]; ++z)
+                {
+                    for (int y = 0; y < parents[1]; ++y)
+                    {
+                        for (int x = 0; x < parents[0]; ++x)
+                        {
+                            Range range = ranges[BrickId({level - 1, {2 * x, 2 * y, 2 * z}})];
+                            for (int corner = 1; corner < 8; ++corner)
+                            {
+                                const Int3 child{std::min(2 * x + (corner & 1), children[0] - 1),
+                                                 std::min(2 * y + (corner >> 1 & 1), children[1] - 1),
+                                                 std::min(2 * z + (corner >> 2), children[2] - 1)};
+                                const Range &other = ranges[BrickId({level - 1, child})];
+                                range.min = std::min(range.min, other.min);
+                                range.max = std::max(range.max, other.max);
+                            }
+                            ranges[BrickId({level, {x, y, z}})] = range;
+                        }
+                    }
+                }
+            }
+        }
+
+        const Volume<T> *source{nullptr};
+        int brickSize{32};
+        std::vector<Volume<T>> coarse{};
+        std::vector<Int3> levelDims{};
+        std::vector<std::size_t> firstBrick{};
+        std::size_t brickTotal{0};
+        std::vector<Range> ranges{};
+    };
+
+    // Where a pyramid is seen from, in world units: the volume box starts at boxMin and a finest
+    // voxel spans voxelSize. A pixel covers pixelSize + pixelSlope * distance, which is a constant
+    // for orthographic views and grows with the distance for perspective ones.
+    struct LodView
+    {
+        Vec3 eye{};
+        Vec3 boxMin{};
+        Vec3 voxelSize{1.0f, 1.0f, 1.0f};
+        float pixelSize{0.0f};
+        float pixelSlope{0.0f};
+        float detail{1.0f}; // pixels a voxel may cover before its brick is refined
+    };
+
+    // Voxels of a brick per pixel at its nearest point to the eye, above 1 when it is magnified
+    template <typename T>
+    float BrickFootprint(const BrickPyramid<T> &pyramid, const LodView &view, const BrickKey &key)
+    {
+        const float scale = std::ldexp(1.0f, key.level);
+        float distanceSquared = 0.0f;
+        for (std::size_t axis = 0; axis < 3; ++axis)
+        {
+            const float extent = static_cast<float>(pyramid.BrickSize()) * scale * view.voxelSize[axis];
+            const float low = view.boxMin[axis] + static_cast<float>(key.index[axis]) * extent;
+            const float gap = std::max({low - view.eye[axis], view.eye[axis] - (low + extent), 0.0f});
+            distanceSquared += gap * gap;
+        }
+        const float voxel = scale * std::max({view.voxelSize[0], view.voxelSize[1], view.voxelSize[2]});
+        const float pixel = view.pixelSize + view.pixelSlope * std::sqrt(distanceSquared);
+        return voxel / std::max(pixel * view.detail, 1e-12f);
+    }
+
+    // Bricks to render from, covering the visible part of the volume once: starting from the
+    // coarsest level, the brick with the most magnified voxels is split into its children while
+    // its voxels cover more than a pixel and the selection stays within `budget` bricks. Bricks
+    // whose range visible(range) rejects are dropped along with everything under them.
+    template <typename T, typename Visible>
+    std::vector<BrickKey> SelectBricks(const BrickPyramid<T> &pyramid,
+                                       const LodView &view,
+                                       std::size_t budget,
+                                       const Visible &visible)
+    {
+        std::vector<BrickKey> selected;
+        if (pyramid.Empty())
+        {
+            return selected;
+        }
+        using Candidate = std::pair<float, BrickKey>;
+        const auto smaller = [](const Candidate &a, const Candidate &b) { return a.first < b.first; };
+        std::priority_queue<Candidate, std::vector<Candidate>, decltype(smaller)> open(smaller);
+        const auto consider = [&](const BrickKey &key) {
+            if (visible(pyramid.BrickRange(key)))
+            {
+                open.emplace(BrickFootprint(pyramid, view, key), key);
+            }
+        };
+
+        const int top = pyramid.LevelCount() - 1;
+        const Int3 topCounts = pyramid.BrickCounts(top);
+        for (int z = 0; z < topCounts[2]; ++z)
+        {
+            for (int y = 0; y < topCounts[1]; ++y)
+            {
+                for (int x = 0; x < topCounts[0]; ++x)
+                {
+                    consider({top, {x, y, z}});
+                }
+            }
+        }
+
+        std::vector<BrickKey> children;
+        while (!open.empty())
+        {
+            const auto [footprint, key] = open.top();
+            open.pop();
+            const bool refine = footprint > 1.0f && key.level > 0;
+            children.clear();
+            if (refine)
+            {
+                const Int3 counts = pyramid.BrickCounts(key.level - 1);
+                for (int corner = 0; corner < 8; ++corner)
+                {
+                    const BrickKey child{key.level - 1,
+                                         {2 * key.index[0] + (corner & 1),
+                                          2 * key.index[1] + (corner >> 1 & 1),
+                                          2 * key.index[2] + (corner >> 2)}};
+                    if (child.index[0] < counts[0] && child.index[1] < counts[1] &&
+                        child.index[2] < counts[2] && visible(pyramid.BrickRange(child)))
+                    {
+                        children.push_back(child);
+                    }
+                }
+            }
+            // the children replace their parent, the bricks still open count against the budget;
+            // a range can pass as a whole while none of its parts does
+            if (refine && (children.empty() ||
+                           selected.size() + open.size() + children.size() <= budget))
+            {
+                for (const BrickKey &child : children)
+                {
+                    open.emplace(BrickFootprint(pyramid, view, child), child);
+                }
+                continue;
+            }
+            selected.push_back(key);
+        }
+        return selected;
+    }
+} // namespace VolumeUtils
+
+#endif // BRICK_PYRAMID_H
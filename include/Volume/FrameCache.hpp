@@ -0,0 +1,138 @@
+#pragma once
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <type_traits>
+#include <utility>
+
+namespace VolumeUtils
+{
+    // FNV-1a over the bytes of everything that changes the rendered image
+    class StateHash
+    {
+    public:
+        template <typename T>
+        StateHash &Add(const T &value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "hash plain values only");
+            unsigned char bytes[sizeof(T)];
+            std::memcpy(bytes, &value, sizeof(T));
+            for (const unsigned char byte : bytes)
+            {
+                hash = (hash ^ byte) * kPrime;
+            }
+            return *this;
+        }
+
+        [[nodiscard]] std::uint64_t Value() const
+        {
+            return hash;
+        }
+
+    private:
+        static constexpr std::uint64_t kOffsetBasis{14695981039346656037ULL};
+        static constexpr std::uint64_t kPrime{1099511628211ULL};
+
+        std::uint64_t hash{kOffsetBasis};
+    };
+
+    // Least recently used cache of finished frames, keyed on the render state hash. Frame is
+    // whatever holds a frame (pixels, a GPU buffer id); when the cache is full, inserting reuses
+    // the storage of the least recently used frame instead of allocating a new one.
+    template <typename Frame>
+    class FrameCache
+    {
+    public:
+        explicit FrameCache(std::size_t capacity = 8) : maxFrames(capacity == 0 ? 1 : capacity)
+        {
+        }
+
+        // Cached frame of this state or nullptr, a hit makes it the most recently used
+        Frame *Find(std::uint64_t key)
+        {
+            for (auto it = entries.begin(); it != entries.end(); ++it)
+            {
+                if (it->first == key)
+                {
+                    entries.splice(entries.begin(), entries, it);
+                    ++hits;
+                    return &entries.front().second;
+                }
+            }
+            ++misses;
+            return nullptr;
+        }
+
+        // Slot for the frame of this state, to be filled by the caller
+        Frame &Insert(std::uint64_t key)
+        {
+            for (auto it = entries.begin(); it != entries.end(); ++it)
+            {
+                if (it->first == key)
+                {
+                    entries.splice(entries.begin(), entries, it);
+                    return entries.front().second;
+                }
+            }
+            if (entries.size() < maxFrames)
+            {
+                entries.emplace_front(key, Frame{});
+            }
+            else
+            {
+                entries.splice(entries.begin(), entries, std::prev(entries.end()));
+                entries.front().first = key;
+            }
+            return entries.front().second;
+        }
+
+        // Visit every stored frame, e.g. to release GPU buffers
+        template <typename Function>
+        void ForEachFrame(Function function)
+        {
+            for (auto &entry : entries)
+            {
+                function(entry.second);
+            }
+        }
+
+        // Forget every frame, e.g. once they no longer match the image size; release them first
+        void Clear()
+        {
+            entries.clear();
+        }
+
+        [[nodiscard]] std::size_t Size() const
+        {
+            return entries.size();
+        }
+
+        [[nodiscard]] std::size_t Capacity() const
+        {
+            return maxFrames;
+        }
+
+        [[nodiscard]] std::size_t Hits() const
+        {
+            return hits;
+        }
+
+        [[nodiscard]] std::size_t Misses() const
+        {
+            return misses;
+        }
+
+    private:
+        std::size_t maxFrames;
+        std::list<std::pair<std::uint64_t, Frame>> entries{};
+        std::size_t hits{0};
+        std::size_t misses{0};
+    };
+} // namespace VolumeUtils
+
+#endif // FRAME_CACHE_H
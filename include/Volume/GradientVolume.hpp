@@ -0,0 +1,206 @@
+#pragma once
+#ifndef GRADIENT_VOLUME_H
+#define GRADIENT_VOLUME_H
+
+#include "Scheduler/ParallelFor.hpp"
+#include "Volume/GridTraversal.hpp"
+#include "Volume/Volume.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace VolumeUtils
+{
+    // Gradient of one voxel in 4 bytes (an RGBA8 texel): its direction on an octahedral map, both
+    // coordinates mapped from [-1, 1] to [0, 255], and its magnitude relative to the largest one
+    struct PackedGradient
+    {
+        std::uint8_t u{128};
+        std::uint8_t v{128};
+        std::uint8_t magnitude{0};
+        std::uint8_t unused{0};
+    };
+
+    // Unit vector to a point of the [-1, 1]^2 octahedral map, the lower hemisphere folded outwards
+    inline std::array<float, 2> EncodeOctahedral(const Vec3 &n)
+    {
+        const float l1 = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+        float u = l1 > 0.0f ? n[0] / l1 : 0.0f;
+        float v = l1 > 0.0f ? n[1] / l1 : 0.0f;
+        if (n[2] < 0.0f)
+        {
+            const float foldedU = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+            const float foldedV = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+            u = foldedU;
+            v = foldedV;
+        }
+        return {u, v};
+    }
+
+    inline Vec3 DecodeOctahedral(float u, float v)
+    {
+        Vec3 n{u, v, 1.0f - std::abs(u) - std::abs(v)};
+        const float fold = std::max(-n[2], 0.0f);
+        n[0] += n[0] >= 0.0f ? -fold : fold;
+        n[1] += n[1] >= 0.0f ? -fold : fold;
+        const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        return {n[0] / length, n[1] / length, n[2] / length};
+    }
+
+    // Gradients of a volume, same dimensions and layout. Magnitudes are value change per edge of
+    // the finest voxel axis, so anisotropic voxels get physically oriented normals.
+    struct GradientVolume
+    {
+        Volume<PackedGradient> gradients{};
+        float maxMagnitude{0.0f}; // magnitude of a packed 255
+
+        [[nodiscard]] bool Empty() const
+        {
+            return gradients.Empty();
+        }
+
+        [[nodiscard]] Vec3 Normal(int x, int y, int z) const
+        {
+            const PackedGradient &packed = gradients(x, y, z);
+            return DecodeOctahedral(static_cast<float>(packed.u) / 127.5f - 1.0f,
+                                    static_cast<float>(packed.v) / 127.5f - 1.0f);
+        }
+
+        [[nodiscard]] float Magnitude(int x, int y, int z) const
+        {
+            return static_cast<float>(gradients(x, y, z).magnitude) / 255.0f * maxMagnitude;
+        }
+    };
+
+    namespace GradientDetail
+    {
+        // Blocks a few bricks wide, small enough that the planes either side of a block stay in
+        // cache while its stencil runs
+        inline constexpr Int3 kBlockSize{32, 8, 8};
+
+        inline Int3 BlockCounts(const Int3 &dims)
+        {
+            Int3 counts{};
+            for (std::size_t axis = 0; axis < 3; ++axis)
+            {
+                counts[axis] = (dims[axis] + kBlockSize[axis] - 1) / kBlockSize[axis];
+            }
+            return counts;
+        }
+
+        // Call visit(x, y, z) for every voxel of block `block`
+        template <typename Visit>
+        void ForEachVoxel(const Int3 &dims, int block, const Visit &visit)
+        {
+            const Int3 counts = BlockCounts(dims);
+            const Int3 index{
+                block % counts[0], block / counts[0] % counts[1], block / (counts[0] * counts[1])};
+            Int3 begin{};
+            Int3 end{};
+            for (std::size_t axis = 0; axis < 3; ++axis)
+            {
+                begin[axis] = index[axis] * kBlockSize[axis];
+                end[axis] = std::min(begin[axis] + kBlockSize[axis], dims[axis]);
+            }
+            for (int z = begin[2]; z < end[2]; ++z)
+            {
+                for (int y = begin[1]; y < end[1]; ++y)
+                {
+                    for (int x = begin[0]; x < end[0]; ++x)
+                    {
+                        visit(x, y, z);
+                    }
+                }
+            }
+        }
+
+        // Central difference at a voxel, `step` is the voxel edge along each axis in finest edges.
+        // One-sided at the borders.
+        template <typename T>
+        Vec3 CentralDifference(const Volume<T> &volume, const Vec3 &step, int x, int y, int z)
+        {
+            const Int3 dims = volume.Dimensions();
+            const Int3 voxel{x, y, z};
+            Vec3 gradient{};
+            for (std::size_t axis = 0; axis < 3; ++axis)
+            {
+                Int3 low = voxel;
+                Int3 high = voxel;
+                low[axis] = std::max(voxel[axis] - 1, 0);
+                high[axis] = std::min(voxel[axis] + 1, dims[axis] - 1);
+                const int span = high[axis] - low[axis];
+                if (span == 0)
+                {
+                    continue;
+                }
+                const float delta = static_cast<float>(volume(high[0], high[1], high[2])) -
+                                    static_cast<float>(volume(low[0], low[1], low[2]));
+                gradient[axis] = delta / (static_cast<float>(span) * step[axis]);
+            }
+            return gradient;
+        }
+    } // namespace GradientDetail
+
+    // Central-difference gradients of every voxel, computed block by block on every core: one
+    // pass finds the largest magnitude, a second one packs. threadCount 0 uses every hardware
+    // thread.
+    template <typename T>
+    GradientVolume BuildGradientVolume(const Volume<T> &volume, int threadCount = 0)
+    {
+        using namespace GradientDetail;
+        const Int3 dims = volume.Dimensions();
+        const std::array<float, 3> &spacing = volume.Spacing();
+        const float finest = std::min({spacing[0], spacing[1], spacing[2]});
+        const Vec3 step{spacing[0] / finest, spacing[1] / finest, spacing[2] / finest};
+        const Int3 counts = BlockCounts(dims);
+        const int blockCount = counts[0] * counts[1] * counts[2];
+
+        GradientVolume result;
+        result.gradients.Resize(dims[0], dims[1], dims[2], volume.GetLayout());
+        result.gradients.SetSpacing(spacing);
+        if (volume.Empty())
+        {
+            return result;
+        }
+
+        std::vector<float> blockMax(static_cast<std::size_t>(blockCount), 0.0f);
+        Scheduler::ParallelFor(blockCount, threadCount, [&](int block) {
+            float largest = 0.0f;
+            ForEachVoxel(dims, block, [&](int x, int y, int z) {
+                const Vec3 g = CentralDifference(volume, step, x, y, z);
+                largest = std::max(largest, g[0] * g[0] + g[1] * g[1] + g[2] * g[2]);
+            });
+            blockMax[static_cast<std::size_t>(block)] = largest;
+        });
+        result.maxMagnitude = std::sqrt(*std::max_element(blockMax.begin(), blockMax.end()));
+        if (result.maxMagnitude <= 0.0f)
+        {
+            return result;
+        }
+
+        const float toByte = 255.0f / result.maxMagnitude;
+        Scheduler::ParallelFor(blockCount, threadCount, [&](int block) {
+            ForEachVoxel(dims, block, [&](int x, int y, int z) {
+                const Vec3 g = CentralDifference(volume, step, x, y, z);
+                const float magnitude = std::sqrt(g[0] * g[0] + g[1] * g[1] + g[2] * g[2]);
+                if (magnitude <= 0.0f)
+                {
+                    return;
+                }
+                const std::array<float, 2> map =
+                    EncodeOctahedral({g[0] / magnitude, g[1] / magnitude, g[2] / magnitude});
+                PackedGradient &packed = result.gradients(x, y, z);
+                packed.u = static_cast<std::uint8_t>(std::lround((map[0] + 1.0f) * 127.5f));
+                packed.v = static_cast<std::uint8_t>(std::lround((map[1] + 1.0f) * 127.5f));
+                packed.magnitude = static_cast<std::uint8_t>(std::lround(magnitude * toByte));
+            });
+        });
+        return result;
+    }
+} // namespace VolumeUtils
+
+#endif // GRADIENT_VOLUME_H
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef GRID_TRAVERSAL_H
+#define GRID_TRAVERSAL_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+namespace VolumeUtils
+{
+    using Vec3 = std::array<float, 3>;
+    using Int3 = std::array<int, 3>;
+
+    // Walk the cells of a regular grid pierced by a ray (Amanatides & Woo 3D DDA).
+    // Every cell in [lower, upper) crossed between tStart and tEnd is visited exactly once,
+    // in ray order, together with the [t0, t1] span of the ray inside it.
+    // visit(const Int3 &cell, float t0, float t1) returns false to stop the walk.
+    template <typename Visitor>
+    void TraverseGrid(const Vec3 &origin,
+                      const Vec3 &direction,
+                      float tStart,
+                      float tEnd,
+                      const Vec3 &gridMin,
+                      const Vec3 &cellSize,
+                      const Int3 &lower,
+                      const Int3 &upper,
+                      Visitor &&visit)
+    {
+        if (!(tStart < tEnd))
+        {
+            return;
+        }
+
+        Int3 cell{};
+        Int3 step{};
+        Vec3 tMax{};
+        Vec3 tDelta{};
+        for (std::size_t axis = 0; axis < 3; ++axis)
+        {
+            // The entry point can sit exactly on a face, clamp it back inside
+            const float entry = origin[axis] + direction[axis] * tStart;
+            const int index = static_cast<int>(std::floor((entry - gridMin[axis]) / cellSize[axis]));
+            cell[axis] = std::clamp(index, lower[axis], upper[axis] - 1);
+
+            if (direction[axis] > 0.0f)
+            {
+                step[axis] = 1;
+                tMax[axis] = (gridMin[axis] + static_cast<float>(cell[axis] + 1) * cellSize[axis] - origin[axis]) / direction[axis];
+                tDelta[axis] = cellSize[axis] / direction[axis];
+            }
+            else if (direction[axis] < 0.0f)
+            {
+                step[axis] = -1;
+                tMax[axis] = (gridMin[axis] + static_cast<float>(cell[axis]) * cellSize[axis] - origin[axis]) / direction[axis];
+                tDelta[axis] = -cellSize[axis] / direction[axis];
+            }
+            else
+            {
+                step[axis] = 0;
+                tMax[axis] = INFINITY;
+                tDelta[axis] = INFINITY;
+            }
+        }
+
+        float t = tStart;
+        while (t < tEnd)
+        {
+            // Axis whose cell boundary is crossed first
+            std::size_t axis = 0;
+            if (tMax[1] < tMax[axis])
+            {
+                axis = 1;
+            }
+            if (tMax[2] < tMax[axis])
+            {
+                axis = 2;
+            }
+
+            // Rays grazing an edge can produce empty spans, step over them silently
+            const float tNext = std::min(tMax[axis], tEnd);
+            if (tNext > t)
+            {
+                if (!visit(static_cast<const Int3 &>(cell), t, tNext))
+                {
+                    return;
+                }
+                t = tNext;
+            }
+
+            cell[axis] += step[axis];
+            if (cell[axis] < lower[axis] || cell[axis] >= upper[axis])
+            {
+                return;
+            }
+            tMax[axis] += tDelta[axis];
+        }
+    }
+} // namespace VolumeUtils
+
+#endif // GRID_TRAVERSAL_H
@@ -0,0 +1,195 @@
+#pragma once
+#ifndef MACROCELL_GRID_H
+#define MACROCELL_GRID_H
+
+#include "Volume/GridTraversal.hpp"
+#include "Volume/Volume.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace VolumeUtils
+{
+    // Coarse grid over a volume that records, per macrocell, the range of voxel values and the
+    // set of mask labels it contains. The ranges are built once at load time; the occupancy bits
+    // that the ray casters use to skip empty macrocells are re-derived from them whenever the
+    // transfer settings change, without touching the volume again.
+    template <typename T>
+    class MacrocellGrid
+    {
+    public:
+        static constexpr int kDefaultCellSize{8};
+
+        struct Cell
+        {
+            T minValue;
+            T maxValue;
+            std::uint32_t labels; // bit n set if mask label n occurs in the cell
+        };
+
+        // Scan the volume (and optional label mask of the same size). Cells include a one voxel
+        // apron so interpolated samples near a cell face are covered too.
+        void Build(const Volume<T> &volume, const Volume<std::uint8_t> *mask = nullptr, int size = kDefaultCellSize)
+        {
+            cellSize = size;
+            for (std::size_t axis = 0; axis < 3; ++axis)
+            {
+                dimensions[axis] = (volume.Dimensions()[axis] + cellSize - 1) / cellSize;
+            }
+            cells.assign(CellCount(), Cell{});
+            occupancy.assign((CellCount() + 31) / 32, 0U);
+
+            const Int3 voxels = volume.Dimensions();
+            for (int cz = 0; cz < dimensions[2]; ++cz)
+            {
+                for (int cy = 0; cy < dimensions[1]; ++cy)
+                {
+                    for (int cx = 0; cx < dimensions[0]; ++cx)
+                    {
+                        const Int3 lower{std::max(cx * cellSize - 1, 0),
+                                         std::max(cy * cellSize - 1, 0),
+                                         std::max(cz * cellSize - 1, 0)};
+                        const Int3 upper{std::min((cx + 1) * cellSize + 1, voxels[0]),
+                                         std::min((cy + 1) * cellSize + 1, voxels[1]),
+                                         std::min((cz + 1) * cellSize + 1, voxels[2])};
+
+                        Cell cell{volume(lower[0], lower[1], lower[2]), volume(lower[0], lower[1], lower[2]), 0U};
+                        for (int z = lower[2]; z < upper[2]; ++z)
+                        {
+                            for (int y = lower[1]; y < upper[1]; ++y)
+                            {
+                                for (int x = lower[0]; x < upper[0]; ++x)
+                                {
+                                    const T value = volume(x, y, z);
+                                    cell.minValue = std::min(cell.minValue, value);
+                                    cell.maxValue = std::max(cell.maxValue, value);
+                                    if (mask != nullptr)
+                                    {
+                                        cell.labels |= 1U << ((*mask)(x, y, z) & 31U);
+                                    }
+                                }
+                            }
+                        }
+                        cells[Index(cx, cy, cz)] = cell;
+                    }
+                }
+            }
+        }
+
+        // Re-derive the occupancy bits, visible(const Cell &) decides whether a macrocell can
+        // contribute anything. Returns true if any bit changed.
+        template <typename Predicate>
+        bool UpdateOccupancy(Predicate &&visible)
+        {
+            bool changed = false;
+            occupiedCount = 0;
+            for (std::size_t word = 0; word < occupancy.size(); ++word)
+            {
+                std::uint32_t bits = 0;
+                const std::size_t first = word * 32;
+                const std::size_t last = std::min(first + 32, cells.size());
+                for (std::size_t i = first; i < last; ++i)
+                {
+                    if (visible(static_cast<const Cell &>(cells[i])))
+                    {
+                        bits |= 1U << (i - first);
+                        ++occupiedCount;
+                    }
+                }
+                changed = changed || bits != occupancy[word];
+                occupancy[word] = bits;
+            }
+            return changed;
+        }
+
+        [[nodiscard]] bool Empty() const
+        {
+            return cells.empty();
+        }
+
+        // Voxels along each edge of a macrocell
+        [[nodiscard]] int CellSize() const
+        {
+            return cellSize;
+        }
+
+        // Number of macrocells along each axis
+        [[nodiscard]] const Int3 &Dimensions() const
+        {
+            return dimensions;
+        }
+
+        [[nodiscard]] std::size_t CellCount() const
+        {
+            return static_cast<std::size_t>(dimensions[0]) * static_cast<std::size_t>(dimensions[1]) *
+                   static_cast<std::size_t>(dimensions[2]);
+        }
+
+        [[nodiscard]] std::size_t OccupiedCount() const
+        {
+            return occupiedCount;
+        }
+
+        [[nodiscard]] const Cell &At(int cx, int cy, int cz) const
+        {
+            return cells[Index(cx, cy, cz)];
+        }
+
+        [[nodiscard]] bool IsOccupied(const Int3 &cell) const
+        {
+            const std::size_t i = Index(cell[0], cell[1], cell[2]);
+            return ((occupancy[i / 32] >> (i % 32)) & 1U) != 0U;
+        }
+
+        // One bit per macrocell, x fastest, packed 32 to a word (the layout the shader reads)
+        [[nodiscard]] const std::vector<std::uint32_t> &OccupancyBits() const
+        {
+            return occupancy;
+        }
+
+        // Every cell, x fastest
+        [[nodiscard]] const std::vector<Cell> &Cells() const
+        {
+            return cells;
+        }
+
+        // Restore cells built earlier (e.g. read from a cache file), the occupancy starts empty.
+        // False, leaving the grid unchanged, if the cell count does not match the dimensions.
+        bool Assign(const Int3 &newDimensions, int newCellSize, std::vector<Cell> newCells)
+        {
+            if (newCellSize <= 0 || newDimensions[0] < 0 || newDimensions[1] < 0 || newDimensions[2] < 0 ||
+                newCells.size() != static_cast<std::size_t>(newDimensions[0]) *
+                                       static_cast<std::size_t>(newDimensions[1]) *
+                                       static_cast<std::size_t>(newDimensions[2]))
+            {
+                return false;
+            }
+            dimensions = newDimensions;
+            cellSize = newCellSize;
+            cells = std::move(newCells);
+            occupancy.assign((cells.size() + 31) / 32, 0U);
+            occupiedCount = 0;
+            return true;
+        }
+
+    private:
+        [[nodiscard]] std::size_t Index(int cx, int cy, int cz) const
+        {
+            return static_cast<std::size_t>(cx) +
+                   static_cast<std::size_t>(dimensions[0]) *
+                       (static_cast<std::size_t>(cy) +
+                        static_cast<std::size_t>(dimensions[1]) * static_cast<std::size_t>(cz));
+        }
+
+        int cellSize{kDefaultCellSize};
+        Int3 dimensions{0, 0, 0};
+        std::size_t occupiedCount{0};
+        std::vector<Cell> cells{};
+        std::vector<std::uint32_t> occupancy{};
+    };
+} // namespace VolumeUtils
+
+#endif // MACROCELL_GRID_H
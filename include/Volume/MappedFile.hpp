@@ -0,0 +1,145 @@
+#pragma once
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace VolumeUtils
+{
+    // Read-only memory mapping of a whole file, unmapped when destroyed. The pages are read
+    // lazily by the OS, and once they are in the page cache a second mapping costs nothing.
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        MappedFile(MappedFile &&other) noexcept
+            : bytes(std::exchange(other.bytes, nullptr)), length(std::exchange(other.length, 0))
+        {
+        }
+
+        MappedFile &operator=(MappedFile &&other) noexcept
+        {
+            if (this != &other)
+            {
+                Close();
+                bytes = std::exchange(other.bytes, nullptr);
+                length = std::exchange(other.length, 0);
+            }
+            return *this;
+        }
+
+        ~MappedFile()
+        {
+            Close();
+        }
+
+        // Map `fileName`, false if it does not exist, is empty or cannot be mapped
+        bool Open(const std::string &fileName)
+        {
+            Close();
+#ifdef _WIN32
+            HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            if (file == INVALID_HANDLE_VALUE)
+            {
+                return false;
+            }
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0)
+            {
+                CloseHandle(file);
+                return false;
+            }
+            HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            CloseHandle(file);
+            if (mapping == NULL)
+            {
+                return false;
+            }
+            void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            // the view keeps the mapping alive
+            CloseHandle(mapping);
+            if (view == NULL)
+            {
+                return false;
+            }
+            length = static_cast<std::size_t>(size.QuadPart);
+#else
+            const int fd = open(fileName.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                return false;
+            }
+            struct stat info;
+            if (fstat(fd, &info) != 0 || info.st_size <= 0)
+            {
+                close(fd);
+                return false;
+            }
+            void *view = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (view == MAP_FAILED)
+            {
+                return false;
+            }
+            length = static_cast<std::size_t>(info.st_size);
+            madvise(view, length, MADV_WILLNEED);
+#endif
+            bytes = static_cast<const unsigned char *>(view);
+            return true;
+        }
+
+        void Close()
+        {
+            if (bytes == nullptr)
+            {
+                return;
+            }
+#ifdef _WIN32
+            UnmapViewOfFile(bytes);
+#else
+            munmap(const_cast<unsigned char *>(bytes), length);
+#endif
+            bytes = nullptr;
+            length = 0;
+        }
+
+        [[nodiscard]] bool IsOpen() const
+        {
+            return bytes != nullptr;
+        }
+
+        [[nodiscard]] const unsigned char *Data() const
+        {
+            return bytes;
+        }
+
+        [[nodiscard]] std::size_t Size() const
+        {
+            return length;
+        }
+
+    private:
+        const unsigned char *bytes{nullptr};
+        std::size_t length{0};
+    };
+} // namespace VolumeUtils
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,707 @@
+// Packet tracing kernel, written once against the lane types of DVR_PACKET_PACK. PacketTracer.hpp
+// includes it once per instruction set, each time into its own namespace and (for the wide packs)
+// inside a region compiled for that instruction set. No include guard on purpose.
+
+namespace DVR_PACKET_NAMESPACE
+{
+    using P = DVR_PACKET_PACK;
+    using F = P::Float;
+    using I = P::Int;
+    using M = P::Mask;
+    using Float3 = std::array<F, 3>;
+    using IntPack3 = std::array<I, 3>;
+
+    constexpr float kInfinity = INFINITY;
+
+    // 2^x for x <= 0, polynomial on the fraction and exponent bits for the integer part.
+    // Relative error is below 1e-7 and, unlike std::pow, it is the same in every lane width.
+    DVR_SIMD_INLINE F Exp2(F x)
+    {
+        x = Simd::Max(Simd::Min(x, F(0.0f)), F(-126.0f));
+        const F whole = Simd::Floor(x);
+        const F f = x - whole;
+        F p = F(0.00186718279f);
+        p = p * f + F(0.00901668798f);
+        p = p * f + F(0.0558004454f);
+        p = p * f + F(0.240164161f);
+        p = p * f + F(0.693151355f);
+        p = p * f + F(1.0f);
+        return p * Simd::AsFloat((Simd::ToInt(whole) + I(127)) << 23);
+    }
+
+    // Per-lane distance between two cell boundaries along every axis
+    DVR_SIMD_INLINE Float3 CellDelta(const Float3 &dir, const Vec3 &cellSize)
+    {
+        Float3 delta{};
+        for (std::size_t axis = 0; axis < 3; ++axis)
+        {
+            const F backward = Simd::Select(
+                dir[axis] < F(0.0f), F(-cellSize[axis]) / dir[axis], F(kInfinity));
+            const F forward = F(cellSize[axis]) / dir[axis];
+            delta[axis] = Simd::Select(dir[axis] > F(0.0f), forward, backward);
+        }
+        return delta;
+    }
+
+    // Clamp a cell index to [lower, upper)
+    DVR_SIMD_INLINE F ClampIndex(F index, I lower, I upper)
+    {
+        return Simd::Min(Simd::Max(index, Simd::ToFloat(lower)), Simd::ToFloat(upper - I(1)));
+    }
+
+    // Start a DDA at ray parameter t, same rules as TraverseGrid
+    DVR_SIMD_INLINE void BeginWalk(const Float3 &origin,
+                                   const Float3 &dir,
+                                   F t,
+                                   const Vec3 &gridMin,
+                                   const Vec3 &cellSize,
+                                   const IntPack3 &lower,
+                                   const IntPack3 &upper,
+                                   IntPack3 &cell,
+                                   Float3 &tMax)
+    {
+        for (std::size_t axis = 0; axis < 3; ++axis)
+        {
+            // The entry point can sit exactly on a face, clamp it back inside
+            const F entry = origin[axis] + dir[axis] * t;
+            F index = Simd::Floor((entry - F(gridMin[axis])) / F(cellSize[axis]));
+            index = ClampIndex(index, lower[axis], upper[axis]);
+            cell[axis] = Simd::ToInt(index);
+
+            const I far = Simd::Select(dir[axis] > F(0.0f), I(1), I(0));
+            const F boundary =
+                F(gridMin[axis]) + Simd::ToFloat(cell[axis] + far) * F(cellSize[axis]);
+            const F distance = (boundary - origin[axis]) / dir[axis];
+            tMax[axis] = Simd::Select(dir[axis] != F(0.0f), distance, F(kInfinity));
+        }
+    }
+
+    // Which axis each lane crosses first, and where
+    struct NextBoundary
+    {
+        M axis[3];
+        F t;
+    };
+
+    DVR_SIMD_INLINE NextBoundary FindNextBoundary(const Float3 &tMax)
+    {
+        const M y = tMax[1] < tMax[0];
+        F best = Simd::Select(y, tMax[1], tMax[0]);
+        const M z = tMax[2] < best;
+        best = Simd::Select(z, tMax[2], best);
+        const M x = !(y | z);
+        const M onlyY = y & !z;
+        return NextBoundary{{x, onlyY, z}, best};
+    }
+
+    // Step the lanes in `lanes` into the next cell, returns the lanes that left [lower, upper)
+    DVR_SIMD_INLINE M StepWalk(M lanes,
+                               const NextBoundary &next,
+                               const IntPack3 &step,
+                               const Float3 &tDelta,
+                               const IntPack3 &lower,
+                               const IntPack3 &upper,
+                               IntPack3 &cell,
+                               Float3 &tMax)
+    {
+        M outside(false);
+        for (std::size_t axis = 0; axis < 3; ++axis)
+        {
+            const M moving = lanes & next.axis[axis];
+            cell[axis] = Simd::Select(moving, cell[axis] + step[axis], cell[axis]);
+            const M left = moving & ((cell[axis] < lower[axis]) | (cell[axis] >= upper[axis]));
+            tMax[axis] = Simd::Select(moving & !left, tMax[axis] + tDelta[axis], tMax[axis]);
+            outside = outside | left;
+        }
+        return outside;
+    }
+
+    // Move the lanes in `lanes` past their current cell, returns the lanes that left [lower, upper)
+    DVR_SIMD_INLINE M AdvanceWalk(M lanes,
+                                  F tEnd,
+                                  F &t,
+                                  const IntPack3 &step,
+                                  const Float3 &tDelta,
+                                  const IntPack3 &lower,
+                                  const IntPack3 &upper,
+                                  IntPack3 &cell,
+                                  Float3 &tMax)
+    {
+        const NextBoundary next = FindNextBoundary(tMax);
+        const F tNext = Simd::Min(next.t, tEnd);
+        t = Simd::Select(lanes & (tNext > t), tNext, t);
+        return StepWalk(lanes, next, step, tDelta, lower, upper, cell, tMax);
+    }
+
+    // Interleave the bits of a 3-bit brick-local coordinate (see Volume::MortonOffset)
+    DVR_SIMD_INLINE I Spread(I v)
+    {
+        return (v & I(1)) | ((v & I(2)) << 2) | ((v & I(4)) << 4);
+    }
+
+    // Offset of voxels inside Data(), honouring the volume's memory layout
+    template <typename T>
+    DVR_SIMD_INLINE I VoxelIndex(const Volume<T> &volume, const IntPack3 &voxel)
+    {
+        const I x = voxel[0];
+        const I y = voxel[1];
+        const I z = voxel[2];
+        if (volume.GetLayout() == Layout::Linear)
+        {
+            return x + I(volume.Width()) * (y + I(volume.Height()) * z);
+        }
+
+        // Same addressing as Volume::Index for 8^3 Morton ordered bricks
+        static_assert(Volume<T>::kBrickSize == 8, "brick addressing assumes 8^3 bricks");
+        constexpr int kBrick = Volume<T>::kBrickSize;
+        const I bricksX((volume.Width() + kBrick - 1) / kBrick);
+        const I bricksY((volume.Height() + kBrick - 1) / kBrick);
+        const I brick = (x >> 3) + bricksX * ((y >> 3) + bricksY * (z >> 3));
+        const I morton = Spread(x & I(7)) | (Spread(y & I(7)) << 1) | (Spread(z & I(7)) << 2);
+        return (brick << 9) + morton;
+    }
+
+    // Fetch voxel values
+    DVR_SIMD_INLINE I FetchVoxel(const Volume<std::uint8_t> &volume, const IntPack3 &voxel, M lanes)
+    {
+        return Simd::Gather(volume.Data(), VoxelIndex(volume, voxel), lanes);
+    }
+
+    DVR_SIMD_INLINE F FetchValue(const Volume<std::uint8_t> &volume, I x, I y, I z, M lanes)
+    {
+        return Simd::ToFloat(FetchVoxel(volume, IntPack3{x, y, z}, lanes));
+    }
+
+    // Value at continuous voxel coordinates (voxel centres at whole numbers) blended from the eight
+    // nearest voxels, positions past the border take the border voxels
+    DVR_SIMD_INLINE F SampleTrilinear(const Volume<std::uint8_t> &volume, const Float3 &coord, M lanes)
+    {
+        const Int3 dims = volume.Dimensions();
+        IntPack3 lo{};
+        IntPack3 hi{};
+        Float3 frac{};
+        for (std::size_t axis = 0; axis < 3; ++axis)
+        {
+            const F clamped =
+                Simd::Min(Simd::Max(coord[axis], F(0.0f)), F(static_cast<float>(dims[axis] - 1)));
+            const F base =
+                Simd::Min(Simd::Floor(clamped), F(static_cast<float>(std::max(dims[axis] - 2, 0))));
+            lo[axis] = Simd::ToInt(base);
+            hi[axis] = Simd::Min(lo[axis] + I(1), I(dims[axis] - 1));
+            frac[axis] = clamped - base;
+        }
+
+        const F c000 = FetchValue(volume, lo[0], lo[1], lo[2], lanes);
+        const F c100 = FetchValue(volume, hi[0], lo[1], lo[2], lanes);
+        const F c010 = FetchValue(volume, lo[0], hi[1], lo[2], lanes);
+        const F c110 = FetchValue(volume, hi[0], hi[1], lo[2], lanes);
+        const F c001 = FetchValue(volume, lo[0], lo[1], hi[2], lanes);
+        const F c101 = FetchValue(volume, hi[0], lo[1], hi[2], lanes);
+        const F c011 = FetchValue(volume, lo[0], hi[1], hi[2], lanes);
+        const F c111 = FetchValue(volume, hi[0], hi[1], hi[2], lanes);
+        const F c00 = c000 + (c100 - c000) * frac[0];
+        const F c10 = c010 + (c110 - c010) * frac[0];
+        const F c01 = c001 + (c101 - c001) * frac[0];
+        const F c11 = c011 + (c111 - c011) * frac[0];
+        const F c0 = c00 + (c10 - c00) * frac[1];
+        const F c1 = c01 + (c11 - c01) * frac[1];
+        return c0 + (c1 - c0) * frac[2];
+    }
+
+    // Is the macrocell of each lane marked occupied
+    DVR_SIMD_INLINE M IsOccupied(const MacrocellGrid<std::uint8_t> *macrocells,
+                                 const IntPack3 &cell,
+                                 M lanes)
+    {
+        if (macrocells == nullptr)
+        {
+            return lanes;
+        }
+        const Int3 &dims = macrocells->Dimensions();
+        const I index = cell[0] + I(dims[0]) * (cell[1] + I(dims[1]) * cell[2]);
+        const I word = Simd::Gather(macrocells->OccupancyBits().data(), index >> 5, lanes);
+        return lanes & ((Simd::ShiftRight(word, index & I(31)) & I(1)) != I(0));
+    }
+
+    // Premultiplied colour and opacity composited front to back, with the samples taken per lane
+    struct Composite
+    {
+        Float3 color;
+        F alpha;
+        I samples;
+    };
+
+    // Composite a sample of premultiplied colour and opacity behind the lanes in `lanes`
+    DVR_SIMD_INLINE void Accumulate(M lanes, const Float3 &color, F opacity, Composite &composite)
+    {
+        const F transparency = F(1.0f) - composite.alpha;
+        for (std::size_t channel = 0; channel < 3; ++channel)
+        {
+            const F blended = composite.color[channel] + transparency * color[channel];
+            composite.color[channel] = Simd::Select(lanes, blended, composite.color[channel]);
+        }
+        const F alpha = composite.alpha + transparency * opacity;
+        composite.alpha = Simd::Select(lanes, alpha, composite.alpha);
+        composite.samples = composite.samples + Simd::Select(lanes, I(1), I(0));
+    }
+
+    // Headlight Blinn-Phong on a premultiplied sample: light and eye both sit along -dir, so the
+    // half vector is the view vector. Both sides of a surface are lit.
+    DVR_SIMD_INLINE void Shade(const PacketSettings &settings,
+                               const Float3 &dir,
+                               const IntPack3 &voxel,
+                               M lanes,
+                               Float3 &color,
+                               F &opacity)
+    {
+        const Volume<PackedGradient> &gradients = settings.gradients->gradients;
+        const auto *bytes = reinterpret_cast<const std::uint8_t *>(gradients.Data());
+        const I texel = VoxelIndex(gradients, voxel) << 2;
+        const F u = Simd::ToFloat(Simd::Gather(bytes, texel, lanes)) / F(127.5f) - F(1.0f);
+        const F v = Simd::ToFloat(Simd::Gather(bytes, texel + I(1), lanes)) / F(127.5f) - F(1.0f);
+        const F magnitude = Simd::ToFloat(Simd::Gather(bytes, texel + I(2), lanes)) / F(255.0f);
+
+        // Octahedral decode, see DecodeOctahedral
+        const F absU = Simd::Max(u, F(0.0f) - u);
+        const F absV = Simd::Max(v, F(0.0f) - v);
+        Float3 normal{u, v, F(1.0f) - absU - absV};
+        const F fold = Simd::Max(F(0.0f) - normal[2], F(0.0f));
+        for (std::size_t axis = 0; axis < 2; ++axis)
+        {
+            const F inward = Simd::Select(normal[axis] < F(0.0f), fold, F(0.0f) - fold);
+            normal[axis] = normal[axis] + inward;
+        }
+        const F length =
+            Simd::Sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        const F dot = (normal[0] * dir[0] + normal[1] * dir[1] + normal[2] * dir[2]) / length;
+        const F facing = Simd::Max(dot, F(0.0f) - dot);
+        F highlight(1.0f);
+        for (int power = 0; power < settings.shininess; ++power)
+        {
+            highlight = highlight * facing;
+        }
+
+        const F weight = Simd::Min(magnitude * F(settings.magnitudeScale), F(1.0f));
+        const F factor = F(1.0f - settings.gradientOpacity) + F(settings.gradientOpacity) * weight;
+        opacity = opacity * factor;
+        const F lit = (F(settings.ambient) + F(settings.diffuse) * facing) * factor;
+        const F shine = F(settings.specular) * highlight * opacity;
+        for (std::size_t channel = 0; channel < 3; ++channel)
+        {
+            color[channel] = color[channel] * lit + shine;
+        }
+    }
+
+    // Colour of each value from the classification tables, premultiplied by `opacity`
+    DVR_SIMD_INLINE Float3 StepColor(const PacketSettings &settings, I value, F opacity, M lanes)
+    {
+        return {Simd::Gather(settings.stepRed.data(), value, lanes) * opacity,
+                Simd::Gather(settings.stepGreen.data(), value, lanes) * opacity,
+                Simd::Gather(settings.stepBlue.data(), value, lanes) * opacity};
+    }
+
+    // Trace one packet of rays, returns the composited colour and opacity per lane.
+    // Each lane walks the macrocell grid and runs the voxel march (DDA or fixed step) inside the
+    // occupied macrocells; lanes advance independently under masks until all are done.
+    DVR_SIMD_INLINE Composite TracePacket(const Float3 &origin,
+                                  const Float3 &dir,
+                                  M valid,
+                                  const PacketSettings &settings)
+    {
+        const Volume<std::uint8_t> &volume = *settings.volume;
+        const Int3 dims = volume.Dimensions();
+        const Vec3 &voxelSize = settings.voxelSize;
+        Vec3 gridMin{};
+        Vec3 gridMax{};
+        for (std::size_t axis = 0; axis < 3; ++axis)
+        {
+            // Volume is centered at the origin
+            gridMin[axis] = -static_cast<float>(dims[axis]) * 0.5f * voxelSize[axis];
+            gridMax[axis] = static_cast<float>(dims[axis]) * 0.5f * voxelSize[axis];
+        }
+
+        // Ray-box intersection
+        F tStart(0.0f);
+        F tEnd(0.0f);
+        for (std::size_t axis = 0; axis < 3; ++axis)
+        {
+            const F invDir = Simd::Select(dir[axis] != F(0.0f), F(1.0f) / dir[axis], F(kInfinity));
+            const F t0 = (F(gridMin[axis]) - origin[axis]) * invDir;
+            const F t1 = (F(gridMax[axis]) - origin[axis]) * invDir;
+            const F enter = Simd::Min(t0, t1);
+            const F exit = Simd::Max(t0, t1);
+            tStart = axis == 0 ? enter : Simd::Max(tStart, enter);
+            tEnd = axis == 0 ? exit : Simd::Min(tEnd, exit);
+        }
+        M active = valid & !(tStart > tEnd) & !(tEnd < F(0.0f));
+        tStart = Simd::Max(tStart, F(0.0f)); // camera inside the volume
+
+        Composite composite{{F(0.0f), F(0.0f), F(0.0f)}, F(0.0f), I(0)};
+        F &alpha = composite.alpha;
+        if (!Simd::Any(active))
+        {
+            return composite;
+        }
+
+        // Without skipping, one macrocell spans the whole volume
+        const bool skipping = settings.macrocells != nullptr && !settings.macrocells->Empty();
+        const MacrocellGrid<std::uint8_t> *macrocells = skipping ? settings.macrocells : nullptr;
+        Int3 macroVoxels = dims;
+        Int3 macroDims{1, 1, 1};
+        if (skipping)
+        {
+            macroVoxels.fill(settings.macrocells->CellSize());
+            macroDims = settings.macrocells->Dimensions();
+        }
+        Vec3 macroSize{};
+        IntPack3 step{};
+        IntPack3 macroLower{};
+        IntPack3 macroUpper{};
+        for (std::size_t axis = 0; axis < 3; ++axis)
+        {
+            macroSize[axis] = voxelSize[axis] * static_cast<float>(macroVoxels[axis]);
+            const I backward = Simd::Select(dir[axis] < F(0.0f), I(-1), I(0));
+            step[axis] = Simd::Select(dir[axis] > F(0.0f), I(1), backward);
+            macroLower[axis] = I(0);
+            macroUpper[axis] = I(macroDims[axis]);
+        }
+        const Float3 macroDelta = CellDelta(dir, macroSize);
+        const Float3 voxelDelta = CellDelta(dir, voxelSize);
+
+        IntPack3 macroCell{};
+        Float3 macroMax{};
+        BeginWalk(
+            origin, dir, tStart, gridMin, macroSize, macroLower, macroUpper, macroCell, macroMax);
+        F t = tStart;
+
+        // Inner march state, valid for lanes with `inner` set
+        M inner(false);
+        F spanEnd(0.0f);
+        IntPack3 lower{};
+        IntPack3 upper{};
+        IntPack3 voxel{};
+        Float3 voxelMax{};
+        F voxelT(0.0f);
+        F sampleIndex(0.0f);
+        // Previous fixed-step sample of each lane, for the pre-integrated segment lookup
+        I previousValue(0);
+        F previousIndex(-2.0f);
+
+        while (Simd::Any(active))
+        {
+            // Macrocell walk: lanes that reach an occupied macrocell start marching through it
+            M outer = active & !inner;
+            active = active & !(outer & !(t < tEnd));
+            outer = outer & active;
+            if (Simd::Any(outer))
+            {
+                const NextBoundary next = FindNextBoundary(macroMax);
+                const F tNext = Simd::Min(next.t, tEnd);
+                const M enter = IsOccupied(macrocells, macroCell, outer & (tNext > t));
+                if (Simd::Any(enter))
+                {
+                    spanEnd = Simd::Select(enter, tNext, spanEnd);
+                    IntPack3 cellLower{};
+                    IntPack3 cellUpper{};
+                    for (std::size_t axis = 0; axis < 3; ++axis)
+                    {
+                        cellLower[axis] = macroCell[axis] * I(macroVoxels[axis]);
+                        cellUpper[axis] =
+                            Simd::Min(cellLower[axis] + I(macroVoxels[axis]), I(dims[axis]));
+                        lower[axis] = Simd::Select(enter, cellLower[axis], lower[axis]);
+                        upper[axis] = Simd::Select(enter, cellUpper[axis], upper[axis]);
+                    }
+                    if (settings.dda)
+                    {
+                        IntPack3 startVoxel{};
+                        Float3 startMax{};
+                        BeginWalk(origin,
+                                  dir,
+                                  t,
+                                  gridMin,
+                                  voxelSize,
+                                  cellLower,
+                                  cellUpper,
+                                  startVoxel,
+                                  startMax);
+                        for (std::size_t axis = 0; axis < 3; ++axis)
+                        {
+                            voxel[axis] = Simd::Select(enter, startVoxel[axis], voxel[axis]);
+                            voxelMax[axis] = Simd::Select(enter, startMax[axis], voxelMax[axis]);
+                        }
+                        voxelT = Simd::Select(enter, t, voxelT);
+                    }
+                    else
+                    {
+                        // Samples sit at tStart + k * stepSize for the whole ray
+                        const F firstSample = Simd::Ceil((t - tStart) / F(settings.stepSize));
+                        sampleIndex = Simd::Select(enter, firstSample, sampleIndex);
+                    }
+                    inner = inner | enter;
+                }
+                const M outside = AdvanceWalk(outer & !enter,
+                                              tEnd,
+                                              t,
+                                              step,
+                                              macroDelta,
+                                              macroLower,
+                                              macroUpper,
+                                              macroCell,
+                                              macroMax);
+                active = active & !outside;
+            }
+
+            // Voxel march inside the current macrocell
+            const M marching = active & inner;
+            if (!Simd::Any(marching))
+            {
+                continue;
+            }
+            M done(false);
+            if (settings.dda)
+            {
+                const M running = marching & (voxelT < spanEnd);
+                done = marching & !running;
+                const NextBoundary next = FindNextBoundary(voxelMax);
+                const F tNext = Simd::Min(next.t, spanEnd);
+
+                // Rays grazing an edge can produce empty spans, step over them silently
+                const M visit = running & (tNext > voxelT);
+                if (Simd::Any(visit))
+                {
+                    // Opacity corrected for the length of the segment inside the voxel
+                    const I value = FetchVoxel(volume, voxel, visit);
+                    const F weight = (tNext - voxelT) / F(settings.stepSize);
+                    const F logTransparency =
+                        Simd::Gather(settings.logTransparency.data(), value, visit);
+                    F opacity = F(1.0f) - Exp2(weight * logTransparency);
+                    Float3 color = StepColor(settings, value, opacity, visit);
+                    if (settings.gradients != nullptr)
+                    {
+                        Shade(settings, dir, voxel, visit, color, opacity);
+                    }
+                    Accumulate(visit, color, opacity, composite);
+                    voxelT = Simd::Select(visit, tNext, voxelT);
+                }
+                const M opaque = visit & (alpha >= F(settings.opacityCutoff));
+                active = active & !opaque;
+                const M left = StepWalk(
+                    running & !opaque, next, step, voxelDelta, lower, upper, voxel, voxelMax);
+                done = done | left;
+            }
+            else
+            {
+                const F tSample = tStart + sampleIndex * F(settings.stepSize);
+                done = marching & ((tSample >= spanEnd) | (alpha >= F(settings.opacityCutoff)));
+                const M sample = marching & !done;
+                if (Simd::Any(sample))
+                {
+                    // Map world position to volume coordinates
+                    Float3 coord{};
+                    for (std::size_t axis = 0; axis < 3; ++axis)
+                    {
+                        const F position = origin[axis] + dir[axis] * tSample;
+                        coord[axis] = (position - F(gridMin[axis])) / F(voxelSize[axis]);
+                    }
+                    // Voxel the sample falls in, it also supplies the gradient
+                    IntPack3 sampleVoxel{};
+                    for (std::size_t axis = 0; axis < 3; ++axis)
+                    {
+                        const F index =
+                            ClampIndex(Simd::Floor(coord[axis]), lower[axis], upper[axis]);
+                        sampleVoxel[axis] = Simd::ToInt(index);
+                    }
+                    I value(0);
+                    if (settings.trilinear)
+                    {
+                        // The macrocell apron covers the neighbours, so no bounds to the span
+                        for (std::size_t axis = 0; axis < 3; ++axis)
+                        {
+                            coord[axis] = coord[axis] - F(0.5f);
+                        }
+                        const F blended = SampleTrilinear(volume, coord, sample);
+                        value = Simd::ToInt(Simd::Floor(blended + F(0.5f)));
+                    }
+                    else
+                    {
+                        value = FetchVoxel(volume, sampleVoxel, sample);
+                    }
+                    Float3 color{};
+                    F opacity(0.0f);
+                    if (settings.PreIntegrated())
+                    {
+                        // Segment from the previous sample, or a constant one when the ray just
+                        // entered the volume or came out of skipped space
+                        const M follows = sample & !(previousIndex != sampleIndex - F(1.0f));
+                        const I front = Simd::Select(follows, previousValue, value);
+                        const I segment = (value << 8) + front;
+                        color = {Simd::Gather(settings.segmentRed.data(), segment, sample),
+                                 Simd::Gather(settings.segmentGreen.data(), segment, sample),
+                                 Simd::Gather(settings.segmentBlue.data(), segment, sample)};
+                        opacity = Simd::Gather(settings.segmentAlpha.data(), segment, sample);
+                        previousValue = Simd::Select(sample, value, previousValue);
+                        previousIndex = Simd::Select(sample, sampleIndex, previousIndex);
+                    }
+                    else
+                    {
+                        opacity = Simd::Gather(settings.stepAlpha.data(), value, sample);
+                        color = StepColor(settings, value, opacity, sample);
+                    }
+                    if (settings.gradients != nullptr)
+                    {
+                        Shade(settings, dir, sampleVoxel, sample, color, opacity);
+                    }
+                    Accumulate(sample, color, opacity, composite);
+                    sampleIndex = Simd::Select(sample, sampleIndex + F(1.0f), sampleIndex);
+                }
+            }
+
+            // Finished macrocells: stop opaque rays, move the others on
+            done = done & active;
+            inner = inner & !done;
+            const M opaque = done & (alpha >= F(settings.opacityCutoff));
+            active = active & !opaque;
+            const M outside = AdvanceWalk(done & !opaque,
+                                          tEnd,
+                                          t,
+                                          step,
+                                          macroDelta,
+                                          macroLower,
+                                          macroUpper,
+                                          macroCell,
+                                          macroMax);
+            active = active & !outside;
+        }
+        return composite;
+    }
+
+    // Render the lattice pixels inside [x0, x1) x [y0, y1) into an RGBA8 image, one screen tile of
+    // lattice pixels per packet. Fill blocks are clipped to the tile. The samples composited are
+    // added to `samples` unless it is nullptr.
+    inline void RenderTile(const RayCamera &camera,
+                           const PacketSettings &settings,
+                           const PixelLattice &lattice,
+                           int x0,
+                           int y0,
+                           int x1,
+                           int y1,
+                           std::uint8_t *rgba,
+                           std::uint64_t *samples)
+    {
+        constexpr int kTileWidth = P::kTileWidth;
+        constexpr int kTileHeight = P::kWidth / P::kTileWidth;
+        const int stride = lattice.stride;
+
+        std::int32_t laneX[P::kWidth];
+        std::int32_t laneY[P::kWidth];
+        for (int lane = 0; lane < P::kWidth; ++lane)
+        {
+            laneX[lane] = lane % kTileWidth * stride;
+            laneY[lane] = lane / kTileWidth * stride;
+        }
+        const I offsetX = Simd::LoadInt(P{}, laneX);
+        const I offsetY = Simd::LoadInt(P{}, laneY);
+
+        // First lattice pixel at or after the tile corner
+        const auto firstOnLattice = [stride](int start, int phase) {
+            return start + ((phase - start) % stride + stride) % stride;
+        };
+        const int firstX = firstOnLattice(x0, lattice.phaseX);
+        const int firstY = firstOnLattice(y0, lattice.phaseY);
+
+        std::int32_t pixelX[P::kWidth];
+        std::int32_t pixelY[P::kWidth];
+        std::int32_t red[P::kWidth];
+        std::int32_t green[P::kWidth];
+        std::int32_t blue[P::kWidth];
+        std::int32_t laneSamples[P::kWidth];
+        for (int y = firstY; y < y1; y += kTileHeight * stride)
+        {
+            // The row part of the image plane offset is shared by the whole row of packets
+            const I py = I(y) + offsetY;
+            Float3 rowOffset{};
+            for (std::size_t axis = 0; axis < 3; ++axis)
+            {
+                rowOffset[axis] = F(camera.corner[axis]) + F(camera.deltaY[axis]) * Simd::ToFloat(py);
+            }
+
+            for (int x = firstX; x < x1; x += kTileWidth * stride)
+            {
+                const I px = I(x) + offsetX;
+                const M valid = (px < I(x1)) & (py < I(y1));
+
+                Float3 offset{};
+                for (std::size_t axis = 0; axis < 3; ++axis)
+                {
+                    offset[axis] = rowOffset[axis] + F(camera.deltaX[axis]) * Simd::ToFloat(px);
+                }
+                Float3 origin{};
+                Float3 dir{};
+                if (camera.orthographic)
+                {
+                    for (std::size_t axis = 0; axis < 3; ++axis)
+                    {
+                        origin[axis] = F(camera.position[axis]) + offset[axis];
+                        dir[axis] = F(camera.forward[axis]);
+                    }
+                }
+                else
+                {
+                    const F length =
+                        Simd::Sqrt(offset[0] * offset[0] + offset[1] * offset[1] + offset[2] * offset[2]);
+                    const F invLength = F(1.0f) / length;
+                    for (std::size_t axis = 0; axis < 3; ++axis)
+                    {
+                        origin[axis] = F(camera.position[axis]);
+                        dir[axis] = Simd::Select(length != F(0.0f), offset[axis] * invLength, offset[axis]);
+                    }
+                }
+
+                const Composite composite = TracePacket(origin, dir, valid, settings);
+                const auto toByte = [](F channel) {
+                    const I rounded = Simd::ToInt(channel * F(255.0f) + F(0.5f));
+                    return Simd::Min(Simd::Max(rounded, I(0)), I(255));
+                };
+                Simd::Store(pixelX, px);
+                Simd::Store(pixelY, py);
+                Simd::Store(red, toByte(composite.color[0]));
+                Simd::Store(green, toByte(composite.color[1]));
+                Simd::Store(blue, toByte(composite.color[2]));
+                if (samples != nullptr)
+                {
+                    Simd::Store(laneSamples, composite.samples);
+                    for (int lane = 0; lane < P::kWidth; ++lane)
+                    {
+                        *samples += static_cast<std::uint64_t>(laneSamples[lane]);
+                    }
+                }
+                for (int lane = 0; lane < P::kWidth; ++lane)
+                {
+                    if (pixelX[lane] >= x1 || pixelY[lane] >= y1)
+                    {
+                        continue;
+                    }
+                    const std::array<std::uint8_t, 3> color{static_cast<std::uint8_t>(red[lane]),
+                                                            static_cast<std::uint8_t>(green[lane]),
+                                                            static_cast<std::uint8_t>(blue[lane])};
+                    const int blockX1 = std::min(pixelX[lane] + lattice.fill, x1);
+                    const int blockY1 = std::min(pixelY[lane] + lattice.fill, y1);
+                    for (int row = pixelY[lane]; row < blockY1; ++row)
+                    {
+                        for (int column = pixelX[lane]; column < blockX1; ++column)
+                        {
+                            const std::size_t offset = static_cast<std::size_t>(row) *
+                                                           static_cast<std::size_t>(camera.width) +
+                                                       static_cast<std::size_t>(column);
+                            std::uint8_t *pixel = rgba + offset * 4;
+                            pixel[0] = color[0];
+                            pixel[1] = color[1];
+                            pixel[2] = color[2];
+                            pixel[3] = 255;
+                        }
+                    }
+                }
+            }
+        }
+    }
+} // namespace DVR_PACKET_NAMESPACE
@@ -0,0 +1,198 @@
+#pragma once
+#ifndef PACKET_TRACER_H
+#define PACKET_TRACER_H
+
+#include "Simd/Simd.hpp"
+#include "Volume/GradientVolume.hpp"
+#include "Volume/GridTraversal.hpp"
+#include "Volume/MacrocellGrid.hpp"
+#include "Volume/Progressive.hpp"
+#include "Volume/RayCamera.hpp"
+#include "Volume/TransferFunction.hpp"
+#include "Volume/Volume.hpp"
+#include "Volume/Window.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace VolumeUtils
+{
+    // Volume, classification and traversal settings of a frame
+    struct PacketSettings
+    {
+        const Volume<std::uint8_t> *volume{nullptr};
+        const MacrocellGrid<std::uint8_t> *macrocells{nullptr}; // nullptr disables skipping
+        bool dda{true};
+        bool trilinear{false}; // fixed steps blend the 8 nearest voxels, the DDA visits whole voxels
+        Vec3 voxelSize{1.0f, 1.0f, 1.0f}; // world size of a voxel along each axis
+        float stepSize{0.1f}; // fixed-step length, DDA segments are weighted in these units
+        float opacityCutoff{0.95f};
+        // Colour and opacity of each value over one fixed step
+        std::array<float, 256> stepRed{};
+        std::array<float, 256> stepGreen{};
+        std::array<float, 256> stepBlue{};
+        std::array<float, 256> stepAlpha{};
+        std::array<float, 256> logTransparency{}; // log2(1 - stepAlpha), for DDA segments
+        // Pre-integrated fixed steps from the previous sample's value to the current one,
+        // [current * 256 + previous], colour premultiplied. Empty unless pre-integration is on.
+        std::vector<float> segmentRed{};
+        std::vector<float> segmentGreen{};
+        std::vector<float> segmentBlue{};
+        std::vector<float> segmentAlpha{};
+        // Blinn-Phong shading with a headlight from precomputed gradients, nullptr renders unlit
+        const GradientVolume *gradients{nullptr};
+        float ambient{0.3f};
+        float diffuse{0.7f};
+        float specular{0.3f};
+        int shininess{16};
+        // Opacity scaled towards the gradient magnitude: 0 ignores it, 1 multiplies by it. A packed
+        // magnitude m (in [0, 1]) counts as min(m * magnitudeScale, 1).
+        float gradientOpacity{0.0f};
+        float magnitudeScale{1.0f};
+
+        // Grey voxels that absorb in proportion to their windowed value. The window is applied
+        // through the tables so changing it never touches the volume; the default spans all 256
+        // values.
+        void SetDensity(float density, const WindowMapping &window = {1.0f / 255.0f, 0.0f})
+        {
+            for (std::size_t value = 0; value < stepAlpha.size(); ++value)
+            {
+                stepRed[value] = stepGreen[value] = stepBlue[value] = 1.0f;
+                stepAlpha[value] = std::min(window(static_cast<float>(value)) * density, 1.0f);
+                logTransparency[value] = std::log2(1.0f - stepAlpha[value]);
+            }
+            ClearSegments();
+        }
+
+        // Classify windowed values through a transfer function whose opacities are over
+        // `stepScale` fixed steps (a fixed step of stepScale times the reference length).
+        // Pre-integration fills the segment tables for fixed steps of that length.
+        void SetTransferFunction(const TransferFunction &transfer,
+                                 const WindowMapping &window,
+                                 float stepScale = 1.0f,
+                                 bool preIntegrate = false)
+        {
+            std::vector<Rgba> table(stepAlpha.size());
+            for (std::size_t value = 0; value < table.size(); ++value)
+            {
+                table[value] = transfer.Evaluate(window(static_cast<float>(value)));
+                stepRed[value] = table[value][0];
+                stepGreen[value] = table[value][1];
+                stepBlue[value] = table[value][2];
+                stepAlpha[value] = CorrectOpacity(table[value][3], stepScale);
+                logTransparency[value] = std::log2(1.0f - stepAlpha[value]);
+            }
+            ClearSegments();
+            if (!preIntegrate)
+            {
+                return;
+            }
+            const std::vector<Rgba> segments = PreIntegrate(table, stepScale);
+            segmentRed.resize(segments.size());
+            segmentGreen.resize(segments.size());
+            segmentBlue.resize(segments.size());
+            segmentAlpha.resize(segments.size());
+            for (std::size_t i = 0; i < segments.size(); ++i)
+            {
+                segmentRed[i] = segments[i][0];
+                segmentGreen[i] = segments[i][1];
+                segmentBlue[i] = segments[i][2];
+                segmentAlpha[i] = segments[i][3];
+            }
+        }
+
+        [[nodiscard]] bool PreIntegrated() const
+        {
+            return !segmentAlpha.empty();
+        }
+
+    private:
+        void ClearSegments()
+        {
+            segmentRed.clear();
+            segmentGreen.clear();
+            segmentBlue.clear();
+            segmentAlpha.clear();
+        }
+    };
+
+    namespace PacketDetail
+    {
+#define DVR_PACKET_NAMESPACE Scalar
+#define DVR_PACKET_PACK Simd::ScalarPack
+#include "Volume/PacketKernel.inl"
+#undef DVR_PACKET_NAMESPACE
+#undef DVR_PACKET_PACK
+
+#if DVR_SIMD_X86
+        DVR_SIMD_BEGIN_AVX2
+#define DVR_PACKET_NAMESPACE Avx2
+#define DVR_PACKET_PACK Simd::Avx2Pack
+#include "Volume/PacketKernel.inl"
+#undef DVR_PACKET_NAMESPACE
+#undef DVR_PACKET_PACK
+        DVR_SIMD_END
+
+        // GCC 12 flags the undefined placeholders inside its own AVX-512 intrinsics once inlined
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#endif
+        DVR_SIMD_BEGIN_AVX512
+#define DVR_PACKET_NAMESPACE Avx512
+#define DVR_PACKET_PACK Simd::Avx512Pack
+#include "Volume/PacketKernel.inl"
+#undef DVR_PACKET_NAMESPACE
+#undef DVR_PACKET_PACK
+        DVR_SIMD_END
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+    } // namespace PacketDetail
+
+    // Render pixels [x0, x1) x [y0, y1) of the frame with the given instruction set, or only the
+    // lattice pixels among them. Every level produces the same bytes, the wide ones just trace
+    // 8 (4x2) or 16 (4x4) rays at once. A pixel gets the same value on every lattice. The number
+    // of samples composited is added to `samples` when given (for benchmarks).
+    inline void RenderTile(Simd::Level level,
+                           const RayCamera &camera,
+                           const PacketSettings &settings,
+                           int x0,
+                           int y0,
+                           int x1,
+                           int y1,
+                           std::uint8_t *rgba,
+                           const PixelLattice &lattice = {},
+                           std::uint64_t *samples = nullptr)
+    {
+#if DVR_SIMD_X86
+        if (level == Simd::Level::Avx512)
+        {
+            PacketDetail::Avx512::RenderTile(camera, settings, lattice, x0, y0, x1, y1, rgba, samples);
+            return;
+        }
+        if (level == Simd::Level::Avx2)
+        {
+            PacketDetail::Avx2::RenderTile(camera, settings, lattice, x0, y0, x1, y1, rgba, samples);
+            return;
+        }
+#endif
+        (void)level;
+        PacketDetail::Scalar::RenderTile(camera, settings, lattice, x0, y0, x1, y1, rgba, samples);
+    }
+
+    // Trace a single ray with the scalar kernel, returns the composited colour (premultiplied)
+    // and opacity
+    inline Rgba TraceRay(const Vec3 &origin, const Vec3 &direction, const PacketSettings &settings)
+    {
+        const auto composite = PacketDetail::Scalar::TracePacket(origin, direction, true, settings);
+        return {composite.color[0], composite.color[1], composite.color[2], composite.alpha};
+    }
+} // namespace VolumeUtils
+
+#endif // PACKET_TRACER_H
@@ -0,0 +1,112 @@
+#pragma once
+#ifndef PHANTOMS_H
+#define PHANTOMS_H
+
+#include "Scheduler/ParallelFor.hpp"
+#include "Volume/Volume.hpp"
+
+#include <cstdint>
+#include <random>
+
+namespace VolumeUtils
+{
+    // Alternating 0 and 2 voxels: every macrocell is occupied and every voxel differs from its
+    // neighbours, the worst case for empty space skipping and early termination
+    inline void FillChecker(Volume<std::uint8_t> &volume)
+    {
+        for (int z = 0; z < volume.Depth(); ++z)
+        {
+            for (int y = 0; y < volume.Height(); ++y)
+            {
+                for (int x = 0; x < volume.Width(); ++x)
+                {
+                    volume(x, y, z) = static_cast<std::uint8_t>(2 * ((x + y + z) % 2 == 0));
+                }
+            }
+        }
+    }
+
+    // Uniformly random values in [0, maxValue]
+    inline void FillRandom(Volume<std::uint8_t> &volume, int maxValue, std::uint32_t seed)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<int> dist(0, maxValue);
+        for (int z = 0; z < volume.Depth(); ++z)
+        {
+            for (int y = 0; y < volume.Height(); ++y)
+            {
+                for (int x = 0; x < volume.Width(); ++x)
+                {
+                    volume(x, y, z) = static_cast<std::uint8_t>(dist(rng));
+                }
+            }
+        }
+    }
+
+    // Hounsfield units of a CT-like torso at a point of [-1, 1]^3, the body along Y (the slice
+    // axis of the reordered volumes): air around a fat-covered body of soft tissue with two
+    // lungs, a contrast-filled vessel and a spine of cortical and cancellous bone
+    inline float CtPhantomValue(float x, float y, float z)
+    {
+        const auto inEllipse = [](float u, float v, float radiusU, float radiusV) {
+            return (u * u) / (radiusU * radiusU) + (v * v) / (radiusV * radiusV) <= 1.0f;
+        };
+        if (y < -0.9f || y > 0.9f || !inEllipse(x, z, 0.85f, 0.6f))
+        {
+            return -1000.0f;
+        }
+        if (!inEllipse(x, z, 0.78f, 0.53f))
+        {
+            return -100.0f;
+        }
+        if (inEllipse(x, z - 0.38f, 0.1f, 0.1f))
+        {
+            return inEllipse(x, z - 0.38f, 0.07f, 0.07f) ? 300.0f : 1200.0f;
+        }
+        if (inEllipse(x - 0.08f, z - 0.18f, 0.06f, 0.06f))
+        {
+            return 250.0f;
+        }
+        for (const float side : {-1.0f, 1.0f})
+        {
+            const float lungX = (x - side * 0.38f) / 0.26f;
+            const float lungY = (y - 0.35f) / 0.5f;
+            const float lungZ = (z + 0.02f) / 0.36f;
+            if (lungX * lungX + lungY * lungY + lungZ * lungZ <= 1.0f)
+            {
+                return -850.0f;
+            }
+        }
+        return 40.0f;
+    }
+
+    // A cube of `size`^3 voxels of CtPhantomValue with +-20 HU of noise, stored as Hounsfield
+    // units (rescale slope 1, intercept 0). Filled slice by slice on every core, the same for
+    // any thread count.
+    inline Volume<std::int16_t> MakeCtPhantom(int size, Layout layout = Layout::Linear, int threadCount = 0)
+    {
+        Volume<std::int16_t> volume(size, size, size, layout);
+        const float scale = 2.0f / static_cast<float>(size);
+        Scheduler::ParallelFor(size, threadCount, [&](int z) {
+            std::uint32_t noise = 0x9E3779B9U * static_cast<std::uint32_t>(z + 1);
+            for (int y = 0; y < size; ++y)
+            {
+                for (int x = 0; x < size; ++x)
+                {
+                    // xorshift, cheap and the same on every platform
+                    noise ^= noise << 13U;
+                    noise ^= noise >> 17U;
+                    noise ^= noise << 5U;
+                    const float value = CtPhantomValue((static_cast<float>(x) + 0.5f) * scale - 1.0f,
+                                                       (static_cast<float>(y) + 0.5f) * scale - 1.0f,
+                                                       (static_cast<float>(z) + 0.5f) * scale - 1.0f);
+                    const int jitter = static_cast<int>(noise % 41U) - 20;
+                    volume(x, y, z) = static_cast<std::int16_t>(static_cast<int>(value) + jitter);
+                }
+            }
+        });
+        return volume;
+    }
+} // namespace VolumeUtils
+
+#endif // PHANTOMS_H
@@ -0,0 +1,126 @@
+#pragma once
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include <vector>
+
+namespace VolumeUtils
+{
+    // Pixels traced by one pass: every stride-th pixel in both directions, starting at
+    // (phaseX, phaseY). Each traced pixel is also copied over the fill x fill block to its lower
+    // right, so a coarse pass still covers the whole frame.
+    struct PixelLattice
+    {
+        int stride{1};
+        int phaseX{0};
+        int phaseY{0};
+        int fill{1};
+    };
+
+    // Progressive refinement of a frame. While the view keeps changing, every frame is traced on
+    // a coarse lattice whose stride adapts to a time budget. Once the view holds still, each
+    // frame halves the stride by tracing only the pixels the coarser lattices skipped, until every
+    // pixel has been traced exactly once. After that there is nothing left to do until the view
+    // changes again. Tiles must be a multiple of kMaxStride wide for the fill to stay inside them.
+    class ProgressiveRefiner
+    {
+    public:
+        static constexpr int kMaxStride{8};
+
+        explicit ProgressiveRefiner(float budget = 16.0f) : budgetMilliseconds(budget)
+        {
+        }
+
+        // Lattices to trace this frame, empty once the image has converged. lastMilliseconds is
+        // how long the passes of the previous frame took, it tunes the coarse stride.
+        const std::vector<PixelLattice> &NextFrame(bool viewChanged, float lastMilliseconds)
+        {
+            passes.clear();
+            if (viewChanged || stride == 0)
+            {
+                if (coarsePass)
+                {
+                    AdaptCoarseStride(lastMilliseconds);
+                }
+                stride = coarseStride;
+                coarsePass = true;
+                passes.push_back({stride, 0, 0, stride});
+                return passes;
+            }
+
+            coarsePass = false;
+            if (stride == 1)
+            {
+                return passes;
+            }
+            // The three lattices in between the traced pixels of the current one
+            const int half = stride / 2;
+            passes.push_back({stride, half, 0, half});
+            passes.push_back({stride, 0, half, half});
+            passes.push_back({stride, half, half, half});
+            stride = half;
+            return passes;
+        }
+
+        // Start over with a coarse pass on the next frame
+        void Restart()
+        {
+            stride = 0;
+        }
+
+        // The frame was completed some other way (a full render, a cached copy)
+        void MarkConverged()
+        {
+            stride = 1;
+            coarsePass = false;
+        }
+
+        // Stride of the finest lattice traced so far, 0 before the first frame
+        [[nodiscard]] int Stride() const
+        {
+            return stride;
+        }
+
+        [[nodiscard]] int CoarseStride() const
+        {
+            return coarseStride;
+        }
+
+        [[nodiscard]] bool Converged() const
+        {
+            return stride == 1 && !coarsePass;
+        }
+
+        [[nodiscard]] float BudgetMilliseconds() const
+        {
+            return budgetMilliseconds;
+        }
+
+        void SetBudgetMilliseconds(float budget)
+        {
+            budgetMilliseconds = budget;
+        }
+
+    private:
+        // Halving the stride quadruples the work, so only refine when that still fits the budget
+        void AdaptCoarseStride(float lastMilliseconds)
+        {
+            if (lastMilliseconds > budgetMilliseconds && coarseStride < kMaxStride)
+            {
+                coarseStride *= 2;
+            }
+            else if (lastMilliseconds * 4.0f < budgetMilliseconds && coarseStride > 1)
+            {
+                coarseStride /= 2;
+            }
+        }
+
+        float budgetMilliseconds;
+        int coarseStride{4};
+        int stride{0};
+        bool coarsePass{false};
+        std::vector<PixelLattice> passes{};
+    };
+} // namespace VolumeUtils
+
+#endif // PROGRESSIVE_H
@@ -0,0 +1,97 @@
+#pragma once
+#ifndef RAY_CAMERA_H
+#define RAY_CAMERA_H
+
+#include "Volume/GridTraversal.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+namespace VolumeUtils
+{
+    inline constexpr float kPi = 3.14159265358979323846f;
+
+    // Ray generation for one frame. Pixel (x, y) offsets the image plane by
+    //   offset = corner + y * deltaY + x * deltaX
+    // and gets the ray
+    //   perspective:  origin = position,          direction = normalize(offset)
+    //   orthographic: origin = position + offset, direction = forward
+    // so only additions and multiplications are left per pixel.
+    struct RayCamera
+    {
+        Vec3 position{0.0f, 0.0f, 0.0f};
+        Vec3 forward{0.0f, 0.0f, 1.0f}; // normalized viewing direction
+        Vec3 corner{0.0f, 0.0f, 1.0f};  // offset of pixel (0, 0)
+        Vec3 deltaX{0.0f, 0.0f, 0.0f};  // offset change from one column to the next
+        Vec3 deltaY{0.0f, 0.0f, 0.0f};  // offset change from one row to the next
+        bool orthographic{false};
+        int width{1};
+        int height{1};
+    };
+
+    // Set up the rays of a width x height frame seen by a look-at camera. Like raylib's Camera3D,
+    // fovy is the vertical field of view in degrees for a perspective camera and the height of
+    // the view in world units for an orthographic one.
+    inline RayCamera MakeRayCamera(const Vec3 &position,
+                                   const Vec3 &target,
+                                   const Vec3 &up,
+                                   float fovy,
+                                   bool orthographic,
+                                   int width,
+                                   int height)
+    {
+        RayCamera camera;
+        camera.position = position;
+        camera.orthographic = orthographic;
+        camera.width = width;
+        camera.height = height;
+
+        Vec3 forward{};
+        float length = 0.0f;
+        for (std::size_t axis = 0; axis < 3; ++axis)
+        {
+            forward[axis] = target[axis] - position[axis];
+            length += forward[axis] * forward[axis];
+        }
+        length = std::sqrt(length);
+        for (std::size_t axis = 0; axis < 3; ++axis)
+        {
+            forward[axis] = length > 0.0f ? forward[axis] / length : 0.0f;
+        }
+        camera.forward = forward;
+        const Vec3 horizontal{up[1] * forward[2] - up[2] * forward[1],
+                              up[2] * forward[0] - up[0] * forward[2],
+                              up[0] * forward[1] - up[1] * forward[0]};
+
+        const float aspectRatio = static_cast<float>(width) / static_cast<float>(height);
+        // Perspective: the image plane sits at cot(fov / 2) and spans [-1, 1] vertically.
+        // Orthographic: the plane goes through the camera and spans the view height.
+        const float focalLength = orthographic ? 0.0f : 1.0f / std::tan(fovy * kPi / 360.0f);
+        const float halfHeight = orthographic ? fovy * 0.5f : 1.0f;
+        const float columnStep = 2.0f * aspectRatio * halfHeight / static_cast<float>(width);
+        const float rowStep = -2.0f * halfHeight / static_cast<float>(height);
+        for (std::size_t axis = 0; axis < 3; ++axis)
+        {
+            const float planeCorner = (up[axis] - horizontal[axis] * aspectRatio) * halfHeight;
+            camera.corner[axis] = forward[axis] * focalLength + planeCorner;
+            camera.deltaX[axis] = horizontal[axis] * columnStep;
+            camera.deltaY[axis] = up[axis] * rowStep;
+        }
+        return camera;
+    }
+
+    // View height of an orthographic camera that frames the target like a perspective camera
+    // with this field of view (degrees) at this distance, and back
+    inline float OrthographicHeight(float fovy, float distance)
+    {
+        return 2.0f * distance * std::tan(fovy * kPi / 360.0f);
+    }
+
+    inline float PerspectiveFovy(float viewHeight, float distance)
+    {
+        return std::atan(viewHeight * 0.5f / distance) * 360.0f / kPi;
+    }
+} // namespace VolumeUtils
+
+#endif // RAY_CAMERA_H
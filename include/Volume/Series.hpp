@@ -0,0 +1,82 @@
+#pragma once
+#ifndef SERIES_H
+#define SERIES_H
+
+#include "Volume/GridTraversal.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace VolumeUtils
+{
+    // Slices of one series in order along the slice normal
+    struct SliceOrder
+    {
+        std::vector<std::string> files{};
+        float spacing{0.0f};      // mean distance between neighbouring slices, 0 for a single one
+        float spacingError{0.0f}; // largest difference between a gap and spacing
+    };
+
+    // Order the slices of a series by their position along the slice normal (ImagePositionPatient
+    // projected on the normal) and derive the slice spacing from it. Slices at the same position
+    // as the previous one (repeated acquisitions) are dropped.
+    inline SliceOrder OrderSlices(std::vector<std::pair<float, std::string>> positions,
+                                  float tolerance = 1e-3f)
+    {
+        if (positions.empty())
+        {
+            throw std::runtime_error("Series has no slices with a position");
+        }
+        std::stable_sort(positions.begin(), positions.end(), [](const auto &a, const auto &b) {
+            return a.first < b.first;
+        });
+
+        SliceOrder order;
+        std::vector<float> kept;
+        for (auto &position : positions)
+        {
+            if (!kept.empty() && position.first - kept.back() <= tolerance)
+            {
+                continue;
+            }
+            kept.push_back(position.first);
+            order.files.push_back(std::move(position.second));
+        }
+        if (kept.size() < 2)
+        {
+            return order;
+        }
+
+        order.spacing = (kept.back() - kept.front()) / static_cast<float>(kept.size() - 1);
+        for (std::size_t slice = 1; slice < kept.size(); ++slice)
+        {
+            const float gap = kept[slice] - kept[slice - 1];
+            order.spacingError = std::max(order.spacingError, std::abs(gap - order.spacing));
+        }
+        return order;
+    }
+
+    // World size of a voxel with this spacing, the finest axis gets cellSize
+    inline Vec3 VoxelSize(const std::array<float, 3> &spacing, float cellSize)
+    {
+        const float finest = std::min({spacing[0], spacing[1], spacing[2]});
+        Vec3 size{cellSize, cellSize, cellSize};
+        if (finest <= 0.0f)
+        {
+            return size;
+        }
+        for (std::size_t axis = 0; axis < 3; ++axis)
+        {
+            size[axis] = cellSize * spacing[axis] / finest;
+        }
+        return size;
+    }
+} // namespace VolumeUtils
+
+#endif // SERIES_H
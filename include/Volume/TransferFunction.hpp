@@ -0,0 +1,260 @@
+#pragma once
+#ifndef TRANSFER_FUNCTION_H
+#define TRANSFER_FUNCTION_H
+
+#include "Volume/FrameCache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace VolumeUtils
+{
+    // Colour and opacity, the opacity is over one reference step of the ray caster
+    using Rgba = std::array<float, 4>;
+
+    // Value of entry i of a table with `size` entries spanning [0, 1]
+    inline float TableValue(std::size_t i, std::size_t size)
+    {
+        return size > 1 ? static_cast<float>(i) / static_cast<float>(size - 1) : 0.0f;
+    }
+
+    // Control point of a 1D transfer function at a windowed value in [0, 1]
+    struct TransferPoint
+    {
+        float value{0.0f};
+        Rgba color{};
+    };
+
+    // Piecewise linear transfer function over windowed values, constant past the end points
+    struct TransferFunction
+    {
+        std::vector<TransferPoint> points{};
+
+        // Keep the points ordered by value after editing them
+        void Sort()
+        {
+            std::stable_sort(points.begin(), points.end(), [](const auto &a, const auto &b) {
+                return a.value < b.value;
+            });
+        }
+
+        [[nodiscard]] Rgba Evaluate(float value) const
+        {
+            if (points.empty())
+            {
+                return {};
+            }
+            if (value <= points.front().value)
+            {
+                return points.front().color;
+            }
+            for (std::size_t i = 1; i < points.size(); ++i)
+            {
+                const TransferPoint &right = points[i];
+                if (value > right.value)
+                {
+                    continue;
+                }
+                const TransferPoint &left = points[i - 1];
+                const float span = right.value - left.value;
+                const float f = span > 0.0f ? (value - left.value) / span : 1.0f;
+                Rgba color{};
+                for (std::size_t channel = 0; channel < 4; ++channel)
+                {
+                    const float delta = right.color[channel] - left.color[channel];
+                    color[channel] = left.color[channel] + delta * f;
+                }
+                return color;
+            }
+            return points.back().color;
+        }
+
+        // Sample the function at `size` evenly spaced values, the first at 0 and the last at 1
+        [[nodiscard]] std::vector<Rgba> Bake(std::size_t size) const
+        {
+            std::vector<Rgba> table(size);
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                table[i] = Evaluate(TableValue(i, size));
+            }
+            return table;
+        }
+
+        [[nodiscard]] std::uint64_t Hash() const
+        {
+            StateHash hash;
+            for (const TransferPoint &point : points)
+            {
+                hash.Add(point.value).Add(point.color);
+            }
+            return hash.Value();
+        }
+    };
+
+    // Translucent soft tissue over opaque bone, for a window spanning roughly -200 to 1000 HU
+    inline TransferFunction TissuePreset()
+    {
+        return {{{0.0f, {0.0f, 0.0f, 0.0f, 0.0f}},
+                 {0.15f, {0.55f, 0.25f, 0.15f, 0.0f}},
+                 {0.25f, {0.85f, 0.45f, 0.35f, 0.02f}},
+                 {0.4f, {0.9f, 0.7f, 0.55f, 0.04f}},
+                 {0.55f, {1.0f, 0.95f, 0.85f, 0.3f}},
+                 {1.0f, {1.0f, 1.0f, 1.0f, 0.8f}}}};
+    }
+
+    // Triangle over windowed values (peak at center, zero at center +- width / 2) times a band of
+    // gradient magnitudes, both in [0, 1]
+    struct TransferWidget
+    {
+        float center{0.5f};
+        float width{0.2f};
+        float gradientLow{0.0f};
+        float gradientHigh{1.0f};
+        Rgba color{1.0f, 1.0f, 1.0f, 0.5f};
+    };
+
+    // 2D transfer function of valueSize x gradientSize entries, [gradient * valueSize + value].
+    // Overlapping widgets blend their colours by opacity.
+    inline std::vector<Rgba> BakeWidgets(const std::vector<TransferWidget> &widgets,
+                                         std::size_t valueSize,
+                                         std::size_t gradientSize)
+    {
+        std::vector<Rgba> table(valueSize * gradientSize);
+        for (std::size_t row = 0; row < gradientSize; ++row)
+        {
+            const float gradient = TableValue(row, gradientSize);
+            for (std::size_t column = 0; column < valueSize; ++column)
+            {
+                const float value = TableValue(column, valueSize);
+                float transparency = 1.0f;
+                float weight = 0.0f;
+                Rgba sum{};
+                for (const TransferWidget &widget : widgets)
+                {
+                    if (gradient < widget.gradientLow || gradient > widget.gradientHigh)
+                    {
+                        continue;
+                    }
+                    const float halfWidth = std::max(widget.width * 0.5f, 1e-6f);
+                    const float tent = 1.0f - std::abs(value - widget.center) / halfWidth;
+                    const float opacity = widget.color[3] * std::max(tent, 0.0f);
+                    transparency *= 1.0f - opacity;
+                    weight += opacity;
+                    for (std::size_t channel = 0; channel < 3; ++channel)
+                    {
+                        sum[channel] += widget.color[channel] * opacity;
+                    }
+                }
+                Rgba &entry = table[row * valueSize + column];
+                for (std::size_t channel = 0; channel < 3; ++channel)
+                {
+                    entry[channel] = weight > 0.0f ? sum[channel] / weight : 0.0f;
+                }
+                entry[3] = 1.0f - transparency;
+            }
+        }
+        return table;
+    }
+
+    // Highest opacity a table of rows x valueSize entries reaches for values in [low, high], used
+    // to decide whether a macrocell can contribute
+    inline float MaxOpacity(const std::vector<Rgba> &table,
+                            std::size_t valueSize,
+                            float low,
+                            float high)
+    {
+        if (valueSize == 0)
+        {
+            return 0.0f;
+        }
+        const auto last = static_cast<float>(valueSize - 1);
+        const float lowIndex = std::floor(std::clamp(low, 0.0f, 1.0f) * last);
+        const float highIndex = std::ceil(std::clamp(high, 0.0f, 1.0f) * last);
+        const auto first = static_cast<std::size_t>(lowIndex);
+        const auto end = static_cast<std::size_t>(highIndex) + 1;
+        float opacity = 0.0f;
+        for (std::size_t row = 0; row < table.size() / valueSize; ++row)
+        {
+            for (std::size_t column = first; column < end; ++column)
+            {
+                opacity = std::max(opacity, table[row * valueSize + column][3]);
+            }
+        }
+        return opacity;
+    }
+
+    // Opacity over `length` reference steps from the opacity over one step
+    inline float CorrectOpacity(float opacity, float length)
+    {
+        return 1.0f - std::pow(1.0f - std::min(opacity, 1.0f), length);
+    }
+
+    // Pre-integrated lookup table for ray segments of `length` reference steps whose value runs
+    // linearly from a front to a back sample, [back * size + front]. Entries hold the colour
+    // premultiplied by opacity and the opacity of the whole segment, so a coarse step still picks
+    // up thin features between its samples. Built from running integrals of extinction and of
+    // extinction weighted colour; attenuation inside a segment is neglected.
+    inline std::vector<Rgba> PreIntegrate(const std::vector<Rgba> &table, float length = 1.0f)
+    {
+        const std::size_t size = table.size();
+        std::vector<float> extinction(size);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            extinction[i] = -std::log(1.0f - std::min(table[i][3], 0.9999f));
+        }
+
+        // integral[i]: extinction (and emitted colour) from value 0 to value i, trapezoid rule
+        std::vector<std::array<double, 4>> integral(size);
+        for (std::size_t i = 1; i < size; ++i)
+        {
+            const double tauLeft = extinction[i - 1];
+            const double tauRight = extinction[i];
+            for (std::size_t channel = 0; channel < 3; ++channel)
+            {
+                const double emission =
+                    tauLeft * table[i - 1][channel] + tauRight * table[i][channel];
+                integral[i][channel] = integral[i - 1][channel] + 0.5 * emission;
+            }
+            integral[i][3] = integral[i - 1][3] + 0.5 * (tauLeft + tauRight);
+        }
+
+        std::vector<Rgba> segments(size * size);
+        for (std::size_t back = 0; back < size; ++back)
+        {
+            for (std::size_t front = 0; front < size; ++front)
+            {
+                Rgba &entry = segments[back * size + front];
+                const std::size_t low = std::min(front, back);
+                const std::size_t high = std::max(front, back);
+                const auto span = static_cast<double>(high - low);
+                const std::array<double, 4> &a = integral[low];
+                const std::array<double, 4> &b = integral[high];
+                const double tau = span > 0.0 ? (b[3] - a[3]) / span : extinction[front];
+                const double thickness = tau * static_cast<double>(length);
+                const auto opacity = static_cast<float>(1.0 - std::exp(-thickness));
+                for (std::size_t channel = 0; channel < 3; ++channel)
+                {
+                    // extinction weighted mean colour over the segment
+                    double chroma = table[front][channel];
+                    if (span > 0.0 && b[3] - a[3] > 1e-12)
+                    {
+                        chroma = (b[channel] - a[channel]) / (b[3] - a[3]);
+                    }
+                    else if (span > 0.0)
+                    {
+                        chroma = 0.5 * (table[front][channel] + table[back][channel]);
+                    }
+                    entry[channel] = static_cast<float>(chroma) * opacity;
+                }
+                entry[3] = opacity;
+            }
+        }
+        return segments;
+    }
+} // namespace VolumeUtils
+
+#endif // TRANSFER_FUNCTION_H
@@ -0,0 +1,193 @@
+#pragma once
+#ifndef VOLUME_H
+#define VOLUME_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace VolumeUtils
+{
+    // Memory layout of the voxels inside a Volume
+    enum class Layout
+    {
+        Linear,  // x fastest, then y, then z (what the GPU buffers expect)
+        Bricked, // kBrickSize^3 bricks stored one after another, Morton order inside a brick
+    };
+
+    // Dense 3D grid of voxels backed by a single contiguous allocation
+    template <typename T>
+    class Volume
+    {
+    public:
+        static constexpr int kBrickSize{8};
+        static constexpr int kBrickVoxels{kBrickSize * kBrickSize * kBrickSize};
+
+        Volume() = default;
+
+        Volume(int newWidth,
+               int newHeight,
+               int newDepth,
+               Layout newLayout = Layout::Linear,
+               std::array<float, 3> spacing = {1.F, 1.F, 1.F})
+            : voxelSpacing(spacing)
+        {
+            Resize(newWidth, newHeight, newDepth, newLayout);
+        }
+
+        // Reallocate the storage, all voxels are reset to T{}
+        void Resize(int newWidth, int newHeight, int newDepth, Layout newLayout = Layout::Linear)
+        {
+            width = newWidth;
+            height = newHeight;
+            depth = newDepth;
+            layout = newLayout;
+            bricksX = (width + kBrickSize - 1) / kBrickSize;
+            bricksY = (height + kBrickSize - 1) / kBrickSize;
+            bricksZ = (depth + kBrickSize - 1) / kBrickSize;
+
+            std::size_t storage = VoxelCount();
+            if (layout == Layout::Bricked)
+            {
+                storage = static_cast<std::size_t>(bricksX) * static_cast<std::size_t>(bricksY) *
+                          static_cast<std::size_t>(bricksZ) * kBrickVoxels;
+            }
+            data.assign(storage, T{});
+        }
+
+        void Clear()
+        {
+            width = height = depth = 0;
+            bricksX = bricksY = bricksZ = 0;
+            data.clear();
+            data.shrink_to_fit();
+        }
+
+        [[nodiscard]] int Width() const
+        {
+            return width;
+        }
+
+        [[nodiscard]] int Height() const
+        {
+            return height;
+        }
+
+        [[nodiscard]] int Depth() const
+        {
+            return depth;
+        }
+
+        [[nodiscard]] std::array<int, 3> Dimensions() const
+        {
+            return {width, height, depth};
+        }
+
+        // Physical size of a voxel along each axis (e.g. millimetres)
+        [[nodiscard]] const std::array<float, 3> &Spacing() const
+        {
+            return voxelSpacing;
+        }
+
+        void SetSpacing(std::array<float, 3> spacing)
+        {
+            voxelSpacing = spacing;
+        }
+
+        [[nodiscard]] Layout GetLayout() const
+        {
+            return layout;
+        }
+
+        [[nodiscard]] bool Empty() const
+        {
+            return data.empty();
+        }
+
+        // Number of addressable voxels (width * height * depth)
+        [[nodiscard]] std::size_t VoxelCount() const
+        {
+            return static_cast<std::size_t>(width) * static_cast<std::size_t>(height) *
+                   static_cast<std::size_t>(depth);
+        }
+
+        // Bytes actually allocated, including brick padding
+        [[nodiscard]] std::size_t SizeInBytes() const
+        {
+            return data.size() * sizeof(T);
+        }
+
+        [[nodiscard]] T *Data()
+        {
+            return data.data();
+        }
+
+        [[nodiscard]] const T *Data() const
+        {
+            return data.data();
+        }
+
+        [[nodiscard]] bool Contains(int x, int y, int z) const
+        {
+            return x >= 0 && x < width && y >= 0 && y < height && z >= 0 && z < depth;
+        }
+
+        // Offset of voxel (x, y, z) inside Data(), coordinates must be in range
+        [[nodiscard]] std::size_t Index(int x, int y, int z) const
+        {
+            if (layout == Layout::Linear)
+            {
+                return static_cast<std::size_t>(x) +
+                       static_cast<std::size_t>(width) *
+                           (static_cast<std::size_t>(y) +
+                            static_cast<std::size_t>(height) * static_cast<std::size_t>(z));
+            }
+
+            const auto brick = static_cast<std::size_t>(x / kBrickSize) +
+                               static_cast<std::size_t>(bricksX) *
+                                   (static_cast<std::size_t>(y / kBrickSize) +
+                                    static_cast<std::size_t>(bricksY) *
+                                        static_cast<std::size_t>(z / kBrickSize));
+            return brick * kBrickVoxels + MortonOffset(x % kBrickSize, y % kBrickSize, z % kBrickSize);
+        }
+
+        [[nodiscard]] T &operator()(int x, int y, int z)
+        {
+            return data[Index(x, y, z)];
+        }
+
+        [[nodiscard]] const T &operator()(int x, int y, int z) const
+        {
+            return data[Index(x, y, z)];
+        }
+
+        void Fill(T value)
+        {
+            std::fill(data.begin(), data.end(), value);
+        }
+
+    private:
+        // Interleave the bits of three 3-bit brick-local coordinates (zyx zyx zyx)
+        static std::size_t MortonOffset(int x, int y, int z)
+        {
+            static constexpr std::array<std::uint16_t, kBrickSize> kSpread{0, 1, 8, 9, 64, 65, 72, 73};
+            return static_cast<std::size_t>(kSpread[static_cast<std::size_t>(x)] |
+                                            (kSpread[static_cast<std::size_t>(y)] << 1U) |
+                                            (kSpread[static_cast<std::size_t>(z)] << 2U));
+        }
+
+        int width{0};
+        int height{0};
+        int depth{0};
+        int bricksX{0};
+        int bricksY{0};
+        int bricksZ{0};
+        Layout layout{Layout::Linear};
+        std::array<float, 3> voxelSpacing{1.F, 1.F, 1.F};
+        std::vector<T> data{};
+    };
+} // namespace VolumeUtils
+
+#endif // VOLUME_H
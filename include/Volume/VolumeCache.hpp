@@ -0,0 +1,389 @@
+#pragma once
+#ifndef VOLUME_CACHE_H
+#define VOLUME_CACHE_H
+
+#include "Volume/GradientVolume.hpp"
+#include "Volume/MacrocellGrid.hpp"
+#include "Volume/MappedFile.hpp"
+#include "Volume/Volume.hpp"
+#include "Volume/Window.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+namespace VolumeUtils
+{
+    // Preprocessed volume on disk, so a series reloads without parsing a single DICOM file:
+    //   header | section table | sections, each starting on a kCacheAlignment boundary
+    // Sections hold voxels exactly as the Volume stores them (native byte order) plus a checksum,
+    // so loading is a copy out of the mapping. A file of another version, byte order or key is
+    // stale and rebuilt.
+    inline constexpr std::uint32_t kCacheVersion{1};
+    inline constexpr std::uint32_t kCacheByteOrder{0x01020304};
+    inline constexpr std::size_t kCacheAlignment{4096};
+    inline constexpr std::array<char, 8> kCacheMagic{'D', 'V', 'R', 'C', 'A', 'C', 'H', 'E'};
+
+    enum class CacheSection : std::uint32_t
+    {
+        Volume = 1,     // stored values, int16
+        Mask = 2,       // labels, uint8
+        Gradients = 3,  // PackedGradient, the header holds the largest magnitude
+        Macrocells = 4, // MacrocellGrid<int16_t> cells, x fastest
+    };
+
+    struct CacheSectionEntry
+    {
+        std::uint32_t type{0};
+        std::uint32_t elementSize{0}; // bytes per voxel or cell
+        std::uint32_t layout{0};      // Layout of a volume section
+        std::int32_t cellSize{0};     // macrocell edge in voxels
+        std::array<std::int32_t, 3> dims{};
+        std::uint32_t reserved{0};
+        std::uint64_t offset{0}; // from the start of the file
+        std::uint64_t size{0};   // in bytes
+        std::uint64_t checksum{0};
+    };
+
+    struct VolumeCacheHeader
+    {
+        std::array<char, 8> magic{};
+        std::uint32_t version{0};
+        std::uint32_t byteOrder{0};
+        std::uint64_t key{0}; // of the source files, a mismatch means they changed
+        std::array<std::int32_t, 3> dims{};
+        std::array<float, 3> spacing{};
+        Rescale rescale{};
+        std::int16_t minValue{0}; // stored range of the volume
+        std::int16_t maxValue{0};
+        float gradientMaxMagnitude{0.0f};
+        std::array<char, 64> seriesUID{};
+        std::uint32_t sectionCount{0};
+        std::uint32_t reserved{0};
+    };
+
+    static_assert(std::is_trivially_copyable_v<VolumeCacheHeader>, "the header is written as bytes");
+    static_assert(std::is_trivially_copyable_v<CacheSectionEntry>, "entries are written as bytes");
+
+    // 64-bit checksum of a section, four independent lanes of eight bytes so checking a volume
+    // runs at about the speed of copying it
+    inline std::uint64_t CacheChecksum(const unsigned char *data, std::size_t size)
+    {
+        constexpr std::uint64_t kPrime{0x100000001B3ULL};
+        std::array<std::uint64_t, 4> lanes{0x9E3779B97F4A7C15ULL ^ size, 0xC2B2AE3D27D4EB4FULL,
+                                           0x165667B19E3779F9ULL, 0x27D4EB2F165667C5ULL};
+        std::size_t i = 0;
+        for (; i + 32 <= size; i += 32)
+        {
+            for (std::size_t lane = 0; lane < 4; ++lane)
+            {
+                std::uint64_t word;
+                std::memcpy(&word, data + i + 8 * lane, sizeof(word));
+                lanes[lane] = (lanes[lane] ^ word) * kPrime;
+                lanes[lane] ^= lanes[lane] >> 29U;
+            }
+        }
+        std::uint64_t hash = lanes[0] ^ (lanes[1] << 1U) ^ (lanes[2] << 2U) ^ (lanes[3] << 3U);
+        for (; i < size; ++i)
+        {
+            hash = (hash ^ data[i]) * kPrime;
+        }
+        return hash ^ (hash >> 32U);
+    }
+
+    // What goes into a cache file, everything but the volume is optional
+    struct VolumeCacheContents
+    {
+        std::uint64_t key{0};
+        std::string seriesUID{};
+        Rescale rescale{};
+        const Volume<std::int16_t> *volume{nullptr};
+        const Volume<std::uint8_t> *mask{nullptr};
+        const GradientVolume *gradients{nullptr};
+        const MacrocellGrid<std::int16_t> *macrocells{nullptr};
+    };
+
+    // Write a cache file through a temporary one renamed into place, so a reader never maps half
+    // a file. Returns false if it could not be written.
+    inline bool WriteVolumeCache(const std::string &path, const VolumeCacheContents &contents)
+    {
+        if (contents.volume == nullptr || contents.volume->Empty())
+        {
+            return false;
+        }
+        const Volume<std::int16_t> &volume = *contents.volume;
+
+        VolumeCacheHeader header;
+        header.magic = kCacheMagic;
+        header.version = kCacheVersion;
+        header.byteOrder = kCacheByteOrder;
+        header.key = contents.key;
+        header.dims = volume.Dimensions();
+        header.spacing = volume.Spacing();
+        header.rescale = contents.rescale;
+        std::copy_n(contents.seriesUID.begin(),
+                    std::min(contents.seriesUID.size(), header.seriesUID.size() - 1),
+                    header.seriesUID.begin());
+        if (volume.GetLayout() == Layout::Linear)
+        {
+            const auto range = std::minmax_element(volume.Data(), volume.Data() + volume.VoxelCount());
+            header.minValue = *range.first;
+            header.maxValue = *range.second;
+        }
+        else
+        {
+            header.minValue = header.maxValue = volume(0, 0, 0);
+            for (int z = 0; z < volume.Depth(); ++z)
+                for (int y = 0; y < volume.Height(); ++y)
+                    for (int x = 0; x < volume.Width(); ++x)
+                    {
+                        header.minValue = std::min(header.minValue, volume(x, y, z));
+                        header.maxValue = std::max(header.maxValue, volume(x, y, z));
+                    }
+        }
+
+        std::vector<CacheSectionEntry> sections;
+        std::vector<const void *> payloads;
+        const auto addVolume = [&](CacheSection type, const auto &source) {
+            CacheSectionEntry entry;
+            entry.type = static_cast<std::uint32_t>(type);
+            entry.elementSize = static_cast<std::uint32_t>(source.SizeInBytes() / std::max<std::size_t>(source.VoxelCount(), 1));
+            entry.layout = static_cast<std::uint32_t>(source.GetLayout());
+            entry.dims = source.Dimensions();
+            entry.size = source.SizeInBytes();
+            sections.push_back(entry);
+            payloads.push_back(source.Data());
+        };
+        addVolume(CacheSection::Volume, volume);
+        if (contents.mask != nullptr && !contents.mask->Empty())
+        {
+            addVolume(CacheSection::Mask, *contents.mask);
+        }
+        if (contents.gradients != nullptr && !contents.gradients->Empty())
+        {
+            addVolume(CacheSection::Gradients, contents.gradients->gradients);
+            header.gradientMaxMagnitude = contents.gradients->maxMagnitude;
+        }
+        if (contents.macrocells != nullptr && !contents.macrocells->Empty())
+        {
+            using Cell = MacrocellGrid<std::int16_t>::Cell;
+            CacheSectionEntry entry;
+            entry.type = static_cast<std::uint32_t>(CacheSection::Macrocells);
+            entry.elementSize = sizeof(Cell);
+            entry.cellSize = contents.macrocells->CellSize();
+            entry.dims = contents.macrocells->Dimensions();
+            entry.size = contents.macrocells->Cells().size() * sizeof(Cell);
+            sections.push_back(entry);
+            payloads.push_back(contents.macrocells->Cells().data());
+        }
+
+        header.sectionCount = static_cast<std::uint32_t>(sections.size());
+        std::uint64_t offset = sizeof(header) + sections.size() * sizeof(CacheSectionEntry);
+        for (std::size_t i = 0; i < sections.size(); ++i)
+        {
+            offset = (offset + kCacheAlignment - 1) / kCacheAlignment * kCacheAlignment;
+            sections[i].offset = offset;
+            sections[i].checksum = CacheChecksum(static_cast<const unsigned char *>(payloads[i]), sections[i].size);
+            offset += sections[i].size;
+        }
+
+        const std::string temporary = path + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char *>(sections.data()),
+                      static_cast<std::streamsize>(sections.size() * sizeof(CacheSectionEntry)));
+            const std::vector<char> padding(kCacheAlignment, 0);
+            for (std::size_t i = 0; i < sections.size() && out; ++i)
+            {
+                const auto position = static_cast<std::uint64_t>(out.tellp());
+                out.write(padding.data(), static_cast<std::streamsize>(sections[i].offset - position));
+                out.write(static_cast<const char *>(payloads[i]), static_cast<std::streamsize>(sections[i].size));
+            }
+            if (!out)
+            {
+                std::error_code ignored;
+                std::filesystem::remove(temporary, ignored);
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temporary, path, error);
+        if (error)
+        {
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+        return true;
+    }
+
+    // A cache file mapped into memory and checked against the expected key. Sections are copied
+    // out on request and only then checksummed, so unused ones cost nothing.
+    class VolumeCacheFile
+    {
+    public:
+        // Map and validate the header and section table, false (and closed) if the file is
+        // missing, of another version or byte order, stale, truncated or its table is damaged
+        bool Open(const std::string &path, std::uint64_t key)
+        {
+            Close();
+            if (!file.Open(path) || file.Size() < sizeof(VolumeCacheHeader))
+            {
+                Close();
+                return false;
+            }
+            std::memcpy(&header, file.Data(), sizeof(header));
+            const std::size_t tableEnd =
+                sizeof(header) + static_cast<std::size_t>(header.sectionCount) * sizeof(CacheSectionEntry);
+            if (header.magic != kCacheMagic || header.version != kCacheVersion ||
+                header.byteOrder != kCacheByteOrder || header.key != key || header.sectionCount > 16 ||
+                file.Size() < tableEnd)
+            {
+                Close();
+                return false;
+            }
+            sections.resize(header.sectionCount);
+            std::memcpy(sections.data(), file.Data() + sizeof(header), tableEnd - sizeof(header));
+            for (const CacheSectionEntry &entry : sections)
+            {
+                if (entry.offset > file.Size() || entry.size > file.Size() - entry.offset || !Consistent(entry))
+                {
+                    Close();
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void Close()
+        {
+            file.Close();
+            header = {};
+            sections.clear();
+        }
+
+        [[nodiscard]] bool IsOpen() const
+        {
+            return file.IsOpen();
+        }
+
+        [[nodiscard]] const VolumeCacheHeader &Header() const
+        {
+            return header;
+        }
+
+        [[nodiscard]] bool Has(CacheSection section) const
+        {
+            return Find(section) != nullptr;
+        }
+
+        // Copy a volume section out, false if it is absent, of another voxel type or damaged
+        template <typename T>
+        bool Read(CacheSection section, Volume<T> &volume) const
+        {
+            const CacheSectionEntry *entry = Find(section);
+            if (entry == nullptr || entry->elementSize != sizeof(T) || !Intact(*entry))
+            {
+                return false;
+            }
+            Volume<T> copy(entry->dims[0], entry->dims[1], entry->dims[2], static_cast<Layout>(entry->layout),
+                           header.spacing);
+            if (copy.SizeInBytes() != entry->size)
+            {
+                return false;
+            }
+            std::memcpy(static_cast<void *>(copy.Data()), file.Data() + entry->offset, entry->size);
+            volume = std::move(copy);
+            return true;
+        }
+
+        bool Read(GradientVolume &gradients) const
+        {
+            if (!Read(CacheSection::Gradients, gradients.gradients))
+            {
+                return false;
+            }
+            gradients.maxMagnitude = header.gradientMaxMagnitude;
+            return true;
+        }
+
+        bool Read(MacrocellGrid<std::int16_t> &macrocells) const
+        {
+            using Cell = MacrocellGrid<std::int16_t>::Cell;
+            const CacheSectionEntry *entry = Find(CacheSection::Macrocells);
+            if (entry == nullptr || entry->elementSize != sizeof(Cell) || entry->size % sizeof(Cell) != 0 ||
+                !Intact(*entry))
+            {
+                return false;
+            }
+            std::vector<Cell> cells(entry->size / sizeof(Cell));
+            std::memcpy(static_cast<void *>(cells.data()), file.Data() + entry->offset, entry->size);
+            return macrocells.Assign(entry->dims, entry->cellSize, std::move(cells));
+        }
+
+    private:
+        // Whether the dimensions, layout and element size of an entry account for exactly its
+        // size, so nothing is allocated from a damaged table. Divides instead of multiplying
+        // the dimensions, which cannot overflow.
+        [[nodiscard]] static bool Consistent(const CacheSectionEntry &entry)
+        {
+            constexpr int kBrick = Volume<std::uint8_t>::kBrickSize;
+            const bool macrocells = entry.type == static_cast<std::uint32_t>(CacheSection::Macrocells);
+            if (entry.elementSize == 0 || entry.layout > static_cast<std::uint32_t>(Layout::Bricked) ||
+                (macrocells && (entry.cellSize <= 0 || entry.layout != 0)) || entry.size % entry.elementSize != 0)
+            {
+                return false;
+            }
+            std::uint64_t count = entry.size / entry.elementSize;
+            for (const std::int32_t dim : entry.dims)
+            {
+                if (dim <= 0)
+                {
+                    return false;
+                }
+                auto extent = static_cast<std::uint64_t>(dim);
+                if (static_cast<Layout>(entry.layout) == Layout::Bricked)
+                {
+                    extent = (extent + kBrick - 1) / kBrick * kBrick;
+                }
+                if (count % extent != 0)
+                {
+                    return false;
+                }
+                count /= extent;
+            }
+            return count == 1;
+        }
+
+        [[nodiscard]] const CacheSectionEntry *Find(CacheSection section) const
+        {
+            for (const CacheSectionEntry &entry : sections)
+            {
+                if (entry.type == static_cast<std::uint32_t>(section))
+                {
+                    return &entry;
+                }
+            }
+            return nullptr;
+        }
+
+        [[nodiscard]] bool Intact(const CacheSectionEntry &entry) const
+        {
+            return CacheChecksum(file.Data() + entry.offset, entry.size) == entry.checksum;
+        }
+
+        MappedFile file{};
+        VolumeCacheHeader header{};
+        std::vector<CacheSectionEntry> sections{};
+    };
+} // namespace VolumeUtils
+
+#endif // VOLUME_CACHE_H
@@ -0,0 +1,78 @@
+#pragma once
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include "Volume/Volume.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace VolumeUtils
+{
+    // Stored pixel values to Hounsfield units: hu = stored * slope + offset
+    // (DICOM RescaleSlope / RescaleIntercept)
+    struct Rescale
+    {
+        float slope{1.0f};
+        float offset{0.0f};
+    };
+
+    // Display window in Hounsfield units, [center - width / 2, center + width / 2] maps to [0, 1]
+    struct Window
+    {
+        float center{40.0f};
+        float width{400.0f};
+    };
+
+    struct WindowPreset
+    {
+        const char *name;
+        Window window;
+    };
+
+    inline constexpr std::array<WindowPreset, 4> kWindowPresets{{{"Soft tissue", {40.0f, 400.0f}},
+                                                                {"Bone", {400.0f, 1800.0f}},
+                                                                {"Lung", {-600.0f, 1500.0f}},
+                                                                {"Brain", {40.0f, 80.0f}}}};
+
+    // Rescale and window folded into one multiply-add from stored values to [0, 1]
+    struct WindowMapping
+    {
+        float scale{1.0f};
+        float bias{0.0f};
+
+        [[nodiscard]] float operator()(float stored) const
+        {
+            return std::clamp(stored * scale + bias, 0.0f, 1.0f);
+        }
+    };
+
+    inline WindowMapping MapWindow(const Window &window, const Rescale &rescale = {})
+    {
+        const float width = std::max(window.width, 1.0f);
+        const float low = window.center - width * 0.5f;
+        return {rescale.slope / width, (rescale.offset - low) / width};
+    }
+
+    // 8-bit copy of a volume with the window applied, for modes bound by memory bandwidth. It has
+    // to be rebuilt whenever the window changes.
+    template <typename T>
+    Volume<std::uint8_t> QuantizeWindow(const Volume<T> &volume, const WindowMapping &mapping)
+    {
+        Volume<std::uint8_t> quantized(
+            volume.Width(), volume.Height(), volume.Depth(), volume.GetLayout(), volume.Spacing());
+        const std::size_t count = volume.SizeInBytes() / sizeof(T);
+        const T *source = volume.Data();
+        std::uint8_t *target = quantized.Data();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const float value = mapping(static_cast<float>(source[i]));
+            target[i] = static_cast<std::uint8_t>(value * 255.0f + 0.5f);
+        }
+        return quantized;
+    }
+} // namespace VolumeUtils
+
+#endif // WINDOW_H
@@ -49,7 +49,6 @@ inline constexpr int kTextPositionY{40};
 inline constexpr int kTextFontSize{24};
 inline constexpr int kFPSPositionX{10};
 inline constexpr int kFPSPositionY{10};
-inline constexpr int kOMPThreads{8};
 } // namespace constants
 
 #endif
@@ -0,0 +1,621 @@
+// Headless benchmark of the ray casters. Fixed camera paths are rendered through synthetic volumes
+// by the CPU packet kernel of DVR_CPU (and, with --gpu, by the compute shader of DVR_GPU in a
+// hidden window); rays/s, samples/s and thread scaling are written as JSON.
+#include "external/glad.h"
+#include "Profiler/Json.hpp"
+#include "Scheduler/TileScheduler.hpp"
+#include "Simd/Simd.hpp"
+#include "Volume/FrameCache.hpp"
+#include "Volume/MacrocellGrid.hpp"
+#include "Volume/PacketTracer.hpp"
+#include "Volume/Phantoms.hpp"
+#include "Volume/RayCamera.hpp"
+#include "Volume/Series.hpp"
+#include "Volume/TransferFunction.hpp"
+#include "Volume/Volume.hpp"
+#include "Volume/Window.hpp"
+#include "raylib.h"
+#include "rlgl.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct BenchOptions
+{
+    std::vector<int> sizes{64, 128, 256, 512};
+    std::vector<std::string> volumes{"checker", "random", "phantom"};
+    std::vector<int> threads{}; // thread counts of the scaling sweep, empty: powers of two up to every core
+    int scalingSize{128};       // phantom the scaling sweep renders
+    int frames{8};
+    int width{512};
+    int height{512};
+    std::string cameraPath{}; // recorded path, empty: an orbit
+    std::string output{};     // JSON file, empty: stdout
+    bool gpu{false};
+};
+
+BenchOptions Options;
+
+constexpr float kFovy = 45.0f;
+constexpr float kCpuVoxel = 1.0f;   // world size of a voxel in DVR_CPU
+constexpr float kGpuVoxel = 0.125f; // and in DVR_GPU
+constexpr int kTransferSize = 256;
+// the phantom is in HU, this window spreads air to bone over the 8 bits of the CPU volume
+const VolumeUtils::Window kPhantomWindow{100.0f, 2200.0f};
+// DVR_CPU's window over 8-bit voxel values, the whole range
+const VolumeUtils::Window kVoxelWindow{127.5f, 255.0f};
+
+// camera positions and targets in units of half the volume edge, up vectors as they are
+struct CameraPose
+{
+    VolumeUtils::Vec3 position{};
+    VolumeUtils::Vec3 target{};
+    VolumeUtils::Vec3 up{0.0f, 1.0f, 0.0f};
+};
+
+// frame times of one camera path through one volume
+struct RunResult
+{
+    std::string device{};
+    std::string volume{};
+    int size{0};
+    std::string traversal{};
+    std::string simd{};
+    int threads{0};
+    std::vector<double> frameMilliseconds{};
+    std::vector<double> gpuMilliseconds{}; // of the dispatch alone, from timer queries
+    uint64_t samples{0};                   // 0 when the renderer does not count them
+    uint64_t checksum{0};
+};
+
+void processArgs(int argc, char *argv[]);
+
+std::vector<CameraPose> cameraPath();
+
+VolumeUtils::Volume<uint8_t> makeCpuVolume(const std::string &name, int size);
+
+RunResult renderCpu(const std::string &name, const VolumeUtils::Volume<uint8_t> &volume, bool dda,
+                    int threadCount, const std::vector<CameraPose> &path);
+
+std::vector<RunResult> renderGpu(const std::vector<CameraPose> &path);
+
+void writeJson(std::ostream &out, const std::vector<RunResult> &runs, const std::vector<RunResult> &scaling);
+
+int main(int argc, char *argv[])
+{
+    processArgs(argc, argv);
+    const std::vector<CameraPose> path = cameraPath();
+    const int hardwareThreads = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1U));
+
+    std::vector<RunResult> runs;
+    for (const std::string &name : Options.volumes)
+    {
+        for (const int size : Options.sizes)
+        {
+            const VolumeUtils::Volume<uint8_t> volume = makeCpuVolume(name, size);
+            for (const bool dda : {true, false})
+                runs.push_back(renderCpu(name, volume, dda, hardwareThreads, path));
+        }
+    }
+
+    // the same phantom on 1, 2, 4, ... threads
+    std::vector<int> threadCounts = Options.threads;
+    if (threadCounts.empty())
+    {
+        for (int count = 1; count < hardwareThreads; count *= 2)
+            threadCounts.push_back(count);
+        threadCounts.push_back(hardwareThreads);
+    }
+    std::vector<RunResult> scaling;
+    const VolumeUtils::Volume<uint8_t> phantom = makeCpuVolume("phantom", Options.scalingSize);
+    for (const bool dda : {true, false})
+        for (const int count : threadCounts)
+            scaling.push_back(renderCpu("phantom", phantom, dda, count, path));
+
+    if (Options.gpu)
+    {
+        const std::vector<RunResult> gpuRuns = renderGpu(path);
+        runs.insert(runs.end(), gpuRuns.begin(), gpuRuns.end());
+    }
+
+    if (Options.output.empty())
+    {
+        writeJson(std::cout, runs, scaling);
+        return 0;
+    }
+    std::ofstream out(Options.output);
+    writeJson(out, runs, scaling);
+    if (!out)
+        throw std::runtime_error("Could not write " + Options.output);
+    std::cerr << "Results: " << Options.output << "\n";
+    return 0;
+}
+
+void processArgs(int argc, char *argv[])
+{
+    const auto parseList = [](const std::string &list) {
+        std::vector<int> values;
+        std::stringstream stream(list);
+        for (std::string value; std::getline(stream, value, ',');)
+            values.push_back(std::stoi(value));
+        return values;
+    };
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--sizes" && hasValue)
+            Options.sizes = parseList(argv[++i]);
+        else if (arg == "--volumes" && hasValue)
+        {
+            Options.volumes.clear();
+            std::stringstream stream(argv[++i]);
+            for (std::string name; std::getline(stream, name, ',');)
+                Options.volumes.push_back(name);
+        }
+        else if (arg == "--threads" && hasValue)
+            Options.threads = parseList(argv[++i]);
+        else if (arg == "--scaling-size" && hasValue)
+            Options.scalingSize = std::stoi(argv[++i]);
+        else if (arg == "--frames" && hasValue)
+            Options.frames = std::max(std::stoi(argv[++i]), 1);
+        else if (arg == "--resolution" && hasValue)
+        {
+            const std::vector<int> resolution = parseList(argv[++i]);
+            if (resolution.size() != 2 || resolution[0] <= 0 || resolution[1] <= 0)
+                throw std::runtime_error("--resolution expects WIDTH,HEIGHT");
+            Options.width = resolution[0];
+            Options.height = resolution[1];
+        }
+        else if (arg == "--camera-path" && hasValue)
+            Options.cameraPath = argv[++i];
+        else if (arg == "--output" && hasValue)
+            Options.output = argv[++i];
+        else if (arg == "--gpu")
+            Options.gpu = true;
+        else
+            throw std::runtime_error(
+                "Usage: ./DVR_Bench [--sizes 64,128,256,512] [--volumes checker,random,phantom] [--frames N] "
+                "[--resolution W,H] [--threads 1,2,4] [--scaling-size N] [--camera-path FILE] [--output FILE] "
+                "[--gpu]\n");
+    }
+    for (const std::string &name : Options.volumes)
+        if (name != "checker" && name != "random" && name != "phantom")
+            throw std::runtime_error("Unknown volume " + name + ", expected checker, random or phantom");
+}
+
+std::vector<CameraPose> cameraPath()
+{
+    std::vector<CameraPose> path;
+    if (Options.cameraPath.empty())
+    {
+        // a full turn around the volume, 20 degrees above it, framing its bounding sphere
+        const float distance = std::sqrt(3.0f) / std::tan(kFovy * 0.5f * PI / 180.0f);
+        for (int frame = 0; frame < Options.frames; ++frame)
+        {
+            const float yaw = 2.0f * PI * static_cast<float>(frame) / static_cast<float>(Options.frames);
+            const float pitch = 20.0f * PI / 180.0f;
+            CameraPose pose;
+            pose.position = {distance * std::cos(pitch) * std::sin(yaw), distance * std::sin(pitch),
+                             -distance * std::cos(pitch) * std::cos(yaw)};
+            path.push_back(pose);
+        }
+        return path;
+    }
+
+    // one pose per line: position, target and up, nine numbers; '#' starts a comment
+    std::ifstream file(Options.cameraPath);
+    if (!file)
+        throw std::runtime_error("Could not open camera path " + Options.cameraPath);
+    for (std::string line; std::getline(file, line);)
+    {
+        line = line.substr(0, line.find('#'));
+        std::stringstream stream(line);
+        CameraPose pose;
+        if (stream >> pose.position[0] >> pose.position[1] >> pose.position[2] >> pose.target[0] >>
+            pose.target[1] >> pose.target[2] >> pose.up[0] >> pose.up[1] >> pose.up[2])
+            path.push_back(pose);
+    }
+    if (path.empty())
+        throw std::runtime_error("No camera poses in " + Options.cameraPath);
+    Options.frames = static_cast<int>(path.size());
+    return path;
+}
+
+VolumeUtils::Volume<uint8_t> makeCpuVolume(const std::string &name, int size)
+{
+    auto start = std::chrono::steady_clock::now();
+    VolumeUtils::Volume<uint8_t> volume(size, size, size, VolumeUtils::Layout::Bricked);
+    if (name == "checker")
+        VolumeUtils::FillChecker(volume);
+    else if (name == "random")
+        VolumeUtils::FillRandom(volume, 255, 12345);
+    else
+        volume = VolumeUtils::QuantizeWindow(VolumeUtils::MakeCtPhantom(size, VolumeUtils::Layout::Bricked),
+                                             VolumeUtils::MapWindow(kPhantomWindow));
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cerr << "Volume: " << name << " " << size << "^3 (" << elapsed.count() << " ms)\n";
+    return volume;
+}
+
+// image of a camera pose, the volume centred on the origin with edges of 2 * halfEdge world units
+VolumeUtils::RayCamera poseCamera(const CameraPose &pose, float halfEdge)
+{
+    const auto scaled = [halfEdge](const VolumeUtils::Vec3 &v) {
+        return VolumeUtils::Vec3{v[0] * halfEdge, v[1] * halfEdge, v[2] * halfEdge};
+    };
+    return VolumeUtils::MakeRayCamera(scaled(pose.position), scaled(pose.target), pose.up, kFovy, false,
+                                      Options.width, Options.height);
+}
+
+RunResult renderCpu(const std::string &name, const VolumeUtils::Volume<uint8_t> &volume, bool dda,
+                    int threadCount, const std::vector<CameraPose> &path)
+{
+    // classified the way DVR_CPU does: density for the test patterns, the tissue transfer function
+    // (pre-integrated) for the phantom
+    VolumeUtils::PacketSettings settings;
+    const VolumeUtils::WindowMapping mapping = VolumeUtils::MapWindow(kVoxelWindow);
+    VolumeUtils::MacrocellGrid<uint8_t> macrocells;
+    macrocells.Build(volume);
+    const bool phantom = name == "phantom";
+    if (phantom)
+    {
+        const VolumeUtils::TransferFunction transfer = VolumeUtils::TissuePreset();
+        settings.SetTransferFunction(transfer, mapping, 1.0f, true);
+        const std::vector<VolumeUtils::Rgba> table = transfer.Bake(kTransferSize);
+        macrocells.UpdateOccupancy([&](const VolumeUtils::MacrocellGrid<uint8_t>::Cell &cell) {
+            return VolumeUtils::MaxOpacity(table, kTransferSize, mapping(static_cast<float>(cell.minValue)),
+                                           mapping(static_cast<float>(cell.maxValue))) > 0.0f;
+        });
+    }
+    else
+    {
+        settings.SetDensity(1.0f, mapping);
+        macrocells.UpdateOccupancy([&](const VolumeUtils::MacrocellGrid<uint8_t>::Cell &cell) {
+            return mapping(static_cast<float>(cell.maxValue)) > 0.0f;
+        });
+    }
+    settings.volume = &volume;
+    settings.macrocells = &macrocells;
+    settings.dda = dda;
+    settings.trilinear = !dda;
+    settings.voxelSize = VolumeUtils::VoxelSize(volume.Spacing(), kCpuVoxel);
+    settings.stepSize = 0.1f;
+
+    RunResult result;
+    result.device = "cpu";
+    result.volume = name;
+    result.size = volume.Width();
+    result.traversal = dda ? "dda" : "fixed";
+    result.simd = Simd::LevelName(Simd::DetectLevel());
+    result.threads = threadCount;
+
+    Scheduler::TileScheduler scheduler(threadCount);
+    std::vector<uint8_t> pixels(static_cast<size_t>(Options.width) * static_cast<size_t>(Options.height) * 4);
+    const float halfEdge = static_cast<float>(volume.Width()) * 0.5f * kCpuVoxel;
+    // the first frame is traced twice, once untimed to warm the caches and the tile order
+    for (int frame = -1; frame < Options.frames; ++frame)
+    {
+        const CameraPose &pose = path[static_cast<size_t>(std::max(frame, 0)) % path.size()];
+        const VolumeUtils::RayCamera camera = poseCamera(pose, halfEdge);
+        std::atomic<uint64_t> samples{0};
+        auto start = std::chrono::steady_clock::now();
+        scheduler.Run(Options.width, Options.height, [&](const Scheduler::Tile &tile) {
+            uint64_t tileSamples = 0;
+            VolumeUtils::RenderTile(Simd::DetectLevel(), camera, settings, tile.x0, tile.y0, tile.x1, tile.y1,
+                                    pixels.data(), {}, &tileSamples);
+            samples += tileSamples;
+        });
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if (frame < 0)
+            continue;
+        result.frameMilliseconds.push_back(elapsed.count());
+        result.samples += samples;
+    }
+    VolumeUtils::StateHash hash;
+    for (const uint8_t byte : pixels)
+        hash.Add(byte);
+    result.checksum = hash.Value();
+
+    const double total = std::accumulate(result.frameMilliseconds.begin(), result.frameMilliseconds.end(), 0.0);
+    std::cerr << "CPU: " << name << " " << result.size << "^3 " << result.traversal << " on " << threadCount
+              << " threads: " << total / Options.frames << " ms/frame\n";
+    return result;
+}
+
+// Upload a volume as a 3D texture the way DVR_GPU does, stored values as R16_SNORM and mask labels
+// as R8UI
+template <typename T>
+unsigned int loadVolumeTexture(const VolumeUtils::Volume<T> &volume)
+{
+    constexpr bool wide = std::is_same_v<T, int16_t>;
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_3D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage3D(GL_TEXTURE_3D, 0, wide ? GL_R16_SNORM : GL_R8UI, volume.Width(), volume.Height(), volume.Depth(),
+                 0, wide ? GL_RED : GL_RED_INTEGER, wide ? GL_SHORT : GL_UNSIGNED_BYTE, volume.Data());
+    const GLint filter = wide ? GL_LINEAR : GL_NEAREST;
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    return texture;
+}
+
+unsigned int loadTransferTable(int width, int height, const std::vector<VolumeUtils::Rgba> &table)
+{
+    const GLenum target = height == 1 ? GL_TEXTURE_1D : GL_TEXTURE_2D;
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(target, texture);
+    if (target == GL_TEXTURE_1D)
+        glTexImage1D(target, 0, GL_RGBA16F, width, 0, GL_RGBA, GL_FLOAT, table.data());
+    else
+        glTexImage2D(target, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, table.data());
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(target, 0);
+    return texture;
+}
+
+std::vector<RunResult> renderGpu(const std::vector<CameraPose> &path)
+{
+    // a hidden window for the GL context, nothing is ever presented; raylib logs to stdout, where
+    // the JSON goes
+    SetTraceLogLevel(LOG_ERROR);
+    SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    InitWindow(Options.width, Options.height, "DVR_Bench");
+    char *source = LoadFileText(ASSETS_PATH "shaders/ray_cast.comp");
+    const unsigned int shader = rlCompileShader(source, RL_COMPUTE_SHADER);
+    const unsigned int program = rlLoadComputeShaderProgram(shader);
+    UnloadFileText(source);
+
+    // the RGBA8 image DVR_GPU draws
+    GLuint frameTexture = 0;
+    glGenTextures(1, &frameTexture);
+    glBindTexture(GL_TEXTURE_2D, frameTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, Options.width, Options.height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    const VolumeUtils::Volume<uint8_t> emptyMask(1, 1, 1);
+    const unsigned int maskTexture = loadVolumeTexture(emptyMask);
+    // the phantom classified like the CPU one: HU through the same window into the tissue preset
+    const std::vector<VolumeUtils::Rgba> table = VolumeUtils::TissuePreset().Bake(kTransferSize);
+    const unsigned int transferTexture = loadTransferTable(kTransferSize, 1, table);
+    const unsigned int preIntegratedTexture =
+        loadTransferTable(kTransferSize, kTransferSize, VolumeUtils::PreIntegrate(table, 1.0f));
+    const VolumeUtils::WindowMapping mapping = VolumeUtils::MapWindow(kPhantomWindow);
+    GLuint query = 0;
+    glGenQueries(1, &query);
+
+    std::vector<RunResult> results;
+    for (const int size : Options.sizes)
+    {
+        const VolumeUtils::Volume<int16_t> phantom = VolumeUtils::MakeCtPhantom(size);
+        const unsigned int volumeTexture = loadVolumeTexture(phantom);
+        VolumeUtils::MacrocellGrid<int16_t> macrocells;
+        macrocells.Build(phantom);
+        macrocells.UpdateOccupancy([&](const VolumeUtils::MacrocellGrid<int16_t>::Cell &cell) {
+            return VolumeUtils::MaxOpacity(table, kTransferSize, mapping(static_cast<float>(cell.minValue)),
+                                           mapping(static_cast<float>(cell.maxValue))) > 0.0f;
+        });
+        const std::vector<uint32_t> &bits = macrocells.OccupancyBits();
+        const unsigned int occupancySSBO =
+            rlLoadShaderBuffer(static_cast<unsigned int>(bits.size() * sizeof(uint32_t)), bits.data(), RL_DYNAMIC_READ);
+
+        rlEnableShader(program);
+        glBindImageTexture(0, frameTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+        rlBindShaderBuffer(occupancySSBO, 8);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_3D, volumeTexture);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_3D, maskTexture);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_1D, transferTexture);
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, preIntegratedTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        // every uniform DVR_GPU sets, with shading, masks and bricks off
+        const int resolution[2] = {Options.width, Options.height};
+        const int volumeSize[3] = {size, size, size};
+        const VolumeUtils::Vec3 voxelSize = VolumeUtils::VoxelSize(phantom.Spacing(), kGpuVoxel);
+        const int macrocellSize = macrocells.CellSize();
+        const float maskStrength[8] = {};
+        const float lighting[4] = {0.3f, 0.7f, 0.3f, 16.0f};
+        const int zero = 0;
+        const int one = 1;
+        const float fZero = 0.0f;
+        const float fOne = 1.0f;
+        const float opacityCutoff = 0.95f;
+        const float windowScale = mapping.scale * INT16_MAX;
+        const float gradientScale = 4.0f;
+        const int brickSize = 32;
+        rlSetUniform(3, resolution, RL_SHADER_UNIFORM_IVEC2, 1);
+        rlSetUniform(5, volumeSize, RL_SHADER_UNIFORM_IVEC3, 1);
+        rlSetUniform(12, &one, RL_SHADER_UNIFORM_INT, 1);
+        const int phase[2] = {0, 0};
+        rlSetUniform(13, phase, RL_SHADER_UNIFORM_IVEC2, 1);
+        rlSetUniform(14, &one, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(16, &zero, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(17, maskStrength, RL_SHADER_UNIFORM_FLOAT, 8);
+        rlSetUniform(26, macrocells.Dimensions().data(), RL_SHADER_UNIFORM_IVEC3, 1);
+        rlSetUniform(27, &macrocellSize, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(28, &one, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(29, &opacityCutoff, RL_SHADER_UNIFORM_FLOAT, 1);
+        rlSetUniform(30, voxelSize.data(), RL_SHADER_UNIFORM_VEC3, 1);
+        rlSetUniform(31, &one, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(32, &windowScale, RL_SHADER_UNIFORM_FLOAT, 1);
+        rlSetUniform(33, &mapping.bias, RL_SHADER_UNIFORM_FLOAT, 1);
+        rlSetUniform(34, &one, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(35, &one, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(36, &fOne, RL_SHADER_UNIFORM_FLOAT, 1);
+        rlSetUniform(37, &gradientScale, RL_SHADER_UNIFORM_FLOAT, 1);
+        rlSetUniform(38, &zero, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(39, &fZero, RL_SHADER_UNIFORM_FLOAT, 1);
+        rlSetUniform(40, lighting, RL_SHADER_UNIFORM_VEC4, 1);
+        rlSetUniform(41, &fZero, RL_SHADER_UNIFORM_FLOAT, 1);
+        rlSetUniform(42, &zero, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(43, &zero, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(44, &brickSize, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(45, &fOne, RL_SHADER_UNIFORM_FLOAT, 1);
+
+        for (const int traversal : {1, 0})
+        {
+            RunResult result;
+            result.device = "gpu";
+            result.volume = "phantom";
+            result.size = size;
+            result.traversal = traversal == 1 ? "dda" : "fixed";
+            result.simd = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+            rlSetUniform(25, &traversal, RL_SHADER_UNIFORM_INT, 1);
+            // wall time until the frame is finished, and the GPU time of the dispatch alone; the
+            // first frame is run once untimed
+            for (int frame = -1; frame < Options.frames; ++frame)
+            {
+                const CameraPose &pose = path[static_cast<size_t>(std::max(frame, 0)) % path.size()];
+                const VolumeUtils::RayCamera camera = poseCamera(pose, static_cast<float>(size) * 0.5f * kGpuVoxel);
+                const int orthographic = 0;
+                rlSetUniform(6, camera.position.data(), RL_SHADER_UNIFORM_VEC3, 1);
+                rlSetUniform(7, camera.corner.data(), RL_SHADER_UNIFORM_VEC3, 1);
+                rlSetUniform(8, camera.deltaX.data(), RL_SHADER_UNIFORM_VEC3, 1);
+                rlSetUniform(9, camera.deltaY.data(), RL_SHADER_UNIFORM_VEC3, 1);
+                rlSetUniform(10, camera.forward.data(), RL_SHADER_UNIFORM_VEC3, 1);
+                rlSetUniform(11, &orthographic, RL_SHADER_UNIFORM_INT, 1);
+                glFinish();
+                auto start = std::chrono::steady_clock::now();
+                glBeginQuery(GL_TIME_ELAPSED, query);
+                rlComputeShaderDispatch(static_cast<unsigned int>((Options.width + 7) / 8),
+                                        static_cast<unsigned int>((Options.height + 7) / 8), 1);
+                glEndQuery(GL_TIME_ELAPSED);
+                glFinish();
+                const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+                if (frame < 0)
+                    continue;
+                result.frameMilliseconds.push_back(elapsed.count());
+                result.gpuMilliseconds.push_back(static_cast<double>(nanoseconds) * 1e-6);
+            }
+            std::vector<uint8_t> frame(static_cast<size_t>(Options.width) * static_cast<size_t>(Options.height) * 4);
+            glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+            glBindTexture(GL_TEXTURE_2D, frameTexture);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, frame.data());
+            glBindTexture(GL_TEXTURE_2D, 0);
+            VolumeUtils::StateHash hash;
+            for (const uint8_t value : frame)
+                hash.Add(value);
+            result.checksum = hash.Value();
+            const double total =
+                std::accumulate(result.frameMilliseconds.begin(), result.frameMilliseconds.end(), 0.0);
+            std::cerr << "GPU: phantom " << size << "^3 " << result.traversal << ": " << total / Options.frames
+                      << " ms/frame\n";
+            results.push_back(std::move(result));
+        }
+        rlDisableShader();
+        rlUnloadShaderBuffer(occupancySSBO);
+        glDeleteTextures(1, &volumeTexture);
+    }
+
+    glDeleteQueries(1, &query);
+    glDeleteTextures(1, &maskTexture);
+    glDeleteTextures(1, &transferTexture);
+    glDeleteTextures(1, &preIntegratedTexture);
+    glDeleteTextures(1, &frameTexture);
+    rlUnloadShaderProgram(program);
+    CloseWindow();
+    return results;
+}
+
+double raysPerSecond(const RunResult &run)
+{
+    const double seconds = std::accumulate(run.frameMilliseconds.begin(), run.frameMilliseconds.end(), 0.0) * 1e-3;
+    const double rays = static_cast<double>(run.frameMilliseconds.size()) * Options.width * Options.height;
+    return seconds > 0.0 ? rays / seconds : 0.0;
+}
+
+// one run as a JSON object: frame time statistics and the throughput derived from them, with the
+// speedup over `baseline` rays/s on one thread when given
+void writeRun(std::ostream &out, const RunResult &run, double baseline)
+{
+    std::vector<double> sorted = run.frameMilliseconds;
+    std::sort(sorted.begin(), sorted.end());
+    const double total = std::accumulate(sorted.begin(), sorted.end(), 0.0);
+    const double frames = static_cast<double>(sorted.size());
+    const double rays = frames * Options.width * Options.height;
+    const double seconds = total * 1e-3;
+    const auto percentile = [&sorted](double p) {
+        return sorted[static_cast<size_t>(std::lround(p * static_cast<double>(sorted.size() - 1)))];
+    };
+    // names come from the command line and the GL driver, escaped like every other string
+    out << "{\"device\": \"" << Profiler::JsonEscaped(run.device) << "\", \"volume\": \""
+        << Profiler::JsonEscaped(run.volume) << "\", \"size\": " << run.size << ", \"traversal\": \""
+        << Profiler::JsonEscaped(run.traversal) << "\", \"backend\": \"" << Profiler::JsonEscaped(run.simd)
+        << "\", \"threads\": " << run.threads << ", \"frames\": " << sorted.size()
+        << ", \"msPerFrame\": " << total / frames << ", \"msMin\": " << sorted.front()
+        << ", \"msMedian\": " << percentile(0.5) << ", \"msMax\": " << sorted.back()
+        << ", \"raysPerSecond\": " << raysPerSecond(run);
+    if (run.samples > 0)
+    {
+        const double samples = static_cast<double>(run.samples);
+        out << ", \"samples\": " << run.samples << ", \"samplesPerRay\": " << samples / rays
+            << ", \"samplesPerSecond\": " << samples / seconds << ", \"nsPerSample\": " << total * 1e6 / samples
+            << ", \"threadNsPerSample\": " << total * 1e6 * run.threads / samples;
+    }
+    if (!run.gpuMilliseconds.empty())
+        out << ", \"gpuMsPerFrame\": "
+            << std::accumulate(run.gpuMilliseconds.begin(), run.gpuMilliseconds.end(), 0.0) / frames;
+    if (baseline > 0.0)
+    {
+        const double speedup = raysPerSecond(run) / baseline;
+        out << ", \"speedup\": " << speedup << ", \"efficiency\": " << speedup / run.threads;
+    }
+    out << ", \"checksum\": \"" << std::hex << std::setw(16) << std::setfill('0') << run.checksum << std::dec
+        << std::setfill(' ') << "\"}";
+}
+
+void writeJson(std::ostream &out, const std::vector<RunResult> &runs, const std::vector<RunResult> &scaling)
+{
+    out << std::setprecision(6);
+    out << "{\n  \"benchmark\": \"DVR_Bench\",\n  \"version\": 1,\n";
+    out << "  \"hardwareThreads\": " << std::thread::hardware_concurrency() << ",\n";
+    out << "  \"simd\": \"" << Profiler::JsonEscaped(Simd::LevelName(Simd::DetectLevel())) << "\",\n";
+    out << "  \"resolution\": [" << Options.width << ", " << Options.height << "],\n";
+    out << "  \"cameraPath\": \"" << Profiler::JsonEscaped(Options.cameraPath.empty() ? "orbit" : Options.cameraPath)
+        << "\",\n";
+    out << "  \"runs\": [";
+    for (size_t i = 0; i < runs.size(); ++i)
+    {
+        out << (i == 0 ? "\n    " : ",\n    ");
+        writeRun(out, runs[i], 0.0);
+    }
+    out << "\n  ],\n  \"scaling\": [";
+    for (size_t i = 0; i < scaling.size(); ++i)
+    {
+        // relative to the first run of the same traversal (the fewest threads) per thread
+        const auto first = std::find_if(scaling.begin(), scaling.end(), [&](const RunResult &run) {
+            return run.traversal == scaling[i].traversal;
+        });
+        const double baseline = raysPerSecond(*first) / first->threads;
+        out << (i == 0 ? "\n    " : ",\n    ");
+        writeRun(out, scaling[i], baseline);
+    }
+    out << "\n  ]\n}\n";
+}
@@ -1,16 +1,41 @@
 #include "DICOMAppHelper.h"
 #include "DICOMParser.h"
+#include "external/glad.h"
+#include "Gui/ProfilerOverlay.hpp"
+#include "Gui/TransferFunctionEditor.hpp"
+#include "Profiler/FrameProfiler.hpp"
+#include "Profiler/GpuTimer.hpp"
+#include "Profiler/PeakMemory.hpp"
+#include "Scheduler/SliceLoader.hpp"
+#include "Volume/BrickCache.hpp"
+#include "Volume/BrickPyramid.hpp"
+#include "Volume/FrameCache.hpp"
+#include "Volume/GradientVolume.hpp"
+#include "Volume/MacrocellGrid.hpp"
+#include "Volume/Progressive.hpp"
+#include "Volume/RayCamera.hpp"
+#include "Volume/Series.hpp"
+#include "Volume/TransferFunction.hpp"
+#include "Volume/Volume.hpp"
+#include "Volume/VolumeCache.hpp"
+#include "Volume/Window.hpp"
 #include "raylib.h"
 #include "raymath.h"
 #include "rlImGui.h"
 #include "rlgl.h"
 
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
 #include <imgui.h>
 #include <iostream>
+#include <map>
 #include <stdint.h>
 #include <filesystem>
+#include <type_traits>
+#include <vector>
 
 #define WIN_WIDTH 1366
 #define WIN_HEIGHT 768
@@ -25,112 +50,446 @@ float camRotateY = 0;
 float brightness = 1.0f;
 bool applyMask = false;
 float maskStrength[8] = {0, 0.15f, 0.1f, 0.6f, 1.0f, 0.7f, 0.7f, 0.5f};
+int traversalMode = 1; // 0: fixed step, 1: 3D DDA
+const char *traversalModeNames[] = {"Fixed step", "3D DDA"};
+bool trilinear = true; // fixed steps interpolate intensities between voxels
+// display window in HU, it starts on the -128..1023 range the volume used to be crushed to
+VolumeUtils::Window window{447.5f, 1151.0f};
+bool quantized = false; // sample an 8-bit copy with the window baked in instead of the 16-bit volume
+int classification = 0; // 0: maximum intensity projection, 1: 1D transfer function, 2: 2D
+const char *classificationNames[] = {"MIP", "Transfer Function", "2D Transfer Function"};
+VolumeUtils::TransferFunction transferFunction = VolumeUtils::TissuePreset();
+// value against gradient magnitude: faint soft tissue boundaries and bone
+std::vector<VolumeUtils::TransferWidget> transferWidgets{
+    {0.3f, 0.2f, 0.1f, 1.0f, {0.9f, 0.5f, 0.4f, 0.1f}},
+    {0.8f, 0.5f, 0.0f, 1.0f, {1.0f, 1.0f, 0.95f, 0.5f}}};
+bool preIntegrated = true;
+float stepScale = 1.0f;      // fixed-step length in reference steps (half the finest voxel edge)
+float gradientRange = 0.25f; // windowed change per voxel at the top of the 2D table
+constexpr int kTransferSize = 256; // entries over the windowed values
+constexpr int kGradientSize = 64;  // rows of gradient magnitude in the 2D table
+// headlight shading from a gradient texture built the first time shading or the 2D transfer
+// function needs it
+bool shading = false;
+float gradientOpacity = 0.0f; // how much the gradient magnitude scales opacity
+float lighting[4] = {0.3f, 0.7f, 0.3f, 16.0f}; // ambient, diffuse, specular, shininess
+float gradientMaxMagnitude = 0.0f; // stored value change per voxel at a packed magnitude of 1
+// out-of-core rendering: with a brick cache budget (--brick-cache MB) the volume is uploaded as a
+// pyramid of bricks streamed into a fixed atlas instead of a single texture, see updateBricks
+std::size_t brickCacheMegabytes = 0; // 0: upload the whole volume
+constexpr int kBrickSize = 32;       // voxels along a brick edge, apron excluded
+float brickDetail = 1.0f;            // pixels a voxel may cover before a finer level is used
+int brickUploads = 64;               // most bricks uploaded in one frame
+// preprocessed volumes are kept on disk (--cache-dir DIR, --no-cache) and mapped back in on the
+// next start instead of parsing the series again, see loadCachedVolume
+bool useVolumeCache = true;
+std::filesystem::path cacheDirectory; // empty: dvr_cache in the temporary directory
+bool skipEmptySpace = true;
+float opacityCutoff = 0.95f;
 int zoom = 128;
-
-std::string BaseFileName;
-std::string MaskBaseFileName;
-std::string Prefix;
+bool progressive = true;
+VolumeUtils::ProgressiveRefiner refiner;
+VolumeUtils::FrameCache<unsigned int> frameCache(4); // textures of finished frames
+// size of the traced image, it follows the window
+int frameWidth = WIN_WIDTH;
+int frameHeight = WIN_HEIGHT;
+// CPU time of the loader and of each frame stage, GPU time from timer queries, shown in the
+// profiler window and saved as a Chrome trace on demand
+Profiler::FrameProfiler Timings;
+Profiler::GpuTimer GpuTimings;
+bool showProfiler = false;
+const std::string kTracePath = "dvr_trace.json";
+
+// files of a series in order along the slice normal, with their spacing (column, row, slice) in mm
+struct DicomSeries
+{
+    std::vector<std::string> files{};
+    std::array<float, 3> spacing{1.0f, 1.0f, 1.0f};
+    VolumeUtils::Rescale rescale{}; // of the first slice, the volume stores values in its units
+    int width{0};
+    int height{0};
+    std::string uid{};
+};
+
+std::string SeriesDirectory;
+std::string MaskDirectory;
+DicomSeries Series;
 int FileCount;
-int SliceThickness;
 bool HasMask;
 int Width;
 int Height;
-uint8_t *Volume;
-uint8_t *VolumeMask;
+VolumeUtils::Volume<int16_t> Volume;
+VolumeUtils::Volume<uint8_t> VolumeMask;
+VolumeUtils::MacrocellGrid<int16_t> Macrocells;
+VolumeUtils::BrickPyramid<int16_t> Pyramid;
+VolumeUtils::VolumeCacheFile VolumeCache; // stays mapped for the gradients, if it has them
+
+// resident bricks of the pyramid: slot 0 of the atlas holds a transparent value for the pages of
+// invisible bricks, the cache hands out the others (cache slot i is atlas slot i + 1)
+struct BrickAtlas
+{
+    unsigned int texture{0};   // R16_SNORM, slots of StoredSize()^3 voxels
+    unsigned int pageTable{0}; // RGBA8UI per finest brick: atlas slot and level it is read from
+    std::array<int, 3> slots{};
+    VolumeUtils::BrickCache cache{};
+    std::vector<uint8_t> pages{};
+    int16_t emptyValue{0};
+    uint64_t frame{0};
+    uint64_t version{0};     // changes with the page table, part of the view key
+    uint64_t settledKey{0};  // view whose bricks are all resident, nothing to do until it changes
+    int uploads{0};          // bricks uploaded by the last update
+};
+BrickAtlas Atlas;
+
+// Classification as seen by empty space skipping: whether stored values in [low, high] can
+// contribute to the image, masks aside
+struct Visibility
+{
+    VolumeUtils::WindowMapping mapping{};
+    std::vector<VolumeUtils::Rgba> table{}; // transfer function, empty for MIP
+
+    bool operator()(float low, float high) const
+    {
+        // maximum intensity projection, voxels at or below the bottom of the window never raise it
+        if (table.empty())
+            return mapping(high) > 0.0f;
+        // the transfer function is not transparent anywhere in the range
+        return VolumeUtils::MaxOpacity(table, kTransferSize, mapping(low), mapping(high)) > 0.0f;
+    }
+
+    // a stored value that never contributes, for the pages of invisible bricks
+    int16_t TransparentValue() const
+    {
+        for (const int16_t candidate : {int16_t(INT16_MIN), int16_t(INT16_MAX)})
+            if (!(*this)(candidate, candidate))
+                return candidate;
+        for (std::size_t i = 1; i + 1 < kTransferSize; ++i)
+        {
+            const float value = VolumeUtils::TableValue(i, kTransferSize);
+            if (VolumeUtils::MaxOpacity(table, kTransferSize, value, value) <= 0.0f)
+                return static_cast<int16_t>(std::clamp(std::round((value - mapping.bias) / mapping.scale),
+                                                       float(INT16_MIN), float(INT16_MAX)));
+        }
+        return INT16_MIN; // nothing is transparent, so no brick is invisible either
+    }
+};
 
 void drawDebugMenu();
 
+void drawWidgetEditor();
+
 void loadVolumeData();
 
 void loadVolumeMasks();
 
 void processArgs(int argc, char *argv[]);
 
-std::string extractDirectory(const std::string& imagedir);
+DicomSeries assembleSeries(const std::string &directory);
+
+uint64_t sourceKey();
+
+std::filesystem::path volumeCachePath();
 
-std::string inferPrefix(const std::string& directory);
+bool loadCachedVolume();
 
-int countFilesWithPrefix(const std::string& directory, const std::string& prefix);
+void saveVolumeCache(const VolumeUtils::GradientVolume *gradients = nullptr);
 
-void reorderVolumes();
+template <typename T>
+unsigned int loadVolumeTexture(const VolumeUtils::Volume<T> &volume, bool labels = false);
+
+void updateVolumeTexture(unsigned int texture, const VolumeUtils::Volume<uint8_t> &volume);
+
+unsigned int loadGradientTexture();
+
+void uploadTransferTable(unsigned int &texture, int width, int height,
+                         const std::vector<VolumeUtils::Rgba> &table);
+
+unsigned int loadFrameTexture(int width, int height);
+
+uint64_t transferKey();
+
+void buildMacrocells();
+
+Visibility currentVisibility();
+
+bool updateMacrocellOccupancy();
+
+void buildPyramid();
+
+void loadBrickAtlas();
+
+void uploadBrick(int slot, const int16_t *voxels);
+
+bool updateBricks();
+
+uint64_t viewKey();
 
 int main(int argc, char *argv[])
 {
     processArgs(argc, argv);
-    loadVolumeData();
-    if (HasMask)
-        loadVolumeMasks();
-    reorderVolumes();
+    if (HasMask && brickCacheMegabytes > 0)
+    {
+        std::cout << "Masks are not streamed, " << MaskDirectory << " is ignored with --brick-cache\n";
+        HasMask = false;
+    }
+    auto loadStart = std::chrono::steady_clock::now();
+    if (!loadCachedVolume())
+    {
+        loadVolumeData();
+        if (HasMask)
+            loadVolumeMasks();
+        buildMacrocells();
+        saveVolumeCache();
+    }
+    if (brickCacheMegabytes > 0)
+        buildPyramid();
     std::cout << "Resolution: " << Width << "x" << Height << "\n";
     std::cout << "Slice Count: " << FileCount << "\n";
-    std::cout << "Slice Thickness: " << SliceThickness << "\n";
+    std::cout << "Spacing: " << Series.spacing[0] << " x " << Series.spacing[1] << " x " << Series.spacing[2] << " mm\n";
+    std::cout << "Rescale: " << Series.rescale.slope << " x + " << Series.rescale.offset << " HU\n";
     std::cout << "Has Mask?: " << (HasMask ? "Yes" : "No") << "\n";
+    auto loadTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - loadStart);
+    std::cout << "Loaded in " << loadTime.count() << " ms, peak memory " << Profiler::PeakResidentBytes() / (1024 * 1024)
+              << " MB\n";
 
+    SetConfigFlags(FLAG_WINDOW_RESIZABLE);
     InitWindow(WIN_WIDTH, WIN_HEIGHT, "DVR_GPU");
     rlImGuiSetup(true);
 
-    const Vector2 resolution = {WIN_WIDTH, WIN_HEIGHT};
-    const int iResolution[2] = {WIN_WIDTH, WIN_HEIGHT};
-
     // compute shader
     char *dvrComputeSource = LoadFileText(ASSETS_PATH "shaders/ray_cast.comp");
     auto dvrComputeShader = rlCompileShader(dvrComputeSource, RL_COMPUTE_SHADER);
     auto dvrComputeProgram = rlLoadComputeShaderProgram(dvrComputeShader);
     UnloadFileText(dvrComputeSource);
 
-    // render shader (fragment)
-    Shader dvrRenderShader = LoadShader(NULL, ASSETS_PATH "shaders/render.glsl");
-    int resUniformLoc = GetShaderLocation(dvrRenderShader, "resolution");
-    int brightUniformLoc = GetShaderLocation(dvrRenderShader, "brightness");
-
-    // Load shader storage buffer object (SSBO), id returned
-    constexpr auto bufferSize = WIN_WIDTH * WIN_HEIGHT * sizeof(Vector4);
-    auto ssboA = rlLoadShaderBuffer(bufferSize, NULL, RL_DYNAMIC_COPY);
-    auto ssboB = rlLoadShaderBuffer(bufferSize, NULL, RL_DYNAMIC_COPY);
+    // The compute shader stores the frame in an RGBA8 texture that is drawn as it is. It keeps the
+    // image between frames, progressive passes only overwrite part of it.
+    unsigned int frameTexture = loadFrameTexture(frameWidth, frameHeight);
+    uint64_t lastKey = 0;
 
-    // upload volume data
-    auto volumeBufferSize = Width * Height * FileCount * SliceThickness * sizeof(uint8_t);
+    // upload volume data as 3D textures, sampled with hardware filtering by the compute shader;
+    // a pyramid is streamed brick by brick instead
     rlEnableShader(dvrComputeProgram);
-    auto volumeDataSSBO = rlLoadShaderBuffer(volumeBufferSize, Volume, RL_STATIC_READ);
-    auto volumeDataMaskSSBO = rlLoadShaderBuffer(volumeBufferSize, VolumeMask, RL_STATIC_READ);
-    rlBindShaderBuffer(volumeDataSSBO, 4);
-    rlBindShaderBuffer(volumeDataMaskSSBO, 7);
-    int volumeSize[3] = {Width, FileCount * SliceThickness, Height};
+    const bool bricked = !Pyramid.Empty();
+    unsigned int volumeTexture = 0;
+    {
+        Profiler::ScopedTimer uploadTimer(Timings, "Upload", Profiler::kLoadStage);
+        Profiler::ScopedGpuTimer uploadGpuTimer(GpuTimings, "Volume Upload");
+        if (bricked)
+            loadBrickAtlas();
+        else
+            volumeTexture = loadVolumeTexture(Volume);
+    }
+    const int iBricked = bricked;
+    rlSetUniform(43, &iBricked, RL_SHADER_UNIFORM_INT, 1);
+    rlSetUniform(44, &kBrickSize, RL_SHADER_UNIFORM_INT, 1);
+    unsigned int quantizedTexture = 0; // built the first time the 8-bit copy is used
+    VolumeUtils::Window quantizedWindow{};
+    // without a mask the shader never samples it, a single voxel keeps the unit complete
+    const VolumeUtils::Volume<uint8_t> emptyMask(1, 1, 1);
+    auto volumeMaskTexture = loadVolumeTexture(HasMask ? VolumeMask : emptyMask, true);
+    int volumeSize[3] = {Volume.Width(), Volume.Height(), Volume.Depth()};
     rlSetUniform(5, &volumeSize, RL_SHADER_UNIFORM_IVEC3, 1);
-
-    // Create a white texture of the size of the window to update
-    // each pixel of the window using the fragment shader
-    Image whiteImage = GenImageColor(WIN_WIDTH, WIN_HEIGHT, WHITE);
-    Texture whiteTex = LoadTextureFromImage(whiteImage);
-    UnloadImage(whiteImage);
+    // anisotropic voxels are stretched by the shader instead of stored as extra slices
+    const VolumeUtils::Vec3 voxelSize = VolumeUtils::VoxelSize(Volume.Spacing(), 0.125f);
+    rlSetUniform(30, voxelSize.data(), RL_SHADER_UNIFORM_VEC3, 1);
+
+    // upload macrocell occupancy, refreshed whenever the classification changes
+    const auto &occupancyBits = Macrocells.OccupancyBits();
+    auto occupancyBufferSize = static_cast<unsigned int>(occupancyBits.size() * sizeof(uint32_t));
+    auto occupancySSBO = rlLoadShaderBuffer(occupancyBufferSize, occupancyBits.data(), RL_DYNAMIC_READ);
+    rlBindShaderBuffer(occupancySSBO, 8);
+    const auto &macrocellGridSize = Macrocells.Dimensions();
+    const int macrocellSize = Macrocells.CellSize();
+    rlSetUniform(26, macrocellGridSize.data(), RL_SHADER_UNIFORM_IVEC3, 1);
+    rlSetUniform(27, &macrocellSize, RL_SHADER_UNIFORM_INT, 1);
+
+    // classification tables, rebuilt whenever a transfer function or the step length changes
+    unsigned int transferTexture = 0;
+    unsigned int preIntegratedTexture = 0;
+    unsigned int transfer2DTexture = 0;
+    uint64_t lastTransferKey = 0;
+    unsigned int gradientTexture = 0;
 
     // Main game loop
     while (!WindowShouldClose())
     {
+        Profiler::ScopedTimer frameTimer(Timings, "Frame");
+        Profiler::StageTimer stages(Timings);
+        GpuTimings.Collect(Timings);
+
         if (IsKeyPressed(KEY_F))
             ToggleFullscreen();
 
+        // the image follows the window, cached frames of the old size are dropped
+        const int screenWidth = GetScreenWidth();
+        const int screenHeight = GetScreenHeight();
+        if (screenWidth > 0 && screenHeight > 0 && (screenWidth != frameWidth || screenHeight != frameHeight))
+        {
+            frameWidth = screenWidth;
+            frameHeight = screenHeight;
+            glDeleteTextures(1, &frameTexture);
+            frameTexture = loadFrameTexture(frameWidth, frameHeight);
+            frameCache.ForEachFrame([](unsigned int texture) { glDeleteTextures(1, &texture); });
+            frameCache.Clear();
+        }
+
+        // occupancy, bricks, windowed copy and tables of changed settings
+        stages.Begin("Upload");
+        GpuTimings.Begin("Upload");
+        if (updateMacrocellOccupancy())
+            rlUpdateShaderBuffer(occupancySSBO, occupancyBits.data(), occupancyBufferSize, 0);
+
+        // bricks of this view, the image is traced again as finer ones arrive
+        if (bricked)
+            updateBricks();
+
+        // the 8-bit copy is only rebuilt when the window changes, the volume is never reloaded
+        const VolumeUtils::WindowMapping mapping = VolumeUtils::MapWindow(window, Series.rescale);
+        if (quantized && (quantizedTexture == 0 || quantizedWindow.center != window.center ||
+                          quantizedWindow.width != window.width))
+        {
+            const auto copy = VolumeUtils::QuantizeWindow(Volume, mapping);
+            if (quantizedTexture == 0)
+                quantizedTexture = loadVolumeTexture(copy);
+            else
+                updateVolumeTexture(quantizedTexture, copy);
+            quantizedWindow = window;
+        }
+
+        if (const uint64_t tables = transferKey(); tables != lastTransferKey)
+        {
+            const std::vector<VolumeUtils::Rgba> table = transferFunction.Bake(kTransferSize);
+            uploadTransferTable(transferTexture, kTransferSize, 1, table);
+            uploadTransferTable(preIntegratedTexture, kTransferSize, kTransferSize,
+                                VolumeUtils::PreIntegrate(table, stepScale));
+            uploadTransferTable(transfer2DTexture, kTransferSize, kGradientSize,
+                                VolumeUtils::BakeWidgets(transferWidgets, kTransferSize, kGradientSize));
+            lastTransferKey = tables;
+        }
+
+        // bricked volumes take central differences of the resident bricks instead
+        if (gradientTexture == 0 && !bricked && (shading || classification == 2))
+            gradientTexture = loadGradientTexture();
+
+        stages.Begin("Dispatch");
+        GpuTimings.Begin("Dispatch");
+        // a view seen recently is copied from the cache, otherwise traced progressively
+        const uint64_t key = viewKey();
+        const bool changed = key != lastKey;
+        lastKey = key;
+        const unsigned int *cached = changed ? frameCache.Find(key) : nullptr;
+        std::vector<VolumeUtils::PixelLattice> passes;
+        if (cached)
+        {
+            glCopyImageSubData(*cached, GL_TEXTURE_2D, 0, 0, 0, 0, frameTexture, GL_TEXTURE_2D, 0, 0, 0, 0,
+                               frameWidth, frameHeight, 1);
+            refiner.MarkConverged();
+        }
+        else if (progressive)
+        {
+            passes = refiner.NextFrame(changed, GetFrameTime() * 1000.0f);
+        }
+        else if (changed || !refiner.Converged())
+        {
+            passes.emplace_back();
+            refiner.MarkConverged();
+        }
+
         // ray cast
         rlEnableShader(dvrComputeProgram);
-        rlBindShaderBuffer(ssboA, 1);
-        rlBindShaderBuffer(ssboB, 2);
-        rlSetUniform(3, iResolution, RL_SHADER_UNIFORM_IVEC2, 1);
-        rlSetUniform(6, &camera, RL_SHADER_UNIFORM_FLOAT, 11);
+        glBindImageTexture(0, frameTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_3D, quantized ? quantizedTexture : bricked ? Atlas.texture : volumeTexture);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_3D, volumeMaskTexture);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_1D, transferTexture);
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, preIntegratedTexture);
+        glActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_2D, transfer2DTexture);
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_3D, gradientTexture);
+        glActiveTexture(GL_TEXTURE7);
+        glBindTexture(GL_TEXTURE_3D, Atlas.pageTable);
+        glActiveTexture(GL_TEXTURE0);
+        const int resolution[2] = {frameWidth, frameHeight};
+        rlSetUniform(3, resolution, RL_SHADER_UNIFORM_IVEC2, 1);
+        // camera basis and pixel deltas once per frame, the shader only adds them up
+        const bool orthographic = camera.projection == CAMERA_ORTHOGRAPHIC;
+        const VolumeUtils::RayCamera rayCamera = VolumeUtils::MakeRayCamera(
+            {camera.position.x, camera.position.y, camera.position.z},
+            {camera.target.x, camera.target.y, camera.target.z},
+            {camera.up.x, camera.up.y, camera.up.z},
+            camera.fovy,
+            orthographic,
+            frameWidth,
+            frameHeight);
+        const int iOrthographic = orthographic;
+        rlSetUniform(6, rayCamera.position.data(), RL_SHADER_UNIFORM_VEC3, 1);
+        rlSetUniform(7, rayCamera.corner.data(), RL_SHADER_UNIFORM_VEC3, 1);
+        rlSetUniform(8, rayCamera.deltaX.data(), RL_SHADER_UNIFORM_VEC3, 1);
+        rlSetUniform(9, rayCamera.deltaY.data(), RL_SHADER_UNIFORM_VEC3, 1);
+        rlSetUniform(10, rayCamera.forward.data(), RL_SHADER_UNIFORM_VEC3, 1);
+        rlSetUniform(11, &iOrthographic, RL_SHADER_UNIFORM_INT, 1);
         rlSetUniform(16, &applyMask, RL_SHADER_UNIFORM_INT, 1);
         rlSetUniform(17, maskStrength, RL_SHADER_UNIFORM_FLOAT, 8);
-        rlComputeShaderDispatch(static_cast<unsigned int>(ceil(WIN_WIDTH / 8.0)),
-                                static_cast<unsigned int>(ceil(WIN_HEIGHT / 8.0)),
-                                1);
+        rlSetUniform(25, &traversalMode, RL_SHADER_UNIFORM_INT, 1);
+        const int iTrilinear = trilinear;
+        rlSetUniform(31, &iTrilinear, RL_SHADER_UNIFORM_INT, 1);
+        const int iSkipEmptySpace = skipEmptySpace;
+        rlSetUniform(28, &iSkipEmptySpace, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(29, &opacityCutoff, RL_SHADER_UNIFORM_FLOAT, 1);
+        // R16_SNORM samples are stored / 32767, the 8-bit copy is already windowed
+        const float windowScale = quantized ? 1.0f : mapping.scale * INT16_MAX;
+        const float windowBias = quantized ? 0.0f : mapping.bias;
+        rlSetUniform(32, &windowScale, RL_SHADER_UNIFORM_FLOAT, 1);
+        rlSetUniform(33, &windowBias, RL_SHADER_UNIFORM_FLOAT, 1);
+        const int iPreIntegrated = preIntegrated;
+        const float gradientScale = 1.0f / gradientRange;
+        rlSetUniform(34, &classification, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(35, &iPreIntegrated, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(36, &stepScale, RL_SHADER_UNIFORM_FLOAT, 1);
+        rlSetUniform(37, &gradientScale, RL_SHADER_UNIFORM_FLOAT, 1);
+        // packed magnitudes are relative to the largest, in stored values per voxel
+        const int iShading = shading;
+        const int iHasGradients = gradientTexture != 0;
+        const float magnitudeScale = gradientMaxMagnitude * VolumeUtils::MapWindow(window, Series.rescale).scale * gradientScale;
+        rlSetUniform(38, &iShading, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(39, &gradientOpacity, RL_SHADER_UNIFORM_FLOAT, 1);
+        rlSetUniform(40, lighting, RL_SHADER_UNIFORM_VEC4, 1);
+        rlSetUniform(41, &magnitudeScale, RL_SHADER_UNIFORM_FLOAT, 1);
+        rlSetUniform(42, &iHasGradients, RL_SHADER_UNIFORM_INT, 1);
+        rlSetUniform(45, &brightness, RL_SHADER_UNIFORM_FLOAT, 1);
+        for (const VolumeUtils::PixelLattice &lattice : passes)
+        {
+            const int phase[2] = {lattice.phaseX, lattice.phaseY};
+            rlSetUniform(12, &lattice.stride, RL_SHADER_UNIFORM_INT, 1);
+            rlSetUniform(13, phase, RL_SHADER_UNIFORM_IVEC2, 1);
+            rlSetUniform(14, &lattice.fill, RL_SHADER_UNIFORM_INT, 1);
+            const int columns = (frameWidth - lattice.phaseX + lattice.stride - 1) / lattice.stride;
+            const int rows = (frameHeight - lattice.phaseY + lattice.stride - 1) / lattice.stride;
+            rlComputeShaderDispatch(static_cast<unsigned int>((columns + 7) / 8),
+                                    static_cast<unsigned int>((rows + 7) / 8),
+                                    1);
+        }
         rlDisableShader();
+        // the stores are visible to the draw and to the copies below
+        if (!passes.empty())
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
 
-        // swap SSBO's
-        auto temp = ssboA;
-        ssboA = ssboB;
-        ssboB = temp;
+        if (!passes.empty() && refiner.Converged())
+        {
+            unsigned int &slot = frameCache.Insert(key);
+            if (slot == 0)
+                slot = loadFrameTexture(frameWidth, frameHeight);
+            glCopyImageSubData(frameTexture, GL_TEXTURE_2D, 0, 0, 0, 0, slot, GL_TEXTURE_2D, 0, 0, 0, 0,
+                               frameWidth, frameHeight, 1);
+        }
 
-        rlBindShaderBuffer(ssboA, 1);
-        SetShaderValue(dvrRenderShader, resUniformLoc, &resolution, SHADER_UNIFORM_VEC2);
-        SetShaderValue(dvrRenderShader, brightUniformLoc, &brightness, SHADER_UNIFORM_FLOAT);
+        stages.Begin("Draw");
+        GpuTimings.Begin("Draw");
 
         //----------------------------------------------------------------------------------
         // Draw
@@ -140,172 +499,203 @@ int main(int argc, char *argv[])
 
         ClearBackground(BLANK);
 
-        BeginShaderMode(dvrRenderShader);
-        DrawTexture(whiteTex, 0, 0, WHITE);
-        EndShaderMode();
+        DrawTexture(Texture2D{frameTexture, frameWidth, frameHeight, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8}, 0, 0, WHITE);
 
         DrawFPS(10, 10);
         drawDebugMenu();
 
+        // the batch is flushed here rather than in EndDrawing, inside the query
+        rlDrawRenderBatchActive();
+        GpuTimings.End();
+        stages.End();
         EndDrawing();
     }
 
-    delete[] Volume;
-    if (HasMask)
-        delete[] VolumeMask;
-
-    // Unload shader buffers objects.
-    rlUnloadShaderBuffer(ssboA);
-    rlUnloadShaderBuffer(ssboB);
-    rlUnloadShaderBuffer(volumeDataSSBO);
+    Volume.Clear();
+    VolumeMask.Clear();
+
+    // Unload frame textures and shader buffers objects.
+    glDeleteTextures(1, &frameTexture);
+    frameCache.ForEachFrame([](unsigned int texture) { glDeleteTextures(1, &texture); });
+    glDeleteTextures(1, &volumeTexture);
+    glDeleteTextures(1, &Atlas.texture);
+    glDeleteTextures(1, &Atlas.pageTable);
+    if (quantizedTexture != 0)
+        glDeleteTextures(1, &quantizedTexture);
+    glDeleteTextures(1, &volumeMaskTexture);
+    glDeleteTextures(1, &transferTexture);
+    glDeleteTextures(1, &preIntegratedTexture);
+    glDeleteTextures(1, &transfer2DTexture);
+    if (gradientTexture != 0)
+        glDeleteTextures(1, &gradientTexture);
+    rlUnloadShaderBuffer(occupancySSBO);
+    GpuTimings.Release();
 
     // Unload compute shader programs
     rlUnloadShaderProgram(dvrComputeProgram);
 
-    UnloadTexture(whiteTex);       // Unload white texture
-    UnloadShader(dvrRenderShader); // Unload rendering fragment shader
-
     CloseWindow(); // Close window and OpenGL context
 
     return 0;
 }
 
-void loadVolumeData()
+// parser and helper of one loader thread, reused for every slice it reads
+struct SliceReader
 {
-    DICOMAppHelper appHelper;
     DICOMParser parser;
+    DICOMAppHelper appHelper;
 
-    int currentFile = 0;
-    int numPixels;
-
-    while (currentFile < FileCount)
+    // parse one file and hand each pixel to store(x, row, value), as a stored value in the units of
+    // `units`. The pixels are read straight from the mapped file, the helper does not make its own
+    // converted copy; slices rescaled like `units` pass through unchanged.
+    template <typename Store>
+    void Read(const std::string &fileName, int width, int height, const VolumeUtils::Rescale &units,
+              const Store &store)
     {
+        Profiler::StageTimer stages(Timings, Profiler::kLoadStage);
+        stages.Begin("Parse");
         parser.ClearAllDICOMTagCallbacks();
-        parser.OpenFile(BaseFileName + Prefix + std::to_string(currentFile));
+        // no rescale tags means 1 / 0 and no pixel data means none, not the last slice's
         appHelper.Clear();
+        appHelper.ResetImageInfo();
+        if (!parser.OpenFile(fileName))
+            throw std::runtime_error("Cannot open slice " + fileName);
+        appHelper.SetCopyImageData(false);
         appHelper.RegisterCallbacks(&parser);
         appHelper.RegisterPixelDataCallback(&parser);
 
-        parser.ReadHeader();
+        if (!parser.ReadHeader())
+            throw std::runtime_error("Slice " + fileName + " is not a DICOM file");
 
-        void *imgData = nullptr;
-        DICOMParser::VRTypes dataType;
+        const void *imgData = nullptr;
         unsigned long imageDataLength = 0;
-
-        appHelper.GetImageData(imgData, dataType, imageDataLength);
-        if (currentFile == 0)
-        {
-            Width = appHelper.GetWidth();
-            Height = appHelper.GetHeight();
-            numPixels = Width * Height;
-            Volume = new uint8_t[numPixels * SliceThickness * FileCount];
-        }
-        for (size_t i = 0; i < numPixels; ++i)
-        {
-            // -1024 <= pixelVal <= 1023
-            int16_t pixelVal = ((int16_t *)imgData)[i];
-            if (pixelVal >= -128)
-            {
-                uint8_t compressed = (uint8_t)((float(pixelVal + 128) / (128 + 1023)) * UINT8_MAX);
-                Volume[currentFile * SliceThickness * numPixels + i] = compressed;
-            }
-        }
-        currentFile++;
+        appHelper.GetRawImageData(imgData, imageDataLength);
+        stages.Begin("Convert");
+        const auto pixelCount = static_cast<unsigned long>(width) * static_cast<unsigned long>(height);
+        if (imgData == nullptr || appHelper.GetBitsAllocated() != 16 || imageDataLength < pixelCount * sizeof(int16_t))
+            throw std::runtime_error("Slice " + fileName + " does not match the size of the series");
+
+        // stored value of this slice -> stored value in `units`
+        const float unitSlope = units.slope != 0.0f ? units.slope : 1.0f;
+        const float scale = appHelper.GetRescaleSlope() / unitSlope;
+        const float bias = (appHelper.GetRescaleOffset() - units.offset) / unitSlope;
+        if (appHelper.GetPixelRepresentation() == 1)
+            Convert(static_cast<const int16_t *>(imgData), width, height, scale, bias, store);
+        else
+            Convert(static_cast<const uint16_t *>(imgData), width, height, scale, bias, store);
     }
-    appHelper.Clear();
 
-    // generate filler slices by LERPing actual slices
-    for (int i = 0; (i + SliceThickness) < FileCount * SliceThickness; i += SliceThickness)
+    template <typename Pixel, typename Store>
+    static void Convert(const Pixel *pixels, int width, int height, float scale, float bias, const Store &store)
     {
-        for (int l = 1; l < SliceThickness; ++l)
+        const bool unchanged = std::is_signed_v<Pixel> && scale == 1.0f && bias == 0.0f;
+        for (int row = 0; row < height; ++row, pixels += width)
         {
-            for (int p = 0; p < numPixels; ++p)
+            if (unchanged)
+            {
+                for (int x = 0; x < width; ++x)
+                    store(x, row, static_cast<int16_t>(pixels[x]));
+                continue;
+            }
+            for (int x = 0; x < width; ++x)
             {
-                Volume[(i + l) * numPixels + p] =
-                    (Volume[i * numPixels + p] * (SliceThickness - l) +
-                     Volume[(i + SliceThickness) * numPixels + p] * l) /
-                    SliceThickness;
+                const float value = std::round(static_cast<float>(pixels[x]) * scale + bias);
+                store(x, row, static_cast<int16_t>(std::clamp(value, float(INT16_MIN), float(INT16_MAX))));
             }
         }
     }
+};
+
+void loadVolumeData()
+{
+    Profiler::ScopedTimer timer(Timings, "Volume", Profiler::kLoadStage);
+    auto start = std::chrono::steady_clock::now();
+
+    Series = assembleSeries(SeriesDirectory);
+    FileCount = static_cast<int>(Series.files.size());
+    Width = Series.width;
+    Height = Series.height;
+    // the shader treats slices as the Y axis: (x, row, slice) is stored at (x, slice, row)
+    Volume.Resize(Width, FileCount, Height);
+    Volume.SetSpacing({Series.spacing[0], Series.spacing[2], Series.spacing[1]});
+    int16_t *voxels = Volume.Data();
+    const std::size_t rowStride = Volume.Index(0, 0, 1);
+
+    // each row of a slice is copied straight into its final place at full precision, so the
+    // volume is never transposed or held twice; only acquired slices are stored, rescale and
+    // window are applied when sampling
+    Scheduler::LoadSlices<SliceReader>(
+        FileCount,
+        0,
+        [&](SliceReader &reader, int file) {
+            int16_t *slice = voxels + Volume.Index(0, file, 0);
+            reader.Read(Series.files[static_cast<size_t>(file)], Width, Height, Series.rescale,
+                        [slice, rowStride](int x, int row, int16_t stored) {
+                            slice[static_cast<std::size_t>(row) * rowStride + static_cast<std::size_t>(x)] = stored;
+                        });
+        },
+        [](int) {});
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Volume: " << FileCount << " slices, " << Volume.SizeInBytes() / (1024 * 1024) << " MB ("
+              << elapsed.count() << " ms)\n";
 }
 
 void loadVolumeMasks()
 {
-    DICOMAppHelper appHelper;
-    DICOMParser parser;
-
-    int currentFile = 0;
-    int numPixels;
-    std::map<uint16_t, Color> masks;
-
-    while (currentFile < FileCount)
-    {
-        parser.ClearAllDICOMTagCallbacks();
-        parser.OpenFile(MaskBaseFileName + Prefix + std::to_string(currentFile));
-        appHelper.Clear();
-        appHelper.RegisterCallbacks(&parser);
-        appHelper.RegisterPixelDataCallback(&parser);
-
-        parser.ReadHeader();
-
-        void *imgData = nullptr;
-        DICOMParser::VRTypes dataType;
-        unsigned long imageDataLength = 0;
-
-        appHelper.GetImageData(imgData, dataType, imageDataLength);
-        if (currentFile == 0)
-        {
-            numPixels = Width * Height;
-            VolumeMask = new uint8_t[numPixels * SliceThickness * FileCount];
-        }
-
-        for (size_t i = 0; i < numPixels; ++i)
-        {
-            // -1024 <= pixelVal <= 1023
-            int16_t pixelVal = ((int16_t *)imgData)[i];
-            switch (pixelVal)
-            {
-            case 65: // bone
-                VolumeMask[currentFile * SliceThickness * numPixels + i] = 1;
-                break;
-            case 129: // liver
-                VolumeMask[currentFile * SliceThickness * numPixels + i] = 2;
-                break;
-            case 33: // venous system
-                VolumeMask[currentFile * SliceThickness * numPixels + i] = 3;
-                break;
-            case 17: // portal vein
-                VolumeMask[currentFile * SliceThickness * numPixels + i] = 4;
-                break;
-            case 193: // gallbladder
-                VolumeMask[currentFile * SliceThickness * numPixels + i] = 5;
-                break;
-            case 131: // tumor
-                VolumeMask[currentFile * SliceThickness * numPixels + i] = 6;
-                break;
-            case 133: // liver cyst
-                VolumeMask[currentFile * SliceThickness * numPixels + i] = 7;
-                break;
-            default:
-                VolumeMask[currentFile * SliceThickness * numPixels + i] = 0;
-                break;
-            }
-        }
-        currentFile++;
-    }
-    appHelper.Clear();
-    // generate filler slices by repeating actual slices
-    for (int i = 0; (i + SliceThickness) < FileCount * SliceThickness; i += SliceThickness)
-    {
-        for (int l = 1; l < SliceThickness; ++l)
-        {
-            for (int p = 0; p < numPixels; ++p)
-            {
-                VolumeMask[(i + l) * numPixels + p] = VolumeMask[i * numPixels + p];
-            }
-        }
-    }
+    Profiler::ScopedTimer timer(Timings, "Masks", Profiler::kLoadStage);
+    auto start = std::chrono::steady_clock::now();
+    // the labels are a series of their own, slice for slice the same geometry as the volume
+    const DicomSeries maskSeries = assembleSeries(MaskDirectory);
+    if (static_cast<int>(maskSeries.files.size()) != FileCount || maskSeries.width != Width || maskSeries.height != Height)
+        throw std::runtime_error("Mask series " + MaskDirectory + " does not match the volume");
+    // in the layout of the volume, slices along Y
+    VolumeMask.Resize(Width, FileCount, Height);
+    uint8_t *labels = VolumeMask.Data();
+    const std::size_t rowStride = VolumeMask.Index(0, 0, 1);
+
+    Scheduler::LoadSlices<SliceReader>(
+        FileCount,
+        0,
+        [&](SliceReader &reader, int file) {
+            uint8_t *slice = labels + VolumeMask.Index(0, file, 0);
+            reader.Read(maskSeries.files[static_cast<size_t>(file)], Width, Height, VolumeUtils::Rescale{},
+                        [slice, rowStride](int x, int row, int16_t label) {
+                uint8_t &voxel = slice[static_cast<std::size_t>(row) * rowStride + static_cast<std::size_t>(x)];
+                switch (label)
+                {
+                case 65: // bone
+                    voxel = 1;
+                    break;
+                case 129: // liver
+                    voxel = 2;
+                    break;
+                case 33: // venous system
+                    voxel = 3;
+                    break;
+                case 17: // portal vein
+                    voxel = 4;
+                    break;
+                case 193: // gallbladder
+                    voxel = 5;
+                    break;
+                case 131: // tumor
+                    voxel = 6;
+                    break;
+                case 133: // liver cyst
+                    voxel = 7;
+                    break;
+                default:
+                    voxel = 0;
+                    break;
+                }
+            });
+        },
+        [](int) {});
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Masks: " << FileCount << " slices, " << VolumeMask.SizeInBytes() / (1024 * 1024) << " MB ("
+              << elapsed.count() << " ms)\n";
 }
 
 void drawDebugMenu()
@@ -325,7 +715,23 @@ void drawDebugMenu()
     {
         camRotateY = std::clamp(camRotateY, -89.9f, 89.9f);
     }
-    if (ImGui::DragFloat("FOV", &camera.fovy, 1.0f, 10.0f, 150.0f, "%.1f"))
+    bool orthographic = camera.projection == CAMERA_ORTHOGRAPHIC;
+    if (ImGui::Checkbox("Orthographic", &orthographic))
+    {
+        // keep the target framed the same way across the switch
+        const float distance = static_cast<float>(zoom);
+        camera.fovy = orthographic ? VolumeUtils::OrthographicHeight(camera.fovy, distance)
+                                   : VolumeUtils::PerspectiveFovy(camera.fovy, distance);
+        camera.projection = orthographic ? CAMERA_ORTHOGRAPHIC : CAMERA_PERSPECTIVE;
+    }
+    if (orthographic)
+    {
+        if (ImGui::DragFloat("View Height", &camera.fovy, 1.0f, 1.0f, 1000.0f, "%.1f"))
+        {
+            camera.fovy = std::clamp(camera.fovy, 1.0f, 1000.0f);
+        }
+    }
+    else if (ImGui::DragFloat("FOV", &camera.fovy, 1.0f, 10.0f, 150.0f, "%.1f"))
     {
         camera.fovy = std::clamp(camera.fovy, 10.0f, 150.0f);
     }
@@ -357,6 +763,87 @@ void drawDebugMenu()
     // Compute final camera position at a fixed distance (zoom) from target
     camera.position = camera.target - forward * zoom;
 
+    // Ray Traversal Control
+    ImGui::Text("Traversal:");
+    ImGui::Combo("Traversal", &traversalMode, traversalModeNames, IM_ARRAYSIZE(traversalModeNames));
+    if (traversalMode == 0)
+        ImGui::Checkbox("Trilinear", &trilinear);
+    ImGui::Checkbox("Skip Empty Space", &skipEmptySpace);
+    ImGui::Text("Occupied Macrocells: %zu / %zu", Macrocells.OccupiedCount(), Macrocells.CellCount());
+
+    // Window/Level Control, applied when sampling so no reload is needed
+    ImGui::Text("Window:");
+    ImGui::DragFloat("Level (HU)", &window.center, 2.0f, -1024.0f, 3071.0f, "%.0f");
+    if (ImGui::DragFloat("Width (HU)", &window.width, 4.0f, 1.0f, 4096.0f, "%.0f"))
+        window.width = std::max(window.width, 1.0f);
+    for (const VolumeUtils::WindowPreset &preset : VolumeUtils::kWindowPresets)
+    {
+        if (&preset != VolumeUtils::kWindowPresets.data())
+            ImGui::SameLine();
+        if (ImGui::Button(preset.name))
+            window = preset.window;
+    }
+    if (Pyramid.Empty())
+        ImGui::Checkbox("8-bit Copy", &quantized);
+
+    // Classification of windowed values, the tables are rebuilt on the next frame
+    ImGui::Text("Classification:");
+    ImGui::Combo("Classification", &classification, classificationNames, IM_ARRAYSIZE(classificationNames));
+    if (classification != 0)
+    {
+        if (traversalMode == 0)
+        {
+            ImGui::SliderFloat("Step Scale", &stepScale, 0.25f, 16.0f, "%.2f");
+            if (classification == 1)
+                ImGui::Checkbox("Pre-integrated", &preIntegrated);
+        }
+        if (classification == 1)
+            Gui::EditTransferFunction(transferFunction);
+        else
+            drawWidgetEditor();
+    }
+
+    // Shading, the gradients are built on the next frame the first time it is turned on
+    ImGui::Text("Shading:");
+    ImGui::Checkbox("Shading", &shading);
+    if (shading)
+    {
+        ImGui::SliderFloat("Gradient Opacity", &gradientOpacity, 0.0f, 1.0f, "%.2f");
+        ImGui::SliderFloat("Ambient", lighting + 0, 0.0f, 1.0f);
+        ImGui::SliderFloat("Diffuse", lighting + 1, 0.0f, 1.0f);
+        ImGui::SliderFloat("Specular", lighting + 2, 0.0f, 1.0f);
+        ImGui::SliderFloat("Shininess", lighting + 3, 1.0f, 128.0f, "%.0f");
+        if (classification != 2)
+            ImGui::SliderFloat("Gradient Range", &gradientRange, 0.01f, 1.0f, "%.2f");
+    }
+
+    // Bricks of the pyramid, streamed in as the view needs them
+    if (!Pyramid.Empty())
+    {
+        ImGui::Text("Bricks:");
+        ImGui::SliderFloat("Voxel Footprint (px)", &brickDetail, 0.25f, 8.0f, "%.2f");
+        ImGui::SliderInt("Uploads / Frame", &brickUploads, 1, 512);
+        ImGui::Text("Resident: %zu / %zu, Uploaded: %d", Atlas.cache.Size(), Atlas.cache.SlotCount(), Atlas.uploads);
+        ImGui::Text("Levels: %d, Evictions: %zu", Pyramid.LevelCount(), Atlas.cache.Evictions());
+    }
+
+    // Progressive Rendering Control
+    ImGui::Text("Progressive:");
+    if (ImGui::Checkbox("Progressive", &progressive))
+        refiner.Restart();
+    if (progressive)
+    {
+        float budget = refiner.BudgetMilliseconds();
+        if (ImGui::SliderFloat("Frame Budget (ms)", &budget, 4.0f, 100.0f, "%.0f"))
+            refiner.SetBudgetMilliseconds(budget);
+        ImGui::Text("Coarse Stride: %d, Traced Stride: %d%s",
+                    refiner.CoarseStride(),
+                    refiner.Stride(),
+                    refiner.Converged() ? " (converged)" : "");
+    }
+    ImGui::Text("Frame Cache: %zu / %zu, Hits: %zu", frameCache.Size(), frameCache.Capacity(), frameCache.Hits());
+    ImGui::Checkbox("Profiler", &showProfiler);
+
     // Image Brightness Control
     ImGui::Text("Brightness:");
     ImGui::PushID("Brightness");
@@ -378,94 +865,673 @@ void drawDebugMenu()
         ImGui::SliderFloat("Venous System", maskStrength + 3, 0.0f, 1.0f);
         ImGui::SliderFloat("Portal Vein", maskStrength + 4, 0.0f, 1.0f);
         ImGui::SliderFloat("Gallbladder", maskStrength + 5, 0.0f, 1.0f);
+        ImGui::SliderFloat("Opacity Cutoff", &opacityCutoff, 0.5f, 1.0f, "%.3f");
     }
     ImGui::PopID();
 
     ImGui::End();
+    if (showProfiler)
+        Gui::DrawProfiler(Timings, kTracePath);
     rlImGuiEnd();
 }
 
+// Widgets of the 2D transfer function: a tent over values times a band of gradient magnitudes
+void drawWidgetEditor()
+{
+    ImGui::SliderFloat("Gradient Range", &gradientRange, 0.01f, 1.0f, "%.2f");
+    std::size_t removed = transferWidgets.size();
+    for (std::size_t i = 0; i < transferWidgets.size(); ++i)
+    {
+        VolumeUtils::TransferWidget &widget = transferWidgets[i];
+        ImGui::PushID(static_cast<int>(i));
+        ImGui::Separator();
+        ImGui::DragFloat("Center", &widget.center, 0.002f, 0.0f, 1.0f, "%.3f");
+        ImGui::DragFloat("Width", &widget.width, 0.002f, 0.001f, 1.0f, "%.3f");
+        ImGui::DragFloat("Gradient Low", &widget.gradientLow, 0.002f, 0.0f, widget.gradientHigh, "%.3f");
+        ImGui::DragFloat("Gradient High", &widget.gradientHigh, 0.002f, widget.gradientLow, 1.0f, "%.3f");
+        ImGui::ColorEdit4("Color", widget.color.data());
+        if (ImGui::Button("Remove"))
+            removed = i;
+        ImGui::PopID();
+    }
+    if (removed < transferWidgets.size())
+        transferWidgets.erase(transferWidgets.begin() + static_cast<std::ptrdiff_t>(removed));
+    if (ImGui::Button("Add Widget"))
+        transferWidgets.emplace_back();
+}
+
 void processArgs(int argc, char *argv[])
 {
-    if (argc < 3)
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--brick-cache" && i + 1 < argc)
+            brickCacheMegabytes = std::stoul(argv[++i]);
+        else if (arg == "--cache-dir" && i + 1 < argc)
+            cacheDirectory = argv[++i];
+        else if (arg == "--no-cache")
+            useVolumeCache = false;
+        else
+            paths.push_back(arg);
+    }
+    if (paths.empty())
     {
         std::string errMsg = "";
-        errMsg += "Expected at least 2 arguments. Usage: ";
-        errMsg += "./DVR_GPU slice_thickness base_directory <optional: "
-                  "mask_base_directory>\n";
+        errMsg += "Expected at least 1 argument. Usage: ";
+        errMsg += "./DVR_GPU [--brick-cache MB] [--cache-dir DIR | --no-cache] series_directory <optional: "
+                  "mask_series_directory>\n";
         errMsg += argv[0];
-        errMsg += " 4 myDicoms/PATIENT_DICOM/ myDicoms/LABELLED_DICOM/\n";
+        errMsg += " myDicoms/PATIENT_DICOM/ myDicoms/LABELLED_DICOM/\n";
         throw std::runtime_error(errMsg);
     }
-    SliceThickness = (int)ceil(atof(argv[1]));
-    BaseFileName = std::string(argv[2]);
-    auto dir = extractDirectory(BaseFileName);
-    Prefix = inferPrefix(dir);
-    FileCount = countFilesWithPrefix(dir, Prefix);
-    if (argc == 4)
+    SeriesDirectory = paths[0];
+    if (paths.size() == 2)
     {
-        MaskBaseFileName = std::string(argv[3]);
+        MaskDirectory = paths[1];
         HasMask = true;
     }
 }
 
+DicomSeries assembleSeries(const std::string &directory)
+{
+    Profiler::ScopedTimer timer(Timings, "Series", Profiler::kLoadStage);
+    auto start = std::chrono::steady_clock::now();
+
+    // only the headers are read, the helper groups the files by series UID and keeps their positions
+    struct SliceHeader
+    {
+        int width{0};
+        int height{0};
+        float pixelSpacing{0.0f};
+        float sliceThickness{0.0f};
+        VolumeUtils::Rescale rescale{};
+    };
+    std::map<std::string, SliceHeader> headers;
+    DICOMAppHelper appHelper;
+    DICOMParser parser;
+    for (const auto &entry : std::filesystem::directory_iterator(directory))
+    {
+        if (!entry.is_regular_file())
+            continue;
+        const std::string fileName = entry.path().string();
+        parser.ClearAllDICOMTagCallbacks();
+        if (!parser.OpenFile(fileName))
+            continue;
+        appHelper.RegisterCallbacks(&parser);
+        appHelper.ResetImageInfo(); // a tag missing from this file must not keep the last file's value
+        if (!parser.ScanHeader())
+            continue;
+        const float *spacing = appHelper.GetPixelSpacing();
+        headers[fileName] = {appHelper.GetWidth(),
+                             appHelper.GetHeight(),
+                             spacing[0],
+                             spacing[2],
+                             {appHelper.GetRescaleSlope(), appHelper.GetRescaleOffset()}};
+    }
+
+    // the series with the most slices is the one to render
+    std::vector<std::string> seriesUIDs;
+    appHelper.GetSeriesUIDs(seriesUIDs);
+    std::string seriesUID;
+    std::vector<std::pair<float, std::string>> positions;
+    for (const std::string &uid : seriesUIDs)
+    {
+        std::vector<std::pair<float, std::string>> seriesPositions;
+        appHelper.GetImagePositionPatientFilenamePairs(uid, seriesPositions);
+        if (seriesPositions.size() > positions.size())
+        {
+            seriesUID = uid;
+            positions = std::move(seriesPositions);
+        }
+    }
+    if (positions.empty())
+        throw std::runtime_error("No DICOM series found in " + directory);
 
+    DicomSeries series;
+    VolumeUtils::SliceOrder order = VolumeUtils::OrderSlices(positions);
+    if (order.files.size() == 1 && positions.size() > 1)
+    {
+        // no ImagePositionPatient, fall back to the instance numbers and the slice thickness
+        std::vector<std::pair<int, std::string>> numbers;
+        appHelper.GetSliceNumberFilenamePairs(seriesUID, numbers);
+        positions.clear();
+        for (const auto &number : numbers)
+            positions.emplace_back(static_cast<float>(number.first), number.second);
+        order = VolumeUtils::OrderSlices(positions);
+        order.spacing = 0.0f;
+    }
+    series.files = std::move(order.files);
 
-std::string extractDirectory(const std::string& imagedir) {
-    return std::filesystem::path(imagedir).parent_path().string(); // Get the directory part
+    const SliceHeader &first = headers.at(series.files.front());
+    for (const std::string &fileName : series.files)
+    {
+        const SliceHeader &header = headers.at(fileName);
+        if (header.width != first.width || header.height != first.height)
+            throw std::runtime_error("Slice " + fileName + " does not match the size of the series");
+    }
+    series.width = first.width;
+    series.height = first.height;
+    series.rescale = first.rescale;
+    series.uid = seriesUID;
+    const float pixelSpacing = first.pixelSpacing > 0.0f ? first.pixelSpacing : 1.0f;
+    const float sliceThickness = first.sliceThickness > 0.0f ? first.sliceThickness : pixelSpacing;
+    series.spacing = {pixelSpacing, pixelSpacing, order.spacing > 0.0f ? order.spacing : sliceThickness};
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Series: " << series.files.size() << " of " << headers.size() << " files in " << directory << " ("
+              << elapsed.count() << " ms)\n";
+    if (order.spacingError > 0.1f * order.spacing)
+        std::cout << "Warning: slice gaps differ from the mean spacing by up to " << order.spacingError << " mm\n";
+    return series;
 }
 
-std::string inferPrefix(const std::string& directory) {
-    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
-        if (entry.is_regular_file()) {
-            const std::string filename = entry.path().filename().string();
-            size_t underscorePos = filename.find('_');
-            if (underscorePos != std::string::npos) {
-                return filename.substr(0, underscorePos + 1); // Include the underscore in the prefix
-            }
+uint64_t sourceKey()
+{
+    // names, sizes and modification times of the source files: a file added, removed or rewritten
+    // invalidates the cache without a single DICOM header being read
+    VolumeUtils::StateHash hash;
+    auto addDirectory = [&hash](const std::string &directory) {
+        std::vector<std::filesystem::directory_entry> entries;
+        for (const auto &entry : std::filesystem::directory_iterator(directory))
+            if (entry.is_regular_file())
+                entries.push_back(entry);
+        std::sort(entries.begin(), entries.end());
+        hash.Add(entries.size());
+        for (const auto &entry : entries)
+        {
+            for (const char c : entry.path().filename().string())
+                hash.Add(c);
+            hash.Add(entry.file_size()).Add(entry.last_write_time().time_since_epoch().count());
         }
-    }
-    throw std::runtime_error("No valid files found to infer the prefix.");
+    };
+    addDirectory(SeriesDirectory);
+    hash.Add(HasMask);
+    if (HasMask)
+        addDirectory(MaskDirectory);
+    return hash.Value();
 }
 
-int countFilesWithPrefix(const std::string& directory, const std::string& prefix) {
-    int count = 0;
+std::filesystem::path volumeCachePath()
+{
+    // one file per series (and mask) directory, named after their absolute paths
+    VolumeUtils::StateHash hash;
+    for (const char c : std::filesystem::absolute(SeriesDirectory).lexically_normal().string())
+        hash.Add(c);
+    hash.Add(HasMask);
+    if (HasMask)
+        for (const char c : std::filesystem::absolute(MaskDirectory).lexically_normal().string())
+            hash.Add(c);
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.dvrcache", static_cast<unsigned long long>(hash.Value()));
+    const std::filesystem::path directory =
+        cacheDirectory.empty() ? std::filesystem::temp_directory_path() / "dvr_cache" : cacheDirectory;
+    return directory / name;
+}
 
-    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
-        if (entry.is_regular_file()) {
-            const std::string filename = entry.path().filename().string();
-            if (filename.rfind(prefix, 0) == 0) { // Check if filename starts with prefix
-                ++count;
-            }
-        }
+bool loadCachedVolume()
+{
+    if (!useVolumeCache)
+        return false;
+    Profiler::ScopedTimer timer(Timings, "Cache Read", Profiler::kLoadStage);
+    auto start = std::chrono::steady_clock::now();
+    const std::string path = volumeCachePath().string();
+    if (!VolumeCache.Open(path, sourceKey()))
+        return false;
+
+    // the mask and macrocells are cached whenever the volume is, a file without them is damaged
+    VolumeUtils::Volume<int16_t> volume;
+    VolumeUtils::Volume<uint8_t> mask;
+    VolumeUtils::MacrocellGrid<int16_t> macrocells;
+    if (!VolumeCache.Read(VolumeUtils::CacheSection::Volume, volume) ||
+        (HasMask && !VolumeCache.Read(VolumeUtils::CacheSection::Mask, mask)) || !VolumeCache.Read(macrocells) ||
+        (HasMask && mask.Dimensions() != volume.Dimensions()))
+    {
+        std::cout << "Cache: " << path << " is damaged, loading the series\n";
+        VolumeCache.Close();
+        return false;
     }
 
-    return count;
+    const VolumeUtils::VolumeCacheHeader &header = VolumeCache.Header();
+    Volume = std::move(volume);
+    VolumeMask = std::move(mask);
+    Macrocells = std::move(macrocells);
+    updateMacrocellOccupancy();
+    // the volume is stored with slices along Y
+    Width = Volume.Width();
+    FileCount = Volume.Height();
+    Height = Volume.Depth();
+    Series.width = Width;
+    Series.height = Height;
+    Series.rescale = header.rescale;
+    Series.spacing = {Volume.Spacing()[0], Volume.Spacing()[2], Volume.Spacing()[1]};
+    Series.uid = header.seriesUID.data();
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Cache: series " << Series.uid << " from " << path << ", "
+              << (Volume.SizeInBytes() + VolumeMask.SizeInBytes()) / (1024 * 1024) << " MB, stored values "
+              << header.minValue << " to " << header.maxValue << " (" << elapsed.count() << " ms)\n";
+    return true;
 }
 
-void reorderVolumes()
+void saveVolumeCache(const VolumeUtils::GradientVolume *gradients)
 {
-    uint8_t *reorderBuffer = new uint8_t[Width * Height * FileCount * SliceThickness];
-    for (int z = 0; z < FileCount * SliceThickness; ++z)
-        for (int y = 0; y < Height; ++y)
-            for (int x = 0; x < Width; ++x)
-                reorderBuffer[(y * FileCount * SliceThickness * Width) + (z * Width) + x] =
-                    Volume[(z * Height * Width) + (y * Width) + x];
-    for (int i = 0; i < Width * Height * FileCount * SliceThickness; ++i)
-        Volume[i] = reorderBuffer[i];
-
-    if (!HasMask)
-    {
-        delete[] reorderBuffer;
+    if (!useVolumeCache)
+        return;
+    Profiler::ScopedTimer timer(Timings, "Cache Write", Profiler::kLoadStage);
+    auto start = std::chrono::steady_clock::now();
+    const std::filesystem::path path = volumeCachePath();
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+
+    VolumeUtils::VolumeCacheContents contents;
+    contents.key = sourceKey();
+    contents.seriesUID = Series.uid;
+    contents.rescale = Series.rescale;
+    contents.volume = &Volume;
+    contents.mask = HasMask ? &VolumeMask : nullptr;
+    contents.gradients = gradients;
+    contents.macrocells = &Macrocells;
+    if (!VolumeUtils::WriteVolumeCache(path.string(), contents))
+    {
+        std::cout << "Cache: could not write " << path.string() << "\n";
         return;
     }
-    for (int z = 0; z < FileCount * SliceThickness; ++z)
-        for (int y = 0; y < Height; ++y)
-            for (int x = 0; x < Width; ++x)
-                reorderBuffer[(y * FileCount * SliceThickness * Width) + (z * Width) + x] =
-                    VolumeMask[(z * Height * Width) + (y * Width) + x];
-    for (int i = 0; i < Width * Height * FileCount * SliceThickness; ++i)
-        VolumeMask[i] = reorderBuffer[i];
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Cache: wrote " << path.string() << " (" << elapsed.count() << " ms)\n";
+}
 
-    delete[] reorderBuffer;
-}
\ No newline at end of file
+// Upload a volume as a 3D texture. Stored values are signed normalized R16 and the windowed copy
+// normalized R8, both with linear filtering so the texture unit interpolates between voxels. Mask
+// labels stay integers (R8UI) and packed gradients RGBA8, both for texelFetch.
+template <typename T>
+unsigned int loadVolumeTexture(const VolumeUtils::Volume<T> &volume, bool labels)
+{
+    constexpr bool wide = std::is_same_v<T, int16_t>;
+    constexpr bool packed = std::is_same_v<T, VolumeUtils::PackedGradient>;
+    static_assert(wide || packed || std::is_same_v<T, uint8_t>, "unsupported voxel type");
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxSize);
+    if (std::max({volume.Width(), volume.Height(), volume.Depth()}) > maxSize)
+    {
+        throw std::runtime_error("Volume exceeds the maximum 3D texture size of " +
+                                 std::to_string(maxSize) + ", stream it with --brick-cache");
+    }
+
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_3D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    const GLint internalFormat = wide ? GL_R16_SNORM : packed ? GL_RGBA8 : labels ? GL_R8UI : GL_R8;
+    const GLenum format = packed ? GL_RGBA : labels ? GL_RED_INTEGER : GL_RED;
+    glTexImage3D(GL_TEXTURE_3D, 0, internalFormat,
+                 volume.Width(), volume.Height(), volume.Depth(), 0,
+                 format, wide ? GL_SHORT : GL_UNSIGNED_BYTE, volume.Data());
+    const GLint filter = labels || packed ? GL_NEAREST : GL_LINEAR;
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    return texture;
+}
+
+// Replace the contents of an R8 volume texture of the same size
+void updateVolumeTexture(unsigned int texture, const VolumeUtils::Volume<uint8_t> &volume)
+{
+    glBindTexture(GL_TEXTURE_3D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, volume.Width(), volume.Height(), volume.Depth(),
+                    GL_RED, GL_UNSIGNED_BYTE, volume.Data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+// Gradients of the volume on every core, uploaded as an RGBA8 texture; only the largest magnitude
+// stays on the CPU
+unsigned int loadGradientTexture()
+{
+    Profiler::ScopedTimer timer(Timings, "Gradients", Profiler::kLoadStage);
+    auto start = std::chrono::steady_clock::now();
+    // read from the cache file when it has them, otherwise built once and added to it
+    VolumeUtils::GradientVolume gradients;
+    const bool cached = VolumeCache.IsOpen() && VolumeCache.Read(gradients) &&
+                        gradients.gradients.Dimensions() == Volume.Dimensions();
+    if (!cached)
+        gradients = VolumeUtils::BuildGradientVolume(Volume);
+    auto built = std::chrono::steady_clock::now();
+    const unsigned int texture = loadVolumeTexture(gradients.gradients);
+    gradientMaxMagnitude = gradients.maxMagnitude;
+    auto uploaded = std::chrono::steady_clock::now();
+    auto buildTime = std::chrono::duration_cast<std::chrono::milliseconds>(built - start);
+    auto uploadTime = std::chrono::duration_cast<std::chrono::milliseconds>(uploaded - built);
+    std::cout << "Gradients: " << gradients.gradients.SizeInBytes() / (1024 * 1024) << " MB, "
+              << 100 * sizeof(VolumeUtils::PackedGradient) / sizeof(int16_t) << "% of the volume ("
+              << buildTime.count() << (cached ? " ms to read, " : " ms to build, ") << uploadTime.count()
+              << " ms to upload)\n";
+    if (!cached)
+    {
+        // the file is replaced, not written through the mapping
+        VolumeCache.Close();
+        saveVolumeCache(&gradients);
+    }
+    return texture;
+}
+
+void buildMacrocells()
+{
+    Profiler::ScopedTimer timer(Timings, "Macrocells", Profiler::kLoadStage);
+    auto start = std::chrono::steady_clock::now();
+    Macrocells.Build(Volume, HasMask ? &VolumeMask : nullptr);
+    updateMacrocellOccupancy();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Macrocells: " << Macrocells.CellCount() << " (" << elapsed.count() << " ms)\n";
+}
+
+Visibility currentVisibility()
+{
+    Visibility visible{VolumeUtils::MapWindow(window, Series.rescale), {}};
+    if (classification == 1)
+        visible.table = transferFunction.Bake(kTransferSize);
+    else if (classification == 2)
+        visible.table = VolumeUtils::BakeWidgets(transferWidgets, kTransferSize, kGradientSize);
+    return visible;
+}
+
+bool updateMacrocellOccupancy()
+{
+    // only re-derive the bits when the classification actually changed
+    static bool lastApplyMask = !applyMask;
+    static float lastMaskStrength[8] = {};
+    static VolumeUtils::Window lastWindow{};
+    static int lastClassification = 0;
+    static uint64_t lastTransfer = 0;
+    const uint64_t transfer = transferKey();
+    if (!Macrocells.Empty() && lastApplyMask == applyMask &&
+        std::equal(std::begin(maskStrength), std::end(maskStrength), std::begin(lastMaskStrength)) &&
+        lastWindow.center == window.center && lastWindow.width == window.width &&
+        lastClassification == classification && lastTransfer == transfer)
+        return false;
+    lastApplyMask = applyMask;
+    std::copy(std::begin(maskStrength), std::end(maskStrength), std::begin(lastMaskStrength));
+    lastWindow = window;
+    lastClassification = classification;
+    lastTransfer = transfer;
+
+    if (!applyMask)
+    {
+        // a cell contributes if its range of values is visible
+        const Visibility visible = currentVisibility();
+        return Macrocells.UpdateOccupancy([&visible](const auto &cell) {
+            return visible(static_cast<float>(cell.minValue), static_cast<float>(cell.maxValue));
+        });
+    }
+
+    // alpha blending, a label contributes if its strength is above zero (label 0 is empty space)
+    uint32_t visibleLabels = 0;
+    for (uint32_t label = 1; label < 8; ++label)
+        if (maskStrength[label] > 0.0f)
+            visibleLabels |= 1U << label;
+    return Macrocells.UpdateOccupancy([visibleLabels](const auto &cell) { return (cell.labels & visibleLabels) != 0; });
+}
+
+uint64_t viewKey()
+{
+    // camera, image size and every setting the compute shader reads
+    VolumeUtils::StateHash hash;
+    hash.Add(frameWidth)
+        .Add(frameHeight)
+        .Add(camera.position)
+        .Add(camera.target)
+        .Add(camera.up)
+        .Add(camera.fovy)
+        .Add(camera.projection)
+        .Add(applyMask)
+        .Add(maskStrength)
+        .Add(traversalMode)
+        .Add(trilinear)
+        .Add(skipEmptySpace)
+        .Add(opacityCutoff)
+        .Add(window.center)
+        .Add(window.width)
+        .Add(quantized)
+        .Add(classification)
+        .Add(preIntegrated)
+        .Add(gradientRange)
+        .Add(shading)
+        .Add(gradientOpacity)
+        .Add(lighting)
+        .Add(gradientMaxMagnitude)
+        .Add(brightness)
+        .Add(Atlas.version)
+        .Add(transferKey());
+    return hash.Value();
+}
+
+uint64_t transferKey()
+{
+    // everything the classification tables are baked from
+    VolumeUtils::StateHash hash;
+    hash.Add(transferFunction.Hash()).Add(stepScale);
+    for (const VolumeUtils::TransferWidget &widget : transferWidgets)
+        hash.Add(widget);
+    return hash.Value();
+}
+
+// Upload an RGBA table as a linearly filtered 1D (height 1) or 2D texture, replacing the contents
+// of an existing one of the same size
+void uploadTransferTable(unsigned int &texture, int width, int height,
+                         const std::vector<VolumeUtils::Rgba> &table)
+{
+    const GLenum target = height == 1 ? GL_TEXTURE_1D : GL_TEXTURE_2D;
+    const bool create = texture == 0;
+    if (create)
+        glGenTextures(1, &texture);
+    glBindTexture(target, texture);
+    if (create && target == GL_TEXTURE_1D)
+        glTexImage1D(target, 0, GL_RGBA16F, width, 0, GL_RGBA, GL_FLOAT, table.data());
+    else if (create)
+        glTexImage2D(target, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, table.data());
+    else if (target == GL_TEXTURE_1D)
+        glTexSubImage1D(target, 0, 0, width, GL_RGBA, GL_FLOAT, table.data());
+    else
+        glTexSubImage2D(target, 0, 0, 0, width, height, GL_RGBA, GL_FLOAT, table.data());
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(target, 0);
+}
+
+// RGBA8 image of a frame, 4 bytes a pixel, stored by the compute shader and drawn with nearest
+// filtering at one texel per pixel
+unsigned int loadFrameTexture(int width, int height)
+{
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+void buildPyramid()
+{
+    Profiler::ScopedTimer timer(Timings, "Pyramid", Profiler::kLoadStage);
+    auto start = std::chrono::steady_clock::now();
+    Pyramid = VolumeUtils::BrickPyramid<int16_t>(Volume, kBrickSize);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Pyramid: " << Pyramid.LevelCount() << " levels, " << Pyramid.BrickCount() << " bricks of "
+              << kBrickSize << "^3, " << Pyramid.SizeInBytes() / (1024 * 1024) << " MB over the volume ("
+              << elapsed.count() << " ms)\n";
+}
+
+// Allocate the brick atlas within the cache budget and the maximum 3D texture size, slot 0 filled
+// with a transparent value, and a page table with one texel per finest brick
+void loadBrickAtlas()
+{
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxSize);
+    const int stored = Pyramid.StoredSize();
+    const std::size_t slotBytes = static_cast<std::size_t>(stored * stored * stored) * sizeof(int16_t);
+    const int budget = static_cast<int>(std::max<std::size_t>(brickCacheMegabytes * 1024 * 1024 / slotBytes, 2));
+    const int perAxis = maxSize / stored;
+    const int side = std::clamp(static_cast<int>(std::cbrt(static_cast<double>(budget))), 1, perAxis);
+    Atlas.slots = {side, side, std::clamp(budget / (side * side), 1, perAxis)};
+    const int slotCount = Atlas.slots[0] * Atlas.slots[1] * Atlas.slots[2];
+    if (slotCount < 2)
+        throw std::runtime_error("The brick cache needs room for at least 2 bricks");
+
+    glGenTextures(1, &Atlas.texture);
+    glBindTexture(GL_TEXTURE_3D, Atlas.texture);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R16_SNORM,
+                 Atlas.slots[0] * stored, Atlas.slots[1] * stored, Atlas.slots[2] * stored, 0,
+                 GL_RED, GL_SHORT, nullptr);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    Atlas.cache = VolumeUtils::BrickCache(static_cast<std::size_t>(slotCount - 1));
+    Atlas.emptyValue = currentVisibility().TransparentValue();
+    uploadBrick(0, std::vector<int16_t>(slotBytes / sizeof(int16_t), Atlas.emptyValue).data());
+
+    const VolumeUtils::Int3 pages = Pyramid.BrickCounts(0);
+    Atlas.pages.assign(static_cast<std::size_t>(pages[0] * pages[1] * pages[2]) * 4, 0);
+    glGenTextures(1, &Atlas.pageTable);
+    glBindTexture(GL_TEXTURE_3D, Atlas.pageTable);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8UI, pages[0], pages[1], pages[2], 0,
+                 GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, Atlas.pages.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    std::cout << "Brick cache: " << slotCount - 1 << " bricks, " << static_cast<std::size_t>(slotCount) * slotBytes / (1024 * 1024)
+              << " MB; page table " << pages[0] << "x" << pages[1] << "x" << pages[2] << "\n";
+}
+
+// Copy StoredSize()^3 voxels into atlas slot `slot`
+void uploadBrick(int slot, const int16_t *voxels)
+{
+    const int stored = Pyramid.StoredSize();
+    glBindTexture(GL_TEXTURE_3D, Atlas.texture);
+    glTexSubImage3D(GL_TEXTURE_3D, 0,
+                    slot % Atlas.slots[0] * stored,
+                    slot / Atlas.slots[0] % Atlas.slots[1] * stored,
+                    slot / (Atlas.slots[0] * Atlas.slots[1]) * stored,
+                    stored, stored, stored, GL_RED, GL_SHORT, voxels);
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+// Pick the bricks of this view by their on-screen footprint and point the page table at them.
+// At most brickUploads missing bricks are uploaded a frame, the others are read from their closest
+// resident ancestor meanwhile; the coarsest brick is touched first every frame so it never leaves
+// the atlas. Returns whether the page table changed.
+bool updateBricks()
+{
+    const bool orthographic = camera.projection == CAMERA_ORTHOGRAPHIC;
+    const Visibility visible = currentVisibility();
+    VolumeUtils::StateHash hash;
+    hash.Add(camera.position).Add(camera.fovy).Add(orthographic).Add(frameHeight).Add(brickDetail)
+        .Add(visible.mapping).Add(classification).Add(transferKey());
+    if (hash.Value() == Atlas.settledKey)
+        return false;
+
+    const int16_t emptyValue = visible.TransparentValue();
+    const int stored = Pyramid.StoredSize();
+    std::vector<int16_t> staging(static_cast<std::size_t>(stored * stored * stored), emptyValue);
+    if (emptyValue != Atlas.emptyValue)
+    {
+        uploadBrick(0, staging.data());
+        Atlas.emptyValue = emptyValue;
+    }
+
+    // cache slot of a brick, uploaded if it is missing and the frame has uploads left
+    ++Atlas.frame;
+    Atlas.uploads = 0;
+    const auto acquire = [&](const VolumeUtils::BrickKey &key, bool force) {
+        const std::size_t id = Pyramid.BrickId(key);
+        if (!force && Atlas.uploads >= brickUploads)
+            return Atlas.cache.Touch(id, Atlas.frame);
+        const VolumeUtils::BrickCache::Lookup lookup = Atlas.cache.Acquire(id, Atlas.frame);
+        if (lookup.load)
+        {
+            Pyramid.CopyBrick(key, staging.data());
+            uploadBrick(lookup.slot + 1, staging.data());
+            ++Atlas.uploads;
+        }
+        return lookup.slot;
+    };
+    const int top = Pyramid.LevelCount() - 1;
+    acquire({top, {0, 0, 0}}, true);
+
+    const VolumeUtils::Vec3 voxelSize = VolumeUtils::VoxelSize(Volume.Spacing(), 0.125f);
+    VolumeUtils::LodView view;
+    view.eye = {camera.position.x, camera.position.y, camera.position.z};
+    for (std::size_t axis = 0; axis < 3; ++axis)
+        view.boxMin[axis] = -0.5f * static_cast<float>(Volume.Dimensions()[axis]) * voxelSize[axis];
+    view.voxelSize = voxelSize;
+    if (orthographic)
+        view.pixelSize = camera.fovy / static_cast<float>(frameHeight);
+    else
+        view.pixelSlope = 2.0f * std::tan(camera.fovy * DEG2RAD * 0.5f) / static_cast<float>(frameHeight);
+    view.detail = brickDetail;
+    std::vector<VolumeUtils::BrickKey> bricks = VolumeUtils::SelectBricks(
+        Pyramid, view, Atlas.cache.SlotCount() - 1,
+        [&visible](const auto &range) { return visible(range.min, range.max); });
+    // coarse bricks cover the most, they are streamed first
+    std::stable_sort(bricks.begin(), bricks.end(), [](const auto &a, const auto &b) { return a.level > b.level; });
+
+    // every page starts on the transparent slot, each brick writes the pages it covers
+    std::vector<uint8_t> pages(Atlas.pages.size(), 0);
+    const VolumeUtils::Int3 pageCounts = Pyramid.BrickCounts(0);
+    bool settled = true;
+    for (const VolumeUtils::BrickKey &brick : bricks)
+    {
+        VolumeUtils::BrickKey source = brick;
+        int slot = acquire(source, false);
+        while (slot == VolumeUtils::BrickCache::kNoSlot)
+        {
+            source = {source.level + 1, {source.index[0] / 2, source.index[1] / 2, source.index[2] / 2}};
+            slot = Atlas.cache.Touch(Pyramid.BrickId(source), Atlas.frame);
+            settled = false;
+        }
+        const int atlasSlot = slot + 1;
+        const uint8_t entry[4] = {static_cast<uint8_t>(atlasSlot % Atlas.slots[0]),
+                                  static_cast<uint8_t>(atlasSlot / Atlas.slots[0] % Atlas.slots[1]),
+                                  static_cast<uint8_t>(atlasSlot / (Atlas.slots[0] * Atlas.slots[1])),
+                                  static_cast<uint8_t>(source.level)};
+        VolumeUtils::Int3 begin{};
+        VolumeUtils::Int3 end{};
+        for (std::size_t axis = 0; axis < 3; ++axis)
+        {
+            begin[axis] = brick.index[axis] << brick.level;
+            end[axis] = std::min((brick.index[axis] + 1) << brick.level, pageCounts[axis]);
+        }
+        for (int z = begin[2]; z < end[2]; ++z)
+            for (int y = begin[1]; y < end[1]; ++y)
+                for (int x = begin[0]; x < end[0]; ++x)
+                    std::copy(entry, entry + 4, pages.begin() + 4 * (x + pageCounts[0] * (y + pageCounts[1] * z)));
+    }
+    Atlas.settledKey = settled ? hash.Value() : 0;
+    if (pages == Atlas.pages)
+        return false;
+
+    Atlas.pages.swap(pages);
+    glBindTexture(GL_TEXTURE_3D, Atlas.pageTable);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, pageCounts[0], pageCounts[1], pageCounts[2],
+                    GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, Atlas.pages.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    ++Atlas.version;
+    return true;
+}